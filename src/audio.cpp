@@ -9,14 +9,23 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	include <emmintrin.h>
+#	define AUDIO_MIX_SSE2
+#endif
+
 #include "CDSPResampler.h"
 
+#include "movie.h"
+#include "rewind.h"
 #include "ring_buffer.h"
+#include "state.h"
 #include "vera/vera_pcm.h"
 #include "vera/vera_psg.h"
 #include "ym2151/ym2151.h"
 
 static SDL_AudioDeviceID Audio_dev            = 0;
+static bool              Audio_offline        = false;
 static int               Obtained_sample_rate = 0;
 static int               Clocks_per_sample    = 0;
 
@@ -36,6 +45,27 @@ static int              Clocks_rendered      = 0;
 
 static volatile audio_render_callback Render_callback = nullptr;
 
+// Mixer gains are Q12 fixed-point, so that a full-scale sample times the
+// maximum gain still fits comfortably in 32 bits after summing all sources.
+static constexpr int   Gain_shift = 12;
+static constexpr int   Gain_unity = 1 << Gain_shift;
+static constexpr float Max_volume = 2.0f;
+
+static float   Source_volume[AUDIO_SOURCE_COUNT] = { 1.0f, 1.0f, 1.0f };
+static bool    Source_muted[AUDIO_SOURCE_COUNT]  = { false, false, false };
+static int16_t Source_gain[AUDIO_SOURCE_COUNT]   = { Gain_unity, Gain_unity, Gain_unity };
+
+// One-pole DC blocker: y[n] = x[n] - x[n-1] + R * y[n-1]
+static constexpr float Dc_filter_r = 0.995f;
+
+struct dc_filter_state {
+	float x1;
+	float y1;
+};
+
+static bool            Dc_filter_enabled = false;
+static dc_filter_state Dc_filter[2]      = {};
+
 audio_lock_scope::audio_lock_scope()
 {
 	SDL_LockAudio();
@@ -50,25 +80,82 @@ static void audio_callback_nop(const int16_t *, const int)
 {
 }
 
+static void update_source_gain(audio_source source)
+{
+	Source_gain[source] = Source_muted[source] ? 0 : static_cast<int16_t>(Source_volume[source] * Gain_unity + 0.5f);
+}
+
+static inline int16_t clip_sample(int32_t sample)
+{
+	return static_cast<int16_t>(sample < -32768 ? -32768 : (sample > 32767 ? 32767 : sample));
+}
+
+static void mix_sources(int16_t *dst)
+{
+	const int32_t ym_gain  = Source_gain[AUDIO_SOURCE_YM];
+	const int32_t psg_gain = Source_gain[AUDIO_SOURCE_PSG];
+	const int32_t pcm_gain = Source_gain[AUDIO_SOURCE_PCM];
+
+	if (Dc_filter_enabled) {
+		// The filter is recursive, so this path stays scalar.
+		for (int i = 0; i < 2 * SAMPLES_PER_BUFFER; ++i) {
+			const int32_t   mixed = (Ym_buffer[i] * ym_gain + Psg_buffer[i] * psg_gain + Pcm_buffer[i] * pcm_gain) >> Gain_shift;
+			dc_filter_state &f    = Dc_filter[i & 1];
+
+			const float x = static_cast<float>(mixed);
+			const float y = x - f.x1 + Dc_filter_r * f.y1;
+			f.x1          = x;
+			f.y1          = y;
+
+			dst[i] = clip_sample(static_cast<int32_t>(y));
+		}
+		return;
+	}
+
+	int i = 0;
+#if defined(AUDIO_MIX_SSE2)
+	// Interleave YM and PSG samples so a single madd applies both gains per lane,
+	// then fold in PCM the same way (paired against zero) and pack with signed
+	// saturation, which gives us the final clip for free.
+	const __m128i ym_psg_gain = _mm_set1_epi32((psg_gain << 16) | (ym_gain & 0xffff));
+	const __m128i pcm_gain_v  = _mm_set1_epi32(pcm_gain & 0xffff);
+	const __m128i zero        = _mm_setzero_si128();
+	for (; i + 8 <= 2 * SAMPLES_PER_BUFFER; i += 8) {
+		const __m128i ym  = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Ym_buffer + i));
+		const __m128i psg = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Psg_buffer + i));
+		const __m128i pcm = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Pcm_buffer + i));
+
+		__m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(ym, psg), ym_psg_gain);
+		__m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(ym, psg), ym_psg_gain);
+		lo         = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(pcm, zero), pcm_gain_v));
+		hi         = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(pcm, zero), pcm_gain_v));
+		lo         = _mm_srai_epi32(lo, Gain_shift);
+		hi         = _mm_srai_epi32(hi, Gain_shift);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packs_epi32(lo, hi));
+	}
+#endif
+	for (; i < 2 * SAMPLES_PER_BUFFER; ++i) {
+		dst[i] = clip_sample((Ym_buffer[i] * ym_gain + Psg_buffer[i] * psg_gain + Pcm_buffer[i] * pcm_gain) >> Gain_shift);
+	}
+}
+
 static void audio_render_buffer()
 {
 	YM_render(Ym_buffer, SAMPLES_PER_BUFFER, Obtained_sample_rate);
 	psg_render(Psg_buffer, SAMPLES_PER_BUFFER);
 	pcm_render(Pcm_buffer, SAMPLES_PER_BUFFER);
 
-	int16_t buffer[2 * SAMPLES_PER_BUFFER];
-	memcpy(buffer, Ym_buffer, sizeof(Ym_buffer));
-	SDL_MixAudioFormat(reinterpret_cast<uint8_t *>(buffer), reinterpret_cast<uint8_t *>(Psg_buffer), AUDIO_S16, sizeof(Psg_buffer), SDL_MIX_MAXVOLUME);
-	SDL_MixAudioFormat(reinterpret_cast<uint8_t *>(buffer), reinterpret_cast<uint8_t *>(Pcm_buffer), AUDIO_S16, sizeof(Pcm_buffer), SDL_MIX_MAXVOLUME);
-
-	// Commit to the backbuffer
+	// Mix directly into the backbuffer. Only this thread ever allocates from the
+	// ring, so the mixed data stays valid for the render callback after unlocking.
+	audio_buffer *backbuffer;
 	{
 		audio_lock_scope lock;
-		audio_buffer *   backbuffer = Audio_backbuffer.allocate();
-		memcpy(backbuffer->data, buffer, sizeof(buffer));
+		backbuffer = Audio_backbuffer.allocate();
+		mix_sources(backbuffer->data);
 	}
 
-	Render_callback(reinterpret_cast<int16_t *>(buffer), SAMPLES_PER_BUFFER);
+	Render_callback(backbuffer->data, SAMPLES_PER_BUFFER);
 }
 
 static void audio_callback(void *, Uint8 *stream, int len)
@@ -129,8 +216,24 @@ void audio_init(const char *dev_name, int /*num_audio_buffers*/)
 	SDL_PauseAudioDevice(Audio_dev, 0);
 }
 
+void audio_init_offline()
+{
+	if (Audio_dev > 0) {
+		audio_close();
+	}
+
+	Render_callback = audio_callback_nop;
+
+	// No device: samples are only handed to the render callback, as fast as the machine can produce them.
+	Audio_offline        = true;
+	Obtained_sample_rate = SAMPLERATE;
+	Clocks_per_sample    = 8000000 / Obtained_sample_rate;
+}
+
 void audio_close(void)
 {
+	Audio_offline = false;
+
 	if (Audio_dev == 0) {
 		return;
 	}
@@ -141,7 +244,7 @@ void audio_close(void)
 
 void audio_render(int cpu_clocks)
 {
-	if (Audio_dev == 0) {
+	if (Audio_dev == 0 && !Audio_offline) {
 		return;
 	}
 
@@ -155,11 +258,41 @@ void audio_render(int cpu_clocks)
 		Clocks_rendered -= Clocks_per_sample * SAMPLES_PER_BUFFER;
 	}
 
+	if (Audio_offline || Audio_backbuffer.count() >= Low_buffer_threshold) {
+		return;
+	}
+
+	// Topping up follows the host's timing, and rendering drains VERA's PCM FIFO, which
+	// the program can see. Movies and step-back re-runs need the same timing every time,
+	// so while either could be asked for, the device gets silence to catch up with.
+	if (movie_is_recording() || movie_is_replaying() || rewind_num_frames() > 0) {
+		audio_lock_scope lock;
+		while (Audio_backbuffer.count() < Low_buffer_threshold) {
+			audio_buffer *backbuffer = Audio_backbuffer.allocate();
+			memset(backbuffer->data, 0, sizeof(backbuffer->data));
+		}
+		return;
+	}
+
 	while (Audio_backbuffer.count() < Low_buffer_threshold) {
 		audio_render_buffer();
 	}
 }
 
+void audio_save_restore(state_stream &state)
+{
+	state.field(Clocks_rendered);
+}
+
+void audio_render_silent(int cpu_clocks)
+{
+	if (Audio_dev == 0 && !Audio_offline) {
+		return;
+	}
+
+	YM_prerender(cpu_clocks);
+}
+
 void audio_usage(void)
 {
 	// SDL_GetAudioDeviceName doesn't work if audio isn't initialized.
@@ -205,4 +338,39 @@ void audio_set_render_callback(audio_render_callback cb)
 {
 	audio_lock_scope lock;
 	Render_callback = cb;
+}
+
+void audio_set_source_volume(audio_source source, float volume)
+{
+	Source_volume[source] = volume < 0.0f ? 0.0f : (volume > Max_volume ? Max_volume : volume);
+	update_source_gain(source);
+}
+
+float audio_get_source_volume(audio_source source)
+{
+	return Source_volume[source];
+}
+
+void audio_set_source_muted(audio_source source, bool muted)
+{
+	Source_muted[source] = muted;
+	update_source_gain(source);
+}
+
+bool audio_get_source_muted(audio_source source)
+{
+	return Source_muted[source];
+}
+
+void audio_set_dc_filter_enabled(bool enabled)
+{
+	if (enabled && !Dc_filter_enabled) {
+		memset(Dc_filter, 0, sizeof(Dc_filter));
+	}
+	Dc_filter_enabled = enabled;
+}
+
+bool audio_get_dc_filter_enabled()
+{
+	return Dc_filter_enabled;
 }
\ No newline at end of file
@@ -13,6 +13,8 @@
 #	define SAMPLES_PER_BUFFER (256)
 #endif
 
+class state_stream;
+
 class audio_lock_scope
 {
 public:
@@ -20,12 +22,28 @@ public:
 	~audio_lock_scope();
 };
 
+enum audio_source {
+	AUDIO_SOURCE_YM,
+	AUDIO_SOURCE_PSG,
+	AUDIO_SOURCE_PCM,
+	AUDIO_SOURCE_COUNT
+};
+
 using audio_render_callback = void (*)(const int16_t *samples, const int num_samples);
 
 void audio_init(const char *dev_name, int num_audio_buffers);
+void audio_init_offline();
 void audio_close(void);
 void audio_render(int cpu_clocks);
 
+// The clocks not yet rendered decide when the next block drains VERA's PCM FIFO,
+// so they're part of the machine's state.
+void audio_save_restore(state_stream &state);
+
+// Keeps the YM2151's timers going like audio_render() does, without producing any
+// output. For frames that get rolled back and must not be heard.
+void audio_render_silent(int cpu_clocks);
+
 void audio_usage(void);
 
 void audio_get_psg_buffer(int16_t *dst);
@@ -34,3 +52,11 @@ void audio_get_ym_buffer(int16_t *dst);
 
 int audio_get_sample_rate();
 void audio_set_render_callback(audio_render_callback cb);
+
+void  audio_set_source_volume(audio_source source, float volume);
+float audio_get_source_volume(audio_source source);
+void  audio_set_source_muted(audio_source source, bool muted);
+bool  audio_get_source_muted(audio_source source);
+
+void audio_set_dc_filter_enabled(bool enabled);
+bool audio_get_dc_filter_enabled();
@@ -0,0 +1,131 @@
+#include "call_stack.h"
+
+#include "cpu/fake6502.h"
+#include "glue.h"
+#include "memory.h"
+
+// Every call pushes at least two bytes, so a real stack can't hold more than this.
+static constexpr int Max_depth = 128;
+
+static bool       Enabled = true;
+static call_frame Frames[Max_depth];
+static int        Depth = 0;
+
+static routine_profile_list Profile;
+static uint64_t             Frame_start_clock = 0;
+static uint64_t             Last_frame_clocks = 0;
+
+static routine_cycles &cycles_for(const call_frame &frame)
+{
+	return Profile[(uint32_t)frame.bank << 16 | frame.address].frame;
+}
+
+void call_stack_enable(bool enable)
+{
+	Enabled = enable;
+}
+
+void call_stack_reset()
+{
+	if (Enabled) {
+		Depth             = 0;
+		Frame_start_clock = clockticks6502;
+	}
+}
+
+void call_stack_reset_profile()
+{
+	Profile.clear();
+	Frame_start_clock = clockticks6502;
+	Last_frame_clocks = 0;
+}
+
+void call_stack_new_frame()
+{
+	if (!Enabled) {
+		return;
+	}
+
+	// Innermost first, so each frame has its children's cycles before working out its own.
+	for (int i = Depth - 1; i >= 0; --i) {
+		call_frame    &frame     = Frames[i];
+		const uint64_t inclusive = clockticks6502 - frame.entry_clock;
+
+		routine_cycles &cycles = cycles_for(frame);
+		cycles.inclusive += inclusive;
+		cycles.exclusive += inclusive - frame.child_clocks;
+		if (i > 0) {
+			Frames[i - 1].child_clocks += inclusive;
+		}
+		frame.entry_clock  = clockticks6502;
+		frame.child_clocks = 0;
+	}
+
+	for (auto &[key, profile] : Profile) {
+		profile.total.calls += profile.frame.calls;
+		profile.total.inclusive += profile.frame.inclusive;
+		profile.total.exclusive += profile.frame.exclusive;
+		profile.last_frame = profile.frame;
+		profile.frame      = {};
+	}
+
+	Last_frame_clocks = clockticks6502 - Frame_start_clock;
+	Frame_start_clock = clockticks6502;
+}
+
+void call_stack_enter(uint16_t address, uint16_t caller, call_kind kind)
+{
+	if (!Enabled || Depth == Max_depth) {
+		return;
+	}
+
+	call_frame &frame  = Frames[Depth++];
+	frame.address      = address;
+	frame.bank         = address >= 0xa000 ? memory_get_current_bank(address) : 0;
+	frame.kind         = kind;
+	frame.caller       = caller;
+	frame.sp           = sp + (kind == call_kind::jsr ? 2 : 3);
+	frame.entry_clock  = clockticks6502;
+	frame.child_clocks = 0;
+
+	++cycles_for(frame).calls;
+}
+
+void call_stack_leave()
+{
+	if (!Enabled) {
+		return;
+	}
+
+	while (Depth > 0 && Frames[Depth - 1].sp <= sp) {
+		const call_frame &frame     = Frames[--Depth];
+		const uint64_t    inclusive = clockticks6502 - frame.entry_clock;
+
+		routine_cycles &cycles = cycles_for(frame);
+		cycles.inclusive += inclusive;
+		cycles.exclusive += inclusive - frame.child_clocks;
+		if (Depth > 0) {
+			Frames[Depth - 1].child_clocks += inclusive;
+		}
+	}
+}
+
+int call_stack_depth()
+{
+	return Depth;
+}
+
+const call_frame &call_stack_get_frame(int index)
+{
+	return Frames[index];
+}
+
+const routine_profile_list &call_stack_get_profile()
+{
+	return Profile;
+}
+
+uint64_t call_stack_last_frame_clocks()
+{
+	return Last_frame_clocks;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#if !defined(CALL_STACK_H)
+#	define CALL_STACK_H
+
+#	include <stdint.h>
+#	include <unordered_map>
+
+// A shadow of the 6502's call stack, kept by the CPU core as it enters and leaves
+// subroutines and interrupt handlers, and the cycles spent in each routine. It costs
+// a little work per JSR, RTS, RTI and interrupt, so it's always on.
+//
+// A frame is left when the stack pointer goes back above where it was when the frame
+// was entered, so routines that drop their return address (PLA PLA RTS), or return
+// from a caller's frame, unwind the frames in between instead of leaving them stuck.
+
+enum class call_kind : uint8_t {
+	jsr,
+	brk,
+	irq,
+	nmi,
+};
+
+struct call_frame {
+	uint16_t  address; // of the routine
+	uint8_t   bank;
+	call_kind kind;
+	uint16_t  caller; // address of the JSR or BRK, or the instruction an interrupt came before
+	uint8_t   sp;     // before the return address was pushed
+	uint64_t  entry_clock;
+	uint64_t  child_clocks;
+};
+
+struct routine_cycles {
+	uint32_t calls;
+	uint64_t inclusive; // counting the routines it called and interrupts that came in
+	uint64_t exclusive; // counting only its own instructions
+};
+
+struct routine_profile {
+	routine_cycles frame;      // so far in this video frame
+	routine_cycles last_frame; // in the last complete video frame
+	routine_cycles total;      // since the last reset
+};
+
+// Keyed by bank << 16 | address. The bank is 0 below $A000.
+using routine_profile_list = std::unordered_map<uint32_t, routine_profile>;
+
+// Turned off (as for run-ahead's frames), nothing enters, leaves or resets the stack.
+void call_stack_enable(bool enable);
+
+// Forget the stack, e.g. when the machine is reset or loaded from a state. The
+// routines' cycles are kept.
+void call_stack_reset();
+
+// Clear the routines' cycles.
+void call_stack_reset_profile();
+
+// Call at the end of each video frame. Routines still on the stack get the cycles they
+// had so far in the frame, so a main loop that never returns shows up too.
+void call_stack_new_frame();
+
+// Called by the CPU core after a JSR, BRK or interrupt has pushed its return address,
+// and after an RTS or RTI has pulled one.
+void call_stack_enter(uint16_t address, uint16_t caller, call_kind kind);
+void call_stack_leave();
+
+// Frame 0 is the outermost.
+int               call_stack_depth();
+const call_frame &call_stack_get_frame(int index);
+
+const routine_profile_list &call_stack_get_profile();
+
+// Cycles in the last complete video frame.
+uint64_t call_stack_last_frame_clocks();
+
+#endif
@@ -104,7 +104,9 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include "../call_stack.h"
 #include "../debugger.h"
+#include "../state.h"
 
 //6502 defines
 #define UNDOCUMENTED //when this is defined, undocumented opcodes are handled.
@@ -169,19 +171,23 @@ static void putvalue(uint16_t saveval)
 
 void nmi6502()
 {
+	const uint16_t caller = pc;
 	push16(pc);
 	push8(status);
 	status |= FLAG_INTERRUPT;
 	pc      = (uint16_t)read6502(0xFFFA) | ((uint16_t)read6502(0xFFFB) << 8);
+	call_stack_enter(pc, caller, call_kind::nmi);
 	waiting = 0;
 }
 
 void irq6502()
 {
+	const uint16_t caller = pc;
 	push16(pc);
 	push8(status & ~FLAG_BREAK);
 	status |= FLAG_INTERRUPT;
 	pc      = (uint16_t)read6502(0xFFFE) | ((uint16_t)read6502(0xFFFF) << 8);
+	call_stack_enter(pc, caller, call_kind::irq);
 	waiting = 0;
 }
 
@@ -245,6 +251,20 @@ void step6502()
 		(*loopexternal)();
 }
 
+void save_restore6502(state_stream &state)
+{
+	state.field(pc);
+	state.field(sp);
+	state.field(a);
+	state.field(x);
+	state.field(y);
+	state.field(status);
+	state.field(instructions);
+	state.field(clockticks6502);
+	state.field(clockgoal6502);
+	state.field(waiting);
+}
+
 void hookexternal(void (*funcptr)())
 {
 	if (funcptr != (void *)NULL) {
@@ -7,11 +7,14 @@
 
 #include <stdint.h>
 
+class state_stream;
+
 extern void     reset6502();
 extern void     step6502();
 extern void     exec6502(uint32_t tickcount);
 extern void     nmi6502();
 extern void     irq6502();
+extern void     save_restore6502(state_stream &state);
 extern uint64_t clockticks6502;
 
 #endif
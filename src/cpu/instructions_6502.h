@@ -175,6 +175,7 @@ bpl()
 static void
 brk()
 {
+	const uint16_t caller = pc - 1;
 	pc++;
 
 	push16(pc);                 //push next instruction address onto stack
@@ -182,6 +183,7 @@ brk()
 	setinterrupt();             //set interrupt flag
 	cleardecimal();             // clear decimal flag (65C02 change)
 	pc = (uint16_t)read6502(0xFFFE) | ((uint16_t)read6502(0xFFFF) << 8);
+	call_stack_enter(pc, caller, call_kind::brk);
 }
 
 static void
@@ -369,6 +371,7 @@ static void
 jsr()
 {
 	push16(pc - 1);
+	call_stack_enter(ea, pc - 3, call_kind::jsr);
 	pc = ea;
 }
 
@@ -511,6 +514,7 @@ rti()
 	status = pull8();
 	value  = pull16();
 	pc     = value;
+	call_stack_leave();
 }
 
 static void
@@ -518,6 +522,7 @@ rts()
 {
 	value = pull16();
 	pc    = value + 1;
+	call_stack_leave();
 }
 
 static void
@@ -1,12 +1,39 @@
 #include "debugger.h"
+#include <algorithm>
+#include <map>
+
 #include "cpu/fake6502.h"
+#include "expression.h"
 #include "glue.h"
 #include "memory.h"
+#include "rewind.h"
+#include "ring_buffer.h"
+#include "trace.h"
+#include "vera/vera_video.h"
 
 static breakpoint_list Breakpoints;
 static breakpoint_list Active_breakpoints;
 static bool            Breakpoint_check[0x10000];
 
+struct breakpoint_condition {
+	expression condition;
+	bool       log  = false;
+	uint32_t   hits = 0;
+};
+
+// Only for breakpoints with a condition or logging.
+static std::map<breakpoint_type, breakpoint_condition> Conditions;
+static std::string                                     Breakpoint_error;
+static uint64_t                                        Condition_clock = UINT64_MAX; // when Condition_fired was worked out
+static bool                                            Condition_fired = false;
+
+static ring_buffer<breakpoint_log_entry, 1024> Log;
+
+static watchpoint_list Watchpoints;
+static watchpoint_hit  Watch_hit;
+static bool            Watch_hit_valid = false;
+static bool            Watch_enabled   = true;
+
 enum debugger_mode {
 	DEBUG_RUN,
 	DEBUG_PAUSE,
@@ -14,7 +41,10 @@ enum debugger_mode {
 	DEBUG_STEP_OVER,
 	DEBUG_STEP_OUT_RUN,
 	DEBUG_STEP_OUT_OVER,
-	DEBUG_STEP_OUT_RETURN
+	DEBUG_STEP_OUT_RETURN,
+	DEBUG_STEP_BACK_INTO,
+	DEBUG_STEP_BACK_OVER,
+	DEBUG_STEP_BACK_RUN
 };
 
 static debugger_mode   Debug_mode      = DEBUG_RUN;
@@ -22,6 +52,8 @@ static uint64_t        Step_clocks     = 0;
 static uint8_t         Step_interrupt  = 0x04;
 static uint8_t         Interrupt_check = 0x04;
 static breakpoint_type Step_target     = { 0, 0 };
+static bool            Stepping_back   = false;
+static int             Step_back_depth = 0; // calls and interrupts entered, less those returned from
 
 uint16_t debug_peek16(uint16_t addr)
 {
@@ -48,6 +80,30 @@ static bool execution_exited_interrupt()
 	return (Step_interrupt != 0) && (Step_interrupt != (status & 0x04));
 }
 
+static bool condition_fired(breakpoint_type current_pc)
+{
+	const auto c = Conditions.find(current_pc);
+	if (c == Conditions.end()) {
+		return true;
+	}
+
+	// The UI also asks whether we're paused; only count getting here once.
+	if (Condition_clock == clockticks6502) {
+		return Condition_fired;
+	}
+	Condition_clock = clockticks6502;
+
+	breakpoint_condition &bc = c->second;
+	++bc.hits;
+	Condition_fired = bc.condition.evaluate(bc.hits) != 0;
+
+	if (Condition_fired && bc.log) {
+		Log.add(breakpoint_log_entry{ clockticks6502, pc, std::get<1>(current_pc), a, x, y, sp, status, bc.hits });
+		Condition_fired = false;
+	}
+	return Condition_fired;
+}
+
 static bool breakpoint_hit(breakpoint_type current_pc)
 {
 	// If the debugger was set to run, make sure it allows at least one CPU cycle...
@@ -55,7 +111,7 @@ static bool breakpoint_hit(breakpoint_type current_pc)
 		return false;
 	}
 	if (Breakpoint_check[breakpoint_addr(current_pc)]) {
-		return Active_breakpoints.find(current_pc) != Active_breakpoints.end();
+		return Active_breakpoints.find(current_pc) != Active_breakpoints.end() && condition_fired(current_pc);
 	}
 	return false;
 }
@@ -72,6 +128,9 @@ bool debugger_is_paused()
 			}
 			break;
 		case DEBUG_PAUSE:
+		case DEBUG_STEP_BACK_INTO:
+		case DEBUG_STEP_BACK_OVER:
+		case DEBUG_STEP_BACK_RUN:
 			return true;
 		case DEBUG_STEP_INTO:
 			if (Step_clocks != clockticks6502) {
@@ -161,6 +220,7 @@ void debugger_pause_execution()
 
 void debugger_continue_execution()
 {
+	Watch_hit_valid = false;
 	Debug_mode      = DEBUG_RUN;
 	Step_clocks     = clockticks6502;
 	Step_interrupt  = 0x04;
@@ -169,8 +229,9 @@ void debugger_continue_execution()
 
 void debugger_step_execution()
 {
-	Debug_mode  = DEBUG_STEP_INTO;
-	Step_clocks = clockticks6502;
+	Watch_hit_valid = false;
+	Debug_mode      = DEBUG_STEP_INTO;
+	Step_clocks     = clockticks6502;
 	Step_interrupt  = status & 0x04;
 	Interrupt_check = Step_interrupt;
 }
@@ -178,6 +239,7 @@ void debugger_step_execution()
 void debugger_step_over_execution()
 {
 	if (debug_read6502(pc) == 0x20) {
+		Watch_hit_valid         = false;
 		Debug_mode              = DEBUG_STEP_OVER;
 		Step_clocks             = clockticks6502;
 		Step_interrupt          = status & 0x04;
@@ -191,6 +253,7 @@ void debugger_step_over_execution()
 
 void debugger_step_out_execution()
 {
+	Watch_hit_valid = false;
 	Step_clocks     = clockticks6502;
 	Step_interrupt  = status & 0x04;
 	Interrupt_check = Step_interrupt;
@@ -223,6 +286,152 @@ void debugger_step_out_execution()
 	}
 }
 
+void debugger_step_back_execution()
+{
+	Debug_mode = DEBUG_STEP_BACK_INTO;
+}
+
+void debugger_step_back_over_execution()
+{
+	Debug_mode = DEBUG_STEP_BACK_OVER;
+}
+
+void debugger_continue_back_execution()
+{
+	Debug_mode = DEBUG_STEP_BACK_RUN;
+}
+
+bool debugger_can_step_back()
+{
+	return rewind_num_frames() > 0 && rewind_frame_clockticks(0) < clockticks6502;
+}
+
+static bool any_instruction()
+{
+	return true;
+}
+
+static bool active_breakpoint()
+{
+	// A watchpoint was hit by the instruction just run.
+	if (Watch_hit_valid) {
+		return true;
+	}
+
+	const breakpoint_type current_pc = get_current_pc();
+	if (!Breakpoint_check[pc] || Active_breakpoints.find(current_pc) == Active_breakpoints.end()) {
+		return false;
+	}
+	// Without counting hits again, or logging them again.
+	const auto c = Conditions.find(current_pc);
+	return c == Conditions.end() || (!c->second.log && c->second.condition.evaluate(c->second.hits) != 0);
+}
+
+// Runs on until the clock, which has to be an instruction boundary on the path the
+// machine takes from here. If asked, notes the latest instruction at each call depth
+// that accept() likes.
+static void retrace(uint64_t until, bool (*accept)() = nullptr, std::map<int, uint64_t> *latest = nullptr)
+{
+	Step_back_depth = 0;
+	Watch_hit_valid = false;
+	while (clockticks6502 < until) {
+		if (accept != nullptr && accept()) {
+			(*latest)[Step_back_depth] = clockticks6502;
+		}
+
+		const uint8_t opcode = debug_read6502(pc);
+		bool          new_frame;
+		Watch_hit_valid = false;
+		if (!machine_step(new_frame)) {
+			break;
+		}
+		switch (opcode) {
+			case 0x00: // brk
+			case 0x20: // jsr
+				++Step_back_depth;
+				break;
+			case 0x40: // rti
+			case 0x60: // rts
+				--Step_back_depth;
+				break;
+		}
+		if (new_frame) {
+			rewind_capture();
+		}
+	}
+}
+
+// Nothing is recorded on the way forward. Instead, the machine goes back to a rewind frame
+// and runs up to where it was, with the same input fed again, looking for the instruction
+// to stop at. If that's not found in the last frame's worth of instructions, it tries again
+// from twice as far back, and so on.
+static void step_back(bool (*accept)(), bool same_level)
+{
+	const uint64_t now = clockticks6502;
+
+	int num_frames = 0;
+	while (num_frames < rewind_num_frames() && rewind_frame_clockticks(num_frames) < now) {
+		++num_frames;
+	}
+
+	trace_suspend(true);
+	Stepping_back   = true;
+	bool     found  = false;
+	uint64_t target = now;
+	for (int span = 1; num_frames > 0; span *= 2) {
+		const int first = std::max(0, num_frames - span);
+		if (!rewind_replay_from(rewind_frame_clockticks(first))) {
+			break;
+		}
+
+		std::map<int, uint64_t> latest;
+		retrace(now, accept, &latest);
+		for (const auto &[depth, clock] : latest) {
+			if ((!same_level || depth <= Step_back_depth) && (!found || clock > target)) {
+				found  = true;
+				target = clock;
+			}
+		}
+
+		if (found || first == 0) {
+			break;
+		}
+	}
+
+	// Running back with no breakpoint on the way ends up as far back as it can go.
+	if (!found && accept == active_breakpoint && num_frames > 0) {
+		found  = true;
+		target = rewind_frame_clockticks(0);
+	}
+	if (found && rewind_replay_from(target)) {
+		retrace(target);
+	}
+	Stepping_back = false;
+	trace_suspend(false);
+}
+
+void debugger_step_back_process()
+{
+	switch (Debug_mode) {
+		case DEBUG_STEP_BACK_INTO:
+			step_back(any_instruction, false);
+			break;
+		case DEBUG_STEP_BACK_OVER:
+			step_back(any_instruction, true);
+			break;
+		case DEBUG_STEP_BACK_RUN:
+			step_back(active_breakpoint, false);
+			break;
+		default:
+			return;
+	}
+
+	Debug_mode      = DEBUG_PAUSE;
+	Step_clocks     = clockticks6502;
+	Step_interrupt  = status & 0x04;
+	Interrupt_check = Step_interrupt;
+}
+
 uint64_t debugger_step_clocks()
 {
 	return clockticks6502 - Step_clocks;
@@ -231,6 +440,9 @@ uint64_t debugger_step_clocks()
 void debugger_interrupt()
 {
 	Interrupt_check |= status & 0x04;
+	if (Stepping_back) {
+		++Step_back_depth;
+	}
 }
 
 bool debugger_step_interrupted()
@@ -238,18 +450,37 @@ bool debugger_step_interrupted()
 	return Interrupt_check != Step_interrupt;
 }
 
-void debugger_add_breakpoint(uint16_t address, uint8_t bank /* = 0 */)
+bool debugger_add_breakpoint(uint16_t address, uint8_t bank /* = 0 */, const char *condition /* = "" */, bool log /* = false */)
 {
 	if (address < 0xa000) {
 		bank = 0;
 	}
 
 	breakpoint_type new_bp{ address, bank };
+	if (*condition != '\0' || log) {
+		breakpoint_condition bc;
+		if (*condition != '\0' && !bc.condition.compile(condition)) {
+			Breakpoint_error = bc.condition.error();
+			return false;
+		}
+		bc.log             = log;
+		Conditions[new_bp] = std::move(bc);
+	} else {
+		Conditions.erase(new_bp);
+	}
+	Condition_clock = UINT64_MAX;
+
 	if (Breakpoints.find(new_bp) == Breakpoints.end()) {
 		Breakpoints.insert(new_bp);
 		Active_breakpoints.insert(new_bp);
 		Breakpoint_check[address] = true;
 	}
+	return true;
+}
+
+const char *debugger_breakpoint_error()
+{
+	return Breakpoint_error.c_str();
 }
 
 void debugger_remove_breakpoint(uint16_t address, uint8_t bank /* = 0 */)
@@ -261,6 +492,7 @@ void debugger_remove_breakpoint(uint16_t address, uint8_t bank /* = 0 */)
 	breakpoint_type old_bp{ address, bank };
 	Breakpoints.erase(old_bp);
 	Active_breakpoints.erase(old_bp);
+	Conditions.erase(old_bp);
 	Breakpoint_check[address] = false;
 	for (const auto &bp : Active_breakpoints) {
 		if (breakpoint_addr(bp) == address) {
@@ -314,3 +546,125 @@ const breakpoint_list &debugger_get_breakpoints()
 {
 	return Breakpoints;
 }
+
+const char *debugger_get_breakpoint_condition(uint16_t address, uint8_t bank /* = 0 */)
+{
+	const auto c = Conditions.find(breakpoint_type{ address, bank });
+	return c != Conditions.end() ? c->second.condition.text().c_str() : "";
+}
+
+bool debugger_breakpoint_is_logpoint(uint16_t address, uint8_t bank /* = 0 */)
+{
+	const auto c = Conditions.find(breakpoint_type{ address, bank });
+	return c != Conditions.end() && c->second.log;
+}
+
+uint32_t debugger_get_breakpoint_hits(uint16_t address, uint8_t bank /* = 0 */)
+{
+	const auto c = Conditions.find(breakpoint_type{ address, bank });
+	return c != Conditions.end() ? c->second.hits : 0;
+}
+
+size_t debugger_get_log_size()
+{
+	return Log.count();
+}
+
+const breakpoint_log_entry &debugger_get_log_entry(size_t index)
+{
+	return Log[(int)index];
+}
+
+void debugger_clear_log()
+{
+	Log.clear();
+}
+
+static void update_watch_page(watch_space space, uint32_t address)
+{
+	uint8_t *pages = space == watch_space::cpu ? memory_get_watch_pages() : vera_video_get_watch_pages();
+
+	pages[address >> 8] = 0;
+	for (const auto &[wp, flags] : Watchpoints) {
+		const auto &[wp_space, wp_address, wp_bank] = wp;
+		if (wp_space == space && (wp_address >> 8) == (address >> 8)) {
+			pages[address >> 8] |= flags;
+		}
+	}
+}
+
+void debugger_add_watchpoint(watch_space space, uint32_t address, uint8_t bank, uint8_t flags)
+{
+	address &= space == watch_space::cpu ? 0xffff : 0x1ffff;
+	if (space == watch_space::vram || address < 0xa000) {
+		bank = 0;
+	}
+
+	if (flags == 0) {
+		Watchpoints.erase(watchpoint_type{ space, address, bank });
+	} else {
+		Watchpoints[watchpoint_type{ space, address, bank }] = flags;
+	}
+	update_watch_page(space, address);
+}
+
+void debugger_remove_watchpoint(watch_space space, uint32_t address, uint8_t bank /* = 0 */)
+{
+	debugger_add_watchpoint(space, address, bank, 0);
+}
+
+const watchpoint_list &debugger_get_watchpoints()
+{
+	return Watchpoints;
+}
+
+const watchpoint_hit *debugger_get_watchpoint_hit()
+{
+	return Watch_hit_valid ? &Watch_hit : nullptr;
+}
+
+void debugger_enable_watchpoints(bool enable)
+{
+	Watch_enabled = enable;
+}
+
+static void watch_access(uint8_t flags, const watchpoint_hit &hit)
+{
+	if ((flags & hit.flag) == 0 && !(hit.flag == WATCH_WRITE && (flags & WATCH_CHANGE) && hit.old_value != hit.value)) {
+		return;
+	}
+
+	Watch_hit       = hit;
+	Watch_hit_valid = true;
+	// Going back over old ground only notes where it would have stopped.
+	if (!Stepping_back) {
+		Debug_mode = DEBUG_PAUSE;
+	}
+}
+
+void debugger_watch_cpu(uint16_t address, uint8_t bank, uint8_t flag, uint8_t old_value, uint8_t value)
+{
+	if (!Watch_enabled) {
+		return;
+	}
+	if (address < 0xa000) {
+		bank = 0;
+	}
+
+	const auto wp = Watchpoints.find(watchpoint_type{ watch_space::cpu, address, bank });
+	if (wp != Watchpoints.end()) {
+		watch_access(wp->second, watchpoint_hit{ watch_space::cpu, address, bank, flag, old_value, value });
+	}
+}
+
+void debugger_watch_vram(uint32_t address, uint8_t flag, uint8_t old_value, uint8_t value)
+{
+	if (!Watch_enabled) {
+		return;
+	}
+
+	const auto wp = Watchpoints.find(watchpoint_type{ watch_space::vram, address, 0 });
+	if (wp != Watchpoints.end()) {
+		watch_access(wp->second, watchpoint_hit{ watch_space::vram, address, 0, flag, old_value, value });
+	}
+}
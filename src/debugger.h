@@ -2,12 +2,45 @@
 #ifndef DEBUGGER_H
 #	define DEBUGGER_H
 
+#	include <map>
 #	include <set>
+#	include <stdint.h>
 #	include <tuple>
 
 using breakpoint_type = std::tuple<uint16_t, uint8_t>;
 using breakpoint_list = std::set<breakpoint_type>;
 
+enum class watch_space : uint8_t {
+	cpu,
+	vram,
+};
+
+enum watch_flags : uint8_t {
+	WATCH_READ   = 1,
+	WATCH_WRITE  = 2,
+	WATCH_CHANGE = 4, // a write of a different value
+};
+
+using watchpoint_type = std::tuple<watch_space, uint32_t, uint8_t>; // space, address, bank
+using watchpoint_list = std::map<watchpoint_type, uint8_t>;         // watch_flags
+
+struct breakpoint_log_entry {
+	uint64_t clock;
+	uint16_t address;
+	uint8_t  bank;
+	uint8_t  a, x, y, sp, status;
+	uint32_t hits;
+};
+
+struct watchpoint_hit {
+	watch_space space;
+	uint32_t    address;
+	uint8_t     bank;
+	uint8_t     flag; // WATCH_READ or WATCH_WRITE
+	uint8_t     old_value;
+	uint8_t     value;
+};
+
 bool debugger_is_paused();
 
 void debugger_pause_execution();
@@ -16,18 +49,63 @@ void debugger_step_execution();
 void debugger_step_over_execution();
 void debugger_step_out_execution();
 
+// Stepping backwards goes back to a rewind frame and runs forward again, so it needs
+// -rewind and only reaches as far back as the frames do.
+void debugger_step_back_execution();
+void debugger_step_back_over_execution();
+void debugger_continue_back_execution();
+bool debugger_can_step_back();
+
+// Does whatever stepping backwards was asked for. Call between instructions.
+void debugger_step_back_process();
+
 uint64_t debugger_step_clocks();
 void     debugger_interrupt();
 bool     debugger_step_interrupted();
 
 // Bank parameter is only meaninful for addresses >= $A000.
 // Addresses < $A000 will force bank to 0.
-void debugger_add_breakpoint(uint16_t address, uint8_t bank = 0);
+//
+// A breakpoint with a condition (see expression.h) only fires when it's non-zero. A
+// logpoint adds an entry to the log when it fires, and lets execution go on. Adding a
+// breakpoint again replaces its condition. Returns false if the condition doesn't
+// compile, and debugger_breakpoint_error() says why.
+bool        debugger_add_breakpoint(uint16_t address, uint8_t bank = 0, const char *condition = "", bool log = false);
+const char *debugger_breakpoint_error();
 void debugger_remove_breakpoint(uint16_t address, uint8_t bank = 0);
 void debugger_activate_breakpoint(uint16_t address, uint8_t bank = 0);
 void debugger_deactivate_breakpoint(uint16_t address, uint8_t bank = 0);
 bool debugger_breakpoint_is_active(uint16_t address, uint8_t bank = 0);
 
+// Empty if there's none.
+const char *debugger_get_breakpoint_condition(uint16_t address, uint8_t bank = 0);
+bool        debugger_breakpoint_is_logpoint(uint16_t address, uint8_t bank = 0);
+
+// How often a breakpoint with a condition or logging was reached, whether or not it fired.
+uint32_t debugger_get_breakpoint_hits(uint16_t address, uint8_t bank = 0);
+
+// The most recent logpoint hits, oldest first.
+size_t                      debugger_get_log_size();
+const breakpoint_log_entry &debugger_get_log_entry(size_t index);
+void                        debugger_clear_log();
+
 const breakpoint_list &debugger_get_breakpoints();
 
+// Watchpoints stop execution after the instruction that made the access. The bank works
+// as for breakpoints; VRAM addresses have none. Adding one again replaces its flags.
+void debugger_add_watchpoint(watch_space space, uint32_t address, uint8_t bank, uint8_t flags);
+void debugger_remove_watchpoint(watch_space space, uint32_t address, uint8_t bank = 0);
+
+const watchpoint_list &debugger_get_watchpoints();
+
+// The access that stopped execution, or nullptr if it was something else.
+const watchpoint_hit *debugger_get_watchpoint_hit();
+
+// Run-ahead frames are thrown away, so what they touch mustn't stop execution.
+void debugger_enable_watchpoints(bool enable);
+
+// Called by memory.cpp and vera_video.cpp on accesses to pages flagged in their watch maps.
+void debugger_watch_cpu(uint16_t address, uint8_t bank, uint8_t flag, uint8_t old_value, uint8_t value);
+void debugger_watch_vram(uint32_t address, uint8_t flag, uint8_t old_value, uint8_t value);
+
 #endif
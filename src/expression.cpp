@@ -0,0 +1,373 @@
+#include "expression.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cpu/fake6502.h"
+#include "glue.h"
+#include "memory.h"
+#include "vera/vera_video.h"
+
+// The bytecode is a list of ops, each taking its operands from the top of the stack and
+// leaving its result there. Only push has an operand in the code: 4 bytes, little endian.
+
+enum class op : uint8_t {
+	push,
+	a,
+	x,
+	y,
+	sp,
+	p,
+	pc,
+	rambank,
+	rombank,
+	clock,
+	hits,
+	peek,
+	peekw,
+	vram,
+	vera,
+	neg,
+	logical_not,
+	bit_not,
+	mul,
+	div,
+	mod,
+	add,
+	sub,
+	shl,
+	shr,
+	lt,
+	le,
+	gt,
+	ge,
+	eq,
+	ne,
+	bit_and,
+	bit_xor,
+	bit_or,
+	logical_and,
+	logical_or,
+};
+
+static constexpr int Max_depth = 16;
+
+struct variable {
+	const char *name;
+	op          code;
+};
+
+static constexpr variable Variables[] = {
+	{ "a", op::a },
+	{ "x", op::x },
+	{ "y", op::y },
+	{ "sp", op::sp },
+	{ "p", op::p },
+	{ "pc", op::pc },
+	{ "rambank", op::rambank },
+	{ "rombank", op::rombank },
+	{ "clock", op::clock },
+	{ "hits", op::hits },
+};
+
+static constexpr variable Functions[] = {
+	{ "peek", op::peek },
+	{ "peekw", op::peekw },
+	{ "vram", op::vram },
+	{ "vera", op::vera },
+};
+
+struct binary_operator {
+	const char *token;
+	op          code;
+};
+
+// From the loosest binding to the tightest, as in C.
+static const std::vector<std::vector<binary_operator>> Binary_operators = {
+	{ { "||", op::logical_or } },
+	{ { "&&", op::logical_and } },
+	{ { "|", op::bit_or } },
+	{ { "^", op::bit_xor } },
+	{ { "&", op::bit_and } },
+	{ { "==", op::eq }, { "!=", op::ne } },
+	{ { "<=", op::le }, { ">=", op::ge }, { "<", op::lt }, { ">", op::gt } },
+	{ { "<<", op::shl }, { ">>", op::shr } },
+	{ { "+", op::add }, { "-", op::sub } },
+	{ { "*", op::mul }, { "/", op::div }, { "%", op::mod } },
+};
+
+class parser
+{
+public:
+	parser(const char *text, std::vector<uint8_t> &code)
+	    : m_pos(text), m_code(code)
+	{
+	}
+
+	bool parse(std::string &error)
+	{
+		binary(0);
+		skip_space();
+		if (m_error.empty() && *m_pos != '\0') {
+			fail("unexpected \"%s\"", m_pos);
+		}
+		error = m_error;
+		return m_error.empty();
+	}
+
+private:
+	void skip_space()
+	{
+		while (isspace((unsigned char)*m_pos)) {
+			++m_pos;
+		}
+	}
+
+	bool accept(const char *token)
+	{
+		skip_space();
+		const size_t length = strlen(token);
+		if (strncmp(m_pos, token, length) != 0) {
+			return false;
+		}
+		// "|" is not the start of "||", nor "<" of "<=" or "<<".
+		if (length == 1 && ((m_pos[1] == token[0] && strchr("|&<>", token[0]) != nullptr) || (m_pos[1] == '=' && strchr("<>!", token[0]) != nullptr))) {
+			return false;
+		}
+		m_pos += length;
+		return true;
+	}
+
+	void fail(const char *format, const char *detail = "")
+	{
+		if (m_error.empty()) {
+			char message[64];
+			snprintf(message, sizeof(message), format, detail);
+			m_error = message;
+		}
+	}
+
+	void emit(op code)
+	{
+		m_code.push_back((uint8_t)code);
+	}
+
+	// Keeps track of how deep the stack gets, adjusting by how many values the op leaves.
+	void emit(op code, int stack_change)
+	{
+		emit(code);
+		m_depth += stack_change;
+		if (m_depth > Max_depth) {
+			fail("expression is too complex");
+		}
+	}
+
+	void push(int32_t value)
+	{
+		emit(op::push, 1);
+		for (int i = 0; i < 4; ++i) {
+			m_code.push_back((uint8_t)((uint32_t)value >> (i * 8)));
+		}
+	}
+
+	void binary(size_t level)
+	{
+		if (level == Binary_operators.size()) {
+			unary();
+			return;
+		}
+
+		binary(level + 1);
+		while (m_error.empty()) {
+			const binary_operator *found = nullptr;
+			for (const binary_operator &bo : Binary_operators[level]) {
+				if (accept(bo.token)) {
+					found = &bo;
+					break;
+				}
+			}
+			if (found == nullptr) {
+				break;
+			}
+			binary(level + 1);
+			emit(found->code, -1);
+		}
+	}
+
+	void unary()
+	{
+		if (accept("-")) {
+			unary();
+			emit(op::neg, 0);
+		} else if (accept("!")) {
+			unary();
+			emit(op::logical_not, 0);
+		} else if (accept("~")) {
+			unary();
+			emit(op::bit_not, 0);
+		} else {
+			primary();
+		}
+	}
+
+	void number(int base)
+	{
+		const char *start = m_pos;
+		uint32_t    value = 0;
+		for (;; ++m_pos) {
+			int digit;
+			if (isdigit((unsigned char)*m_pos)) {
+				digit = *m_pos - '0';
+			} else if (isxdigit((unsigned char)*m_pos)) {
+				digit = tolower((unsigned char)*m_pos) - 'a' + 10;
+			} else {
+				break;
+			}
+			if (digit >= base) {
+				break;
+			}
+			value = value * base + digit;
+		}
+		if (m_pos == start || isalnum((unsigned char)*m_pos)) {
+			fail("bad number at \"%s\"", start);
+		}
+		push((int32_t)value);
+	}
+
+	void primary()
+	{
+		skip_space();
+
+		if (accept("(")) {
+			binary(0);
+			if (!accept(")")) {
+				fail("missing \")\"");
+			}
+		} else if (*m_pos == '$') {
+			++m_pos;
+			number(16);
+		} else if (*m_pos == '%') {
+			++m_pos;
+			number(2);
+		} else if (m_pos[0] == '0' && (m_pos[1] == 'x' || m_pos[1] == 'X')) {
+			m_pos += 2;
+			number(16);
+		} else if (isdigit((unsigned char)*m_pos)) {
+			number(10);
+		} else if (isalpha((unsigned char)*m_pos) || *m_pos == '_') {
+			identifier();
+		} else if (*m_pos == '\0') {
+			fail("unexpected end");
+		} else {
+			fail("unexpected \"%s\"", m_pos);
+		}
+	}
+
+	void identifier()
+	{
+		const char *start = m_pos;
+		while (isalnum((unsigned char)*m_pos) || *m_pos == '_') {
+			++m_pos;
+		}
+		const std::string name(start, m_pos);
+
+		for (const variable &v : Variables) {
+			if (name == v.name) {
+				emit(v.code, 1);
+				return;
+			}
+		}
+		for (const variable &f : Functions) {
+			if (name == f.name) {
+				if (!accept("(")) {
+					fail("missing \"(\" after %s", f.name);
+					return;
+				}
+				binary(0);
+				if (!accept(")")) {
+					fail("missing \")\"");
+				}
+				emit(f.code, 0);
+				return;
+			}
+		}
+		fail("unknown name \"%s\"", name.c_str());
+	}
+
+	const char           *m_pos;
+	std::vector<uint8_t> &m_code;
+	int                   m_depth = 0;
+	std::string           m_error;
+};
+
+bool expression::compile(const char *text)
+{
+	m_code.clear();
+	m_text = text;
+
+	parser p(text, m_code);
+	if (!p.parse(m_error)) {
+		m_code.clear();
+		return false;
+	}
+	return true;
+}
+
+int32_t expression::evaluate(uint32_t hits) const
+{
+	int32_t  stack[Max_depth];
+	int32_t *top = stack - 1;
+
+	const uint8_t *code = m_code.data();
+	const uint8_t *end  = code + m_code.size();
+	while (code < end) {
+		switch ((op)*code++) {
+			case op::push:
+				*++top = (int32_t)((uint32_t)code[0] | (uint32_t)code[1] << 8 | (uint32_t)code[2] << 16 | (uint32_t)code[3] << 24);
+				code += 4;
+				break;
+
+			case op::a: *++top = a; break;
+			case op::x: *++top = x; break;
+			case op::y: *++top = y; break;
+			case op::sp: *++top = sp; break;
+			case op::p: *++top = status; break;
+			case op::pc: *++top = pc; break;
+			case op::rambank: *++top = memory_get_ram_bank(); break;
+			case op::rombank: *++top = memory_get_rom_bank(); break;
+			case op::clock: *++top = (int32_t)clockticks6502; break;
+			case op::hits: *++top = (int32_t)hits; break;
+
+			case op::peek: *top = debug_read6502((uint16_t)*top); break;
+			case op::peekw: *top = debug_read6502((uint16_t)*top) | debug_read6502((uint16_t)(*top + 1)) << 8; break;
+			case op::vram: *top = vera_video_space_read((uint32_t)*top); break;
+			case op::vera: *top = vera_debug_video_read((uint8_t)*top); break;
+
+			case op::neg: *top = (int32_t)(0u - (uint32_t)*top); break;
+			case op::logical_not: *top = !*top; break;
+			case op::bit_not: *top = ~*top; break;
+
+			case op::mul: --top; top[0] = (int32_t)((uint32_t)top[0] * (uint32_t)top[1]); break;
+			case op::div: --top; top[0] = top[1] != 0 && !(top[1] == -1 && top[0] == INT32_MIN) ? top[0] / top[1] : 0; break;
+			case op::mod: --top; top[0] = top[1] != 0 && top[1] != -1 ? top[0] % top[1] : 0; break;
+			case op::add: --top; top[0] = (int32_t)((uint32_t)top[0] + (uint32_t)top[1]); break;
+			case op::sub: --top; top[0] = (int32_t)((uint32_t)top[0] - (uint32_t)top[1]); break;
+			case op::shl: --top; top[0] = (int32_t)((uint32_t)top[0] << (top[1] & 31)); break;
+			case op::shr: --top; top[0] = top[0] >> (top[1] & 31); break;
+			case op::lt: --top; top[0] = top[0] < top[1]; break;
+			case op::le: --top; top[0] = top[0] <= top[1]; break;
+			case op::gt: --top; top[0] = top[0] > top[1]; break;
+			case op::ge: --top; top[0] = top[0] >= top[1]; break;
+			case op::eq: --top; top[0] = top[0] == top[1]; break;
+			case op::ne: --top; top[0] = top[0] != top[1]; break;
+			case op::bit_and: --top; top[0] = top[0] & top[1]; break;
+			case op::bit_xor: --top; top[0] = top[0] ^ top[1]; break;
+			case op::bit_or: --top; top[0] = top[0] | top[1]; break;
+			case op::logical_and: --top; top[0] = top[0] && top[1]; break;
+			case op::logical_or: --top; top[0] = top[0] || top[1]; break;
+		}
+	}
+
+	return top >= stack ? *top : 1;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#if !defined(EXPRESSION_H)
+#	define EXPRESSION_H
+
+#	include <stdint.h>
+#	include <string>
+#	include <vector>
+
+// An expression over the machine's state, like "a == $40 && peek($22) > 3", compiled
+// once into bytecode for a small stack machine so that evaluating it is cheap.
+//
+// Values are 32-bit signed. Numbers are decimal, $hex, 0xhex or %binary. Operators
+// are C's, with C's precedence: ! ~ - (unary), * / %, + -, << >>, < <= > >=, == !=,
+// &, ^, |, &&, ||. Both sides of && and || are always evaluated.
+//
+//   a x y sp p pc       CPU registers (p is the status register)
+//   rambank rombank     current banks
+//   clock               CPU clock, low 32 bits
+//   hits                times the breakpoint was reached, this time included
+//   peek(addr)          byte at a CPU address, in the current banks
+//   peekw(addr)         little-endian word at a CPU address
+//   vram(addr)          byte of VERA's address space
+//   vera(reg)           VERA register 0-31, as $9F20 + reg reads (without side effects)
+
+class expression
+{
+public:
+	// Returns false and describes the problem in error() if the text doesn't compile.
+	bool compile(const char *text);
+
+	int32_t evaluate(uint32_t hits) const;
+
+	bool               empty() const { return m_code.empty(); }
+	const std::string &text() const { return m_text; }
+	const std::string &error() const { return m_error; }
+
+private:
+	std::vector<uint8_t> m_code;
+	std::string          m_text;
+	std::string          m_error;
+};
+
+#endif
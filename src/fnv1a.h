@@ -0,0 +1,28 @@
+#pragma once
+#if !defined(FNV1A_H)
+#	define FNV1A_H
+
+#	include <stddef.h>
+#	include <stdint.h>
+
+// 64-bit FNV-1a, for telling apart ROMs and the like. Not for anything that has to
+// stand up to someone trying to collide it.
+
+static constexpr uint64_t Fnv1a_offset_basis = 0xcbf29ce484222325ULL;
+
+inline uint64_t fnv1a(uint64_t hash, const void *data, size_t size)
+{
+	const uint8_t *bytes = static_cast<const uint8_t *>(data);
+	for (size_t i = 0; i < size; ++i) {
+		hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+template <typename T>
+uint64_t fnv1a(uint64_t hash, const T &value)
+{
+	return fnv1a(hash, &value, sizeof(value));
+}
+
+#endif
@@ -1,6 +1,12 @@
 #include "gif_recorder.h"
 
+#include <atomic>
+#include <chrono>
+#include <stdlib.h>
+#include <thread>
+
 #include "gif/gif.h"
+#include "ring_buffer.h"
 #include "vera/vera_video.h"
 
 // GIF recorder states
@@ -18,6 +24,208 @@ static GifWriter            Gif_writer;
 static int Gif_width;
 static int Gif_height;
 
+// Frames are handed to the encoder thread through this queue. If the encoder falls
+// behind, frames are dropped rather than stalling emulation; timing stays correct
+// because every frame carries its number.
+struct gif_frame {
+	uint32_t number;
+	uint32_t pixels[SCREEN_WIDTH * SCREEN_HEIGHT];
+};
+
+static spsc_queue<gif_frame, 4> Gif_queue;
+static std::thread              Gif_encoder;
+static std::atomic<bool>        Gif_encoder_stopping{ false };
+static bool                     Gif_encoder_running = false;
+static uint32_t                 Gif_frame_number    = 0;
+
+//
+// Encoder thread state
+//
+
+// Most recent distinct frame, not yet written because its duration isn't known.
+static uint32_t Pending_pixels[SCREEN_WIDTH * SCREEN_HEIGHT];
+static uint32_t Pending_start = 0;
+static bool     Pending_valid = false;
+
+static uint8_t Rect_image[SCREEN_WIDTH * SCREEN_HEIGHT * 4];
+
+static constexpr uint32_t Rgb_mask = 0x00ffffff;
+
+// GIF delays are in 1/100s; the machine runs at 60 frames per second.
+static uint32_t frame_to_centiseconds(uint32_t frame)
+{
+	return static_cast<uint32_t>(static_cast<uint64_t>(frame) * 100 / 60);
+}
+
+// Find the bounding box of pixels that differ from what is already on the GIF's canvas.
+static bool find_changed_rect(const uint32_t *pixels, const uint32_t *canvas, int &left, int &top, int &right, int &bottom)
+{
+	left   = Gif_width;
+	top    = Gif_height;
+	right  = -1;
+	bottom = -1;
+
+	for (int y = 0; y < Gif_height; ++y) {
+		const uint32_t *row     = pixels + y * Gif_width;
+		const uint32_t *old_row = canvas + y * Gif_width;
+
+		int x0 = 0;
+		while (x0 < Gif_width && ((row[x0] ^ old_row[x0]) & Rgb_mask) == 0) {
+			++x0;
+		}
+		if (x0 == Gif_width) {
+			continue;
+		}
+
+		int x1 = Gif_width - 1;
+		while (((row[x1] ^ old_row[x1]) & Rgb_mask) == 0) {
+			--x1;
+		}
+
+		left   = x0 < left ? x0 : left;
+		right  = x1 > right ? x1 : right;
+		top    = y < top ? y : top;
+		bottom = y;
+	}
+
+	return right >= 0;
+}
+
+// VERA colors are 12-bit, expanded to 24-bit by repeating each nibble. As long as
+// a frame only contains such colors (no dimmed NTSC overscan, no chroma-disable
+// averaging) and no more than 255 of them in the changed area, we can build the
+// frame's palette exactly and skip quantization altogether.
+static bool write_exact_frame(const uint32_t *pixels, uint32_t *canvas, bool first, int left, int top, int width, int height, uint32_t delay)
+{
+	int16_t    slot[4096];
+	GifPalette pal;
+	int        count = 1; // index 0 is transparency
+
+	memset(slot, 0xff, sizeof(slot));
+	memset(&pal, 0, sizeof(pal));
+
+	uint8_t *out = Rect_image;
+	for (int y = top; y < top + height; ++y) {
+		const uint32_t *row     = pixels + y * Gif_width;
+		const uint32_t *old_row = canvas + y * Gif_width;
+		for (int x = left; x < left + width; ++x, out += 4) {
+			const uint32_t c = row[x] & Rgb_mask;
+			if (!first && c == (old_row[x] & Rgb_mask)) {
+				out[3] = kGifTransIndex;
+				continue;
+			}
+			if (((c >> 4) & 0x0f0f0f) != (c & 0x0f0f0f)) {
+				return false;
+			}
+
+			const int key = ((c >> 12) & 0xf00) | ((c >> 8) & 0x0f0) | ((c >> 4) & 0x00f);
+			if (slot[key] < 0) {
+				if (count == 256) {
+					return false;
+				}
+				// gif.h writes palette entries as (b, g, r), matching the framebuffer's byte order.
+				pal.r[count] = c & 0xff;
+				pal.g[count] = (c >> 8) & 0xff;
+				pal.b[count] = (c >> 16) & 0xff;
+				slot[key]    = static_cast<int16_t>(count++);
+			}
+			out[3] = static_cast<uint8_t>(slot[key]);
+		}
+	}
+
+	pal.bitDepth = 2;
+	while ((1 << pal.bitDepth) < count) {
+		++pal.bitDepth;
+	}
+
+	GifWriteLzwImage(Gif_writer.f, Rect_image, left, top, width, height, delay, &pal);
+	Gif_writer.firstFrame = false;
+
+	for (int y = top; y < top + height; ++y) {
+		memcpy(canvas + y * Gif_width + left, pixels + y * Gif_width + left, width * sizeof(uint32_t));
+	}
+	return true;
+}
+
+static void write_frame(const uint32_t *pixels, uint32_t delay)
+{
+	if (Gif_writer.f == nullptr) {
+		return;
+	}
+
+	uint32_t *canvas = reinterpret_cast<uint32_t *>(Gif_writer.oldImage);
+	const bool first  = Gif_writer.firstFrame;
+
+	int left, top, right, bottom;
+	if (first) {
+		left   = 0;
+		top    = 0;
+		right  = Gif_width - 1;
+		bottom = Gif_height - 1;
+	} else if (!find_changed_rect(pixels, canvas, left, top, right, bottom)) {
+		// Identical frames are merged before we get here, but keep the timing right regardless.
+		left = top = right = bottom = 0;
+	}
+
+	if (write_exact_frame(pixels, canvas, first, left, top, right - left + 1, bottom - top + 1, delay)) {
+		return;
+	}
+
+	// Fall back to gif.h's quantizer. It diffs against, and then updates, the same canvas.
+	GifWriteFrame(&Gif_writer, reinterpret_cast<const uint8_t *>(pixels), Gif_width, Gif_height, delay, 8, false);
+}
+
+static void encode_frame(const gif_frame &frame)
+{
+	if (Pending_valid) {
+		if (memcmp(frame.pixels, Pending_pixels, sizeof(Pending_pixels)) == 0) {
+			return;
+		}
+
+		// Many viewers treat delays below 2/100s as "as fast as possible" or even 1/10s,
+		// so frames that would be shorter than that are superseded by the next one.
+		const uint32_t delay = frame_to_centiseconds(frame.number) - frame_to_centiseconds(Pending_start);
+		if (delay >= 2) {
+			write_frame(Pending_pixels, delay);
+			Pending_start = frame.number;
+		}
+	} else {
+		Pending_start = frame.number;
+	}
+
+	memcpy(Pending_pixels, frame.pixels, sizeof(Pending_pixels));
+	Pending_valid = true;
+}
+
+static void flush_pending()
+{
+	if (Pending_valid) {
+		const uint32_t delay = frame_to_centiseconds(Gif_frame_number) - frame_to_centiseconds(Pending_start);
+		write_frame(Pending_pixels, delay < 2 ? 2 : delay);
+		Pending_valid = false;
+	}
+}
+
+static void encoder_main()
+{
+	for (;;) {
+		const bool last_pass = Gif_encoder_stopping;
+
+		gif_frame *frame;
+		while ((frame = Gif_queue.begin_read()) != nullptr) {
+			encode_frame(*frame);
+			Gif_queue.end_read();
+		}
+
+		if (last_pass) {
+			break;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	}
+
+	flush_pending();
+}
+
 void gif_recorder_set_path(char const *path)
 {
 	Gif_path = new char[strlen(path) + 1];
@@ -43,12 +251,28 @@ void gif_recorder_init(int width, int height)
 		}
 		if (!GifBegin(&Gif_writer, Gif_path, SCREEN_WIDTH, SCREEN_HEIGHT, 1, 8, false)) {
 			Gif_record_state = RECORD_GIF_DISABLED;
+		} else {
+			Gif_frame_number     = 0;
+			Pending_valid        = false;
+			Gif_encoder_stopping = false;
+			Gif_encoder_running  = true;
+			Gif_encoder          = std::thread(encoder_main);
+
+			// exit() (the guest powering off, say) would otherwise destroy the thread
+			// while it's joinable, which aborts before the GIF is finished.
+			atexit(gif_recorder_shutdown);
 		}
 	}
 }
 
 void gif_recorder_shutdown()
 {
+	if (Gif_encoder_running) {
+		Gif_encoder_stopping = true;
+		Gif_encoder.join();
+		Gif_encoder_running = false;
+	}
+
 	if (Gif_record_state != RECORD_GIF_DISABLED) {
 		GifEnd(&Gif_writer);
 		Gif_record_state = RECORD_GIF_DISABLED;
@@ -58,12 +282,14 @@ void gif_recorder_shutdown()
 void gif_recorder_update(const uint8_t *image_bytes)
 {
 	if (Gif_record_state > RECORD_GIF_PAUSED) {
-		if (!GifWriteFrame(&Gif_writer, image_bytes, SCREEN_WIDTH, SCREEN_HEIGHT, 2, 8, false)) {
-			// if that failed, stop recording
-			GifEnd(&Gif_writer);
-			Gif_record_state = RECORD_GIF_DISABLED;
-			printf("Unexpected end of recording.\n");
+		gif_frame *frame = Gif_queue.begin_write();
+		if (frame != nullptr) {
+			frame->number = Gif_frame_number;
+			memcpy(frame->pixels, image_bytes, sizeof(frame->pixels));
+			Gif_queue.end_write();
 		}
+		++Gif_frame_number;
+
 		if (Gif_record_state == RECORD_GIF_SINGLE) { // if single-shot stop recording
 			Gif_record_state = RECORD_GIF_PAUSED;    // need to close in video_end()
 		}
@@ -11,7 +11,6 @@
 #include "options.h"
 
 #define LOAD_HYPERCALLS
-//#define TRACE
 #define TRACE_VIA
 
 #define MHZ 8
@@ -23,15 +22,21 @@
 #define ROM_SIZE (NUM_ROM_BANKS * 16384)                   /* banks at $C000-$FFFF */
 
 extern uint8_t  a, x, y, sp, status;
+extern uint8_t  waiting; // set by WAI until an interrupt comes
 extern uint16_t pc;
 extern uint8_t *RAM;
-extern uint8_t  ROM[];
+extern uint8_t *ROM;
 extern uint32_t instructions;
 
 extern bool        save_on_exit;
 
 extern void machine_dump();
 extern void machine_reset();
+
+// Runs one instruction and whatever happens between instructions, as the emulator
+// loop does. new_frame tells whether VERA finished a frame. Returns false once the
+// program has asked to quit.
+extern bool machine_step(bool &new_frame);
 extern void machine_toggle_warp();
 extern void init_audio();
 
@@ -5,6 +5,7 @@
 #include "i2c.h"
 #include "rtc.h"
 #include "smc.h"
+#include "state.h"
 #include <stdbool.h>
 #include <stdio.h>
 
@@ -29,6 +30,8 @@ static int     count     = 0;
 static uint8_t device;
 static uint8_t offset;
 
+static i2c_port_t old_i2c_port;
+
 uint8_t i2c_read(uint8_t device, uint8_t offset)
 {
 	uint8_t value;
@@ -61,7 +64,6 @@ void i2c_write(uint8_t device, uint8_t offset, uint8_t value)
 
 void i2c_step()
 {
-	static i2c_port_t old_i2c_port;
 	if (old_i2c_port.clk_in != i2c_port.clk_in || old_i2c_port.data_in != i2c_port.data_in) {
 		LOG_PRINTF(5, "I2C(%d) C:%d D:%d\n", state, i2c_port.clk_in, i2c_port.data_in);
 		if (state == STATE_STOP && i2c_port.clk_in == 0 && i2c_port.data_in == 0) {
@@ -136,3 +138,15 @@ void i2c_step()
 		old_i2c_port = i2c_port;
 	}
 }
+
+void i2c_save_restore(state_stream &stream)
+{
+	stream.field(i2c_port);
+	stream.field(old_i2c_port);
+	stream.field(state);
+	stream.field(read_mode);
+	stream.field(value);
+	stream.field(count);
+	stream.field(device);
+	stream.field(offset);
+}
@@ -15,8 +15,11 @@ typedef struct {
 	int data_out;
 } i2c_port_t;
 
+class state_stream;
+
 extern i2c_port_t i2c_port;
 
 void i2c_step();
+void i2c_save_restore(state_stream &stream);
 
 #endif
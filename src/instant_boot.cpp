@@ -0,0 +1,108 @@
+#include "instant_boot.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "SDL.h"
+#include "cpu/fake6502.h"
+#include "fnv1a.h"
+#include "glue.h"
+#include "mapped_file.h"
+#include "movie.h"
+#include "noise.h"
+#include "rtc.h"
+#include "state.h"
+#include "vera/sdcard.h"
+
+// If BASIC hasn't asked for input after this long, the ROM isn't going to.
+static constexpr uint64_t Capture_deadline = (uint64_t)MHZ * 1000000 * 10;
+
+static bool Capture_pending = false;
+static char Cache_path[PATH_MAX];
+
+// Everything the KERNAL looks at on its way to the BASIC prompt.
+static uint64_t boot_key()
+{
+	uint64_t hash = Fnv1a_offset_basis;
+	hash          = fnv1a(hash, ROM, ROM_SIZE);
+	hash          = fnv1a(hash, nvram);
+	hash          = fnv1a(hash, Options.num_ram_banks);
+	hash          = fnv1a(hash, Options.keymap);
+	hash          = fnv1a(hash, Options.set_system_time);
+	hash          = fnv1a(hash, Options.ym_irq);
+	hash          = fnv1a(hash, Options.ym_strict);
+	return hash;
+}
+
+bool instant_boot_restore()
+{
+	Capture_pending = false;
+
+	// The KERNAL may boot differently with a card (AUTOBOOT.X16), and the card's own
+	// state isn't part of the snapshot.
+	if (!Options.instant_boot || sdcard_is_attached()) {
+		return false;
+	}
+
+	char filename[32];
+	snprintf(filename, sizeof(filename), "box16-boot-%016llx.state", (unsigned long long)boot_key());
+	options_get_base_path(Cache_path, filename);
+
+	mapped_file cache;
+	if (cache.open(Cache_path, false) && machine_load_state(cache.data(), cache.size())) {
+		if (Options.set_system_time) {
+			rtc_set_system_time();
+		}
+		// The snapshot's noise would give every start the same "random" numbers. A movie
+		// brings its own.
+		if (!movie_is_replaying()) {
+			noise_seed((uint32_t)time(NULL));
+		}
+		printf("Instant boot from %s\n", Cache_path);
+		return true;
+	}
+
+	Capture_pending = true;
+	return false;
+}
+
+bool instant_boot_pending()
+{
+	if (Capture_pending && clockticks6502 > Capture_deadline) {
+		printf("BASIC didn't start, not caching this boot.\n");
+		Capture_pending = false;
+	}
+	return Capture_pending;
+}
+
+void instant_boot_capture()
+{
+	if (!Capture_pending) {
+		return;
+	}
+	Capture_pending = false;
+
+	std::vector<uint8_t> state;
+	machine_save_state(state);
+
+	// Other instances may be starting up at the same time, so only ever
+	// let a complete file appear under the final name.
+	char temp_path[PATH_MAX + 16];
+	snprintf(temp_path, sizeof(temp_path), "%s.%d.tmp", Cache_path, (int)getpid());
+
+	SDL_RWops *f = SDL_RWFromFile(temp_path, "wb");
+	if (f == nullptr) {
+		printf("Cannot write %s!\n", temp_path);
+		return;
+	}
+	const bool written = SDL_RWwrite(f, state.data(), state.size(), 1) == 1;
+	SDL_RWclose(f);
+
+	if (!written || rename(temp_path, Cache_path) != 0) {
+		// On Windows, rename() fails if another instance got there first.
+		remove(temp_path);
+	}
+}
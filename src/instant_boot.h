@@ -0,0 +1,19 @@
+#pragma once
+#if !defined(INSTANT_BOOT_H)
+#	define INSTANT_BOOT_H
+
+// With -instantboot, the machine state from the moment BASIC first waits for
+// input is cached next to box16.ini, keyed by the ROM, NVRAM and the options
+// the boot depends on. Later starts restore it instead of resetting the machine.
+
+// Returns true if the machine was restored; otherwise the caller resets it as usual
+// and the boot is captured once it gets far enough.
+bool instant_boot_restore();
+
+// True until the boot has been captured (or given up on).
+bool instant_boot_pending();
+
+// Call when BASIC first reads a line.
+void instant_boot_capture();
+
+#endif
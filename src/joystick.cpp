@@ -1,6 +1,8 @@
 #include "joystick.h"
 
 #include <SDL.h>
+#include "movie.h"
+#include "state.h"
 #include <unordered_map>
 
 #define LOG_JOYSTICK(...) // printf(__VA_ARGS__)
@@ -8,7 +10,6 @@
 struct joystick_info {
 	SDL_GameController *controller;
 	uint16_t            button_mask;
-	uint16_t            shift_mask;
 	int                 current_slot;
 };
 
@@ -36,6 +37,34 @@ static int                                    Joystick_slots[NUM_JOYSTICKS];
 static bool Joystick_latch = false;
 uint8_t     Joystick_data  = 0;
 
+// An empty port reads as all 1s.
+static constexpr uint32_t No_controller = 0xffffffff;
+
+// What each port shows when latched. While a movie plays, it comes from the movie
+// instead of the controllers.
+static uint32_t Port_buttons[NUM_JOYSTICKS] = { No_controller, No_controller, No_controller, No_controller };
+static uint32_t Port_shift[NUM_JOYSTICKS];
+
+static void update_ports()
+{
+	if (movie_is_replaying()) {
+		return;
+	}
+	for (int i = 0; i < NUM_JOYSTICKS; ++i) {
+		uint32_t buttons = No_controller;
+		if (Joystick_slots[i] >= 0) {
+			const auto &joy = Joystick_controllers.find(Joystick_slots[i]);
+			if (joy != Joystick_controllers.end()) {
+				buttons = joy->second.button_mask | 0xF000;
+			}
+		}
+		if (buttons != Port_buttons[i]) {
+			Port_buttons[i] = buttons;
+			movie_record_joystick(i, buttons);
+		}
+	}
+}
+
 bool joystick_init()
 {
 	for (int i = 0; i < NUM_JOYSTICKS; ++i) {
@@ -81,8 +110,9 @@ void joystick_add(int index)
 				break;
 			}
 		}
-		Joystick_controllers.try_emplace(instance_id, joystick_info{ controller, 0xffff, 0, slot });
+		Joystick_controllers.try_emplace(instance_id, joystick_info{ controller, 0xffff, slot });
 	}
+	update_ports();
 }
 
 void joystick_remove(int instance_id)
@@ -103,6 +133,7 @@ void joystick_remove(int instance_id)
 		SDL_GameControllerClose(controller);
 		Joystick_controllers.erase(instance_id);
 	}
+	update_ports();
 }
 
 void joystick_slot_remap(int slot, int instance_id)
@@ -145,6 +176,7 @@ void joystick_slot_remap(int slot, int instance_id)
 	if (instance_old_slot != NUM_JOYSTICKS) {
 		Joystick_slots[instance_old_slot] = slot_old_instance_id;
 	}
+	update_ports();
 }
 
 void joystick_button_down(int instance_id, uint8_t button)
@@ -155,6 +187,7 @@ void joystick_button_down(int instance_id, uint8_t button)
 	if (joy != Joystick_controllers.end()) {
 		joy->second.button_mask &= ~(button_map[button]);
 	}
+	update_ports();
 }
 
 void joystick_button_up(int instance_id, uint8_t button)
@@ -165,18 +198,14 @@ void joystick_button_up(int instance_id, uint8_t button)
 	if (joy != Joystick_controllers.end()) {
 		joy->second.button_mask |= button_map[button];
 	}
+	update_ports();
 }
 
 static void do_shift()
 {
 	for (int i = 0; i < NUM_JOYSTICKS; ++i) {
-		if (Joystick_slots[i] >= 0) {
-			const auto &joy = Joystick_controllers.find(Joystick_slots[i]);
-			Joystick_data |= ((joy->second.shift_mask & 1) ? (0x80 >> i) : 0);
-			joy->second.shift_mask >>= 1;
-		} else {
-			Joystick_data |= 0x80 >> i;
-		}
+		Joystick_data |= ((Port_shift[i] & 1) ? (0x80 >> i) : 0);
+		Port_shift[i] = (Port_shift[i] >> 1) | (Port_shift[i] & 0x80000000);
 	}
 }
 
@@ -184,8 +213,8 @@ void joystick_set_latch(bool value)
 {
 	Joystick_latch = value;
 	if (value) {
-		for (auto &joy : Joystick_controllers) {
-			joy.second.shift_mask = joy.second.button_mask | 0xF000;
+		for (int i = 0; i < NUM_JOYSTICKS; ++i) {
+			Port_shift[i] = Port_buttons[i];
 		}
 		do_shift();
 	}
@@ -221,4 +250,22 @@ void joystick_for_each_slot(std::function<void(int, int, SDL_GameController *)>
 			}
 		}
 	}
-}
\ No newline at end of file
+}
+
+uint32_t joystick_get_port_buttons(int port)
+{
+	return Port_buttons[port];
+}
+
+void joystick_replay_port_buttons(int port, uint32_t buttons)
+{
+	Port_buttons[port] = buttons;
+}
+
+void joystick_save_restore(state_stream &state)
+{
+	// The controllers belong to the host, only the shift registers are machine state.
+	state.field(Joystick_latch);
+	state.field(Joystick_data);
+	state.field(Port_shift);
+}
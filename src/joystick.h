@@ -10,6 +10,8 @@
 #include <functional>
 #include <SDL.h>
 
+class state_stream;
+
 extern uint8_t Joystick_data;
 
 bool joystick_init();
@@ -22,6 +24,11 @@ void joystick_button_up(int instance_id, uint8_t button);
 
 void joystick_set_latch(bool value);
 void joystick_set_clock(bool value);
+void joystick_save_restore(state_stream &state);
+
+// The buttons each port shows the machine, as they are latched (1 = released).
+uint32_t joystick_get_port_buttons(int port);
+void     joystick_replay_port_buttons(int port, uint32_t buttons);
 
 void joystick_for_each(std::function<void(int, SDL_GameController *, int current_slot)> fn);
 void joystick_for_each_slot(std::function<void(int, int, SDL_GameController *)> fn);
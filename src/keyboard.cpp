@@ -5,6 +5,8 @@
 
 #include "glue.h"
 #include "keyboard.h"
+#include "memory.h"
+#include "movie.h"
 #include "ps2.h"
 #include "rom_symbols.h"
 #include "unicode.h"
@@ -128,6 +130,8 @@ static bool process_text_input(text_input_data &data)
 		if (c && !e) {
 			RAM[KEYD + RAM[NDX]] = c;
 			RAM[NDX]++;
+			memory_mark_dirty(KEYD, NDX + 1 - KEYD);
+			movie_record_ram(KEYD, NDX + 1 - KEYD);
 		} else {
 			return true;
 		}
@@ -5,12 +5,21 @@
 #include "loadsave.h"
 
 #include <SDL.h>
+#include <algorithm>
+#include <ctype.h>
 #include <dirent.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
+#include <string>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
+#include <vector>
+
+#if defined(__linux__)
+#	include <sys/inotify.h>
+#endif
 
 #include "glue.h"
 #include "memory.h"
@@ -21,13 +30,170 @@
 #define MIN(a, b) (((a) < (b)) ? (a) : (b))
 #define MAX(a, b) (((a) > (b)) ? (a) : (b))
 
-static int create_directory_listing(uint8_t *data)
+// Index of Options.hyper_path, so LOAD"$" and wildcard lookups don't read the
+// directory and stat every file each time. It's rebuilt when the directory changes:
+// on Linux inotify says when, elsewhere the directory's mtime is checked.
+struct hyper_dir_entry {
+	std::string name;
+	uint32_t    size;
+	bool        is_dir;
+};
+
+static std::vector<hyper_dir_entry> Dir_entries;
+static std::string                  Dir_path;
+static bool                         Dir_valid     = false;
+static time_t                       Dir_mtime     = 0;
+static time_t                       Dir_scan_time = 0;
+#if defined(__linux__)
+static int Dir_inotify = -1;
+#endif
+
+static bool hyper_dir_changed()
+{
+#if defined(__linux__)
+	if (Dir_inotify >= 0) {
+		bool changed = false;
+		char events[4096];
+		while (read(Dir_inotify, events, sizeof(events)) > 0) {
+			changed = true;
+		}
+		return changed;
+	}
+#endif
+
+	// A change within the same second as the scan wouldn't show in the mtime, so rescan until it's older.
+	struct stat st;
+	if (stat(Dir_path.c_str(), &st) != 0) {
+		return true;
+	}
+	return st.st_mtime != Dir_mtime || Dir_mtime >= Dir_scan_time;
+}
+
+static void scan_hyper_dir()
+{
+	Dir_entries.clear();
+	Dir_path  = Options.hyper_path;
+	Dir_valid = true;
+
+#if defined(__linux__)
+	if (Dir_inotify >= 0) {
+		close(Dir_inotify);
+	}
+	Dir_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (Dir_inotify >= 0 && inotify_add_watch(Dir_inotify, Dir_path.c_str(), IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF) < 0) {
+		close(Dir_inotify);
+		Dir_inotify = -1;
+	}
+#endif
+
+	struct stat st;
+	Dir_mtime     = stat(Dir_path.c_str(), &st) == 0 ? st.st_mtime : 0;
+	Dir_scan_time = time(nullptr);
+
+	DIR *dirp = opendir(Dir_path.c_str());
+	if (dirp == nullptr) {
+		return;
+	}
+	while (struct dirent *dp = readdir(dirp)) {
+		if (!strcmp(dp->d_name, ".") || !strcmp(dp->d_name, "..")) {
+			continue;
+		}
+		const std::string path = Dir_path + "/" + dp->d_name;
+		if (stat(path.c_str(), &st) != 0) {
+			continue;
+		}
+		const bool is_dir = S_ISDIR(st.st_mode);
+		Dir_entries.push_back({ dp->d_name, is_dir ? 0 : (uint32_t)MIN((uint64_t)st.st_size, 0xFFFFFFFF), is_dir });
+	}
+	closedir(dirp);
+
+	std::sort(Dir_entries.begin(), Dir_entries.end(), [](const hyper_dir_entry &a, const hyper_dir_entry &b) { return a.name < b.name; });
+}
+
+static const std::vector<hyper_dir_entry> &hyper_dir()
 {
-	uint8_t *      data_start = data;
-	struct stat    st;
-	DIR *          dirp;
-	struct dirent *dp;
-	int            file_size;
+	if (!Dir_valid || Dir_path != Options.hyper_path || hyper_dir_changed()) {
+		scan_hyper_dir();
+	}
+	return Dir_entries;
+}
+
+static bool has_wildcards(const char *name)
+{
+	return strpbrk(name, "*?") != nullptr;
+}
+
+// CBM-style pattern: '?' matches any one character, '*' any number of them. Letters match either case.
+static bool matches_pattern(const char *pattern, const char *name)
+{
+	for (; *pattern != '\0'; ++pattern, ++name) {
+		if (*pattern == '*') {
+			for (;; ++name) {
+				if (matches_pattern(pattern + 1, name)) {
+					return true;
+				}
+				if (*name == '\0') {
+					return false;
+				}
+			}
+		}
+		if (*name == '\0' || (*pattern != '?' && toupper((uint8_t)*pattern) != toupper((uint8_t)*name))) {
+			return false;
+		}
+	}
+	return *name == '\0';
+}
+
+static void set_status(uint8_t value)
+{
+	RAM[STATUS] = value;
+	memory_mark_dirty(STATUS, 1);
+}
+
+static std::string get_kernal_filename()
+{
+	const char *name = (const char *)&RAM[RAM[FNADR] | RAM[FNADR + 1] << 8];
+	return std::string(name, RAM[FNLEN]);
+}
+
+// Drop any "@" (replace) and "0:" (drive) prefix from a filename.
+static std::string strip_cbm_prefix(const std::string &filename)
+{
+	size_t skip = 0;
+	if (skip < filename.size() && filename[skip] == '@') {
+		++skip;
+	}
+	const size_t colon = filename.find(':', skip);
+	if (colon != std::string::npos && colon - skip <= 1 && (colon == skip || isdigit((uint8_t)filename[skip]))) {
+		skip = colon + 1;
+	}
+	return filename.substr(skip);
+}
+
+// Find the host file for a name: the file itself if there's one by that name,
+// otherwise the first file in the directory the name matches as a pattern
+// (which for a name without wildcards means one differing only in case).
+static bool find_hyper_file(const std::string &name, char *path)
+{
+	snprintf(path, PATH_MAX, "%s/%s", Options.hyper_path, name.c_str());
+
+	struct stat st;
+	if (!has_wildcards(name.c_str()) && stat(path, &st) == 0 && !S_ISDIR(st.st_mode)) {
+		return true;
+	}
+
+	for (const hyper_dir_entry &entry : hyper_dir()) {
+		if (!entry.is_dir && matches_pattern(name.c_str(), entry.name.c_str())) {
+			snprintf(path, PATH_MAX, "%s/%s", Options.hyper_path, entry.name.c_str());
+			return true;
+		}
+	}
+	return false;
+}
+
+static int create_directory_listing(uint8_t *data, const uint8_t *data_end, const char *pattern)
+{
+	uint8_t *data_start = data;
 
 	// We inject this directly into RAM, so
 	// this does not include the load address!
@@ -40,12 +206,21 @@ static int create_directory_listing(uint8_t *data)
 	*data++ = 0;
 	*data++ = 0x12; // REVERSE ON
 	*data++ = '"';
-	for (int i = 0; i < 16; i++) {
-		*data++ = ' ';
+
+	// The disk name is the directory's name.
+	std::string disk_name = Options.hyper_path;
+	while (disk_name.size() > 1 && (disk_name.back() == '/' || disk_name.back() == '\\')) {
+		disk_name.pop_back();
 	}
-	if (!(getcwd((char *)data - 16, 256))) {
-		return false;
+	if (disk_name == ".") {
+		char cwd[PATH_MAX];
+		disk_name = getcwd(cwd, sizeof(cwd)) ? cwd : "";
 	}
+	disk_name = disk_name.substr(disk_name.find_last_of("/\\") + 1);
+	for (size_t i = 0; i < 16; i++) {
+		*data++ = i < disk_name.size() ? disk_name[i] : ' ';
+	}
+
 	*data++ = '"';
 	*data++ = ' ';
 	*data++ = '0';
@@ -55,17 +230,18 @@ static int create_directory_listing(uint8_t *data)
 	*data++ = 'C';
 	*data++ = 0;
 
-	if (!(dirp = opendir(Options.hyper_path))) {
-		return 0;
-	}
-	while ((dp = readdir(dirp))) {
-		size_t namlen = strlen(dp->d_name);
-		stat(dp->d_name, &st);
-		file_size = (st.st_size + 255) / 256;
-		if (file_size > 0xFFFF) {
-			file_size = 0xFFFF;
+	// Each line takes at most 30 bytes, and the listing mustn't run into the I/O area.
+	for (const hyper_dir_entry &entry : hyper_dir()) {
+		if (data_end - data < 30 + 20) {
+			break;
+		}
+		if (pattern != nullptr && !matches_pattern(pattern, entry.name.c_str())) {
+			continue;
 		}
 
+		size_t namlen    = entry.name.size();
+		int    file_size = (int)MIN(((uint64_t)entry.size + 255) / 256, 0xFFFF);
+
 		// link
 		*data++ = 1;
 		*data++ = 1;
@@ -85,16 +261,15 @@ static int create_directory_listing(uint8_t *data)
 		if (namlen > 16) {
 			namlen = 16; // TODO hack
 		}
-		memcpy(data, dp->d_name, namlen);
+		memcpy(data, entry.name.data(), namlen);
 		data += namlen;
 		*data++ = '"';
 		for (size_t i = namlen; i < 16; i++) {
 			*data++ = ' ';
 		}
 		*data++ = ' ';
-		*data++ = 'P';
-		*data++ = 'R';
-		*data++ = 'G';
+		memcpy(data, entry.is_dir ? "DIR" : "PRG", 3);
+		data += 3;
 		*data++ = 0;
 	}
 
@@ -113,36 +288,33 @@ static int create_directory_listing(uint8_t *data)
 	// link
 	*data++ = 0;
 	*data++ = 0;
-	(void)closedir(dirp);
 	return (int)(reinterpret_cast<uintptr_t>(data) - reinterpret_cast<uintptr_t>(data_start));
 }
 
 void LOAD()
 {
-	char const *kernal_filename = (char *)&RAM[RAM[FNADR] | RAM[FNADR + 1] << 8];
-	uint16_t    override_start  = (x | (y << 8));
+	const std::string kernal_filename = get_kernal_filename();
+	uint16_t          override_start  = (x | (y << 8));
 
 	if (kernal_filename[0] == '$') {
-		uint16_t dir_len = create_directory_listing(RAM + override_start);
+		// "$" lists everything, "$:<pattern>" only the matching files.
+		const size_t      colon   = kernal_filename.find(':');
+		const std::string pattern = colon != std::string::npos ? kernal_filename.substr(colon + 1) : "";
+
+		uint16_t dir_len = override_start < 0x9f00 ? create_directory_listing(RAM + override_start, RAM + 0x9f00, pattern.empty() ? nullptr : pattern.c_str()) : 0;
 		uint16_t end     = override_start + dir_len;
+		memory_mark_dirty(override_start, dir_len);
 		x                = end & 0xff;
 		y                = end >> 8;
 		status &= 0xfe;
-		RAM[STATUS] = 0;
-		a           = 0;
+		set_status(0);
+		a = 0;
 	} else {
-		char      filename[PATH_MAX];
-		const int hyperpath_len = snprintf(filename, PATH_MAX, "%s/", Options.hyper_path);
-		filename[PATH_MAX - 1]  = '\0';
-
-		const int len = MIN(RAM[FNLEN], sizeof(filename) - hyperpath_len - 1);
-		memcpy(filename + hyperpath_len, kernal_filename, len);
-		filename[hyperpath_len + len] = 0;
-
-		SDL_RWops *f = SDL_RWFromFile(filename, "rb");
+		char       filename[PATH_MAX];
+		SDL_RWops *f = find_hyper_file(strip_cbm_prefix(kernal_filename), filename) ? SDL_RWFromFile(filename, "rb") : nullptr;
 		if (!f) {
-			a           = 4; // FNF
-			RAM[STATUS] = a;
+			a = 4; // FNF
+			set_status(a);
 			status |= 1;
 			return;
 		}
@@ -162,33 +334,43 @@ void LOAD()
 			vera_video_write(0, start & 0xff);
 			vera_video_write(1, start >> 8);
 			vera_video_write(2, ((a - 2) & 0xf) | 0x10);
-			uint8_t buf[2048];
+
+			uint32_t address = ((uint32_t)(a - 2) & 0x1) << 16 | start;
+			uint8_t  buf[0x4000];
 			while (1) {
 				uint16_t n = (uint16_t)SDL_RWread(f, buf, 1, sizeof buf);
 				if (n == 0)
 					break;
-				for (size_t i = 0; i < n; i++) {
-					vera_video_write(3, buf[i]);
-				}
+				vera_video_space_write_range(address, buf, n);
+				address += n;
 				bytes_read += n;
 			}
+
+			// Leave the data port where writing the file through it byte by byte would have.
+			vera_video_write(0, address & 0xff);
+			vera_video_write(1, (address >> 8) & 0xff);
+			vera_video_write(2, ((address >> 16) & 0x1) | 0x10);
 		} else if (start < 0x9f00) {
 			// Fixed RAM
 			bytes_read = (uint16_t)SDL_RWread(f, RAM + start, 1, 0x9f00 - start);
+			memory_mark_dirty(start, bytes_read);
 		} else if (start < 0xa000) {
 			// IO addresses
 		} else if (start < 0xc000) {
 			// banked RAM
+			uint8_t  bank    = memory_get_ram_bank();
+			uint16_t address = start;
+			uint8_t  buf[0x4000];
 			while (1) {
-				size_t len = 0xc000 - start;
-				bytes_read = (uint16_t)SDL_RWread(f, RAM + (((uint16_t)memory_get_ram_bank() % Options.num_ram_banks) << 13) + start, 1, len);
-				if (bytes_read < len)
+				uint16_t n = (uint16_t)SDL_RWread(f, buf, 1, sizeof buf);
+				if (n == 0)
 					break;
-
-				// Wrap into the next bank
-				start = 0xa000;
-				memory_set_ram_bank(1 + memory_get_ram_bank());
+				memory_write_banked_range(bank, address, buf, n);
 			}
+			memory_set_ram_bank(bank);
+
+			// Report the end address within the last bank written to.
+			bytes_read = address - start;
 		} else {
 			// ROM
 		}
@@ -199,22 +381,25 @@ void LOAD()
 		x            = end & 0xff;
 		y            = end >> 8;
 		status &= 0xfe;
-		RAM[STATUS] = 0;
-		a           = 0;
+		set_status(0);
+		a = 0;
 	}
 }
 
 void SAVE()
 {
-	char const *kernal_filename = (char *)&RAM[RAM[FNADR] | RAM[FNADR + 1] << 8];
+	const std::string kernal_filename = strip_cbm_prefix(get_kernal_filename());
 
-	char      filename[PATH_MAX];
-	const int hyperpath_len = snprintf(filename, PATH_MAX, "%s/", Options.hyper_path);
-	filename[PATH_MAX - 1]  = '\0';
-
-	const int len = MIN(RAM[FNLEN], sizeof(filename) - hyperpath_len - 1);
-	memcpy(filename + hyperpath_len, kernal_filename, len);
-	filename[hyperpath_len + len] = 0;
+	// A pattern replaces the first file it matches; there's no creating a file with one.
+	char filename[PATH_MAX];
+	if (!has_wildcards(kernal_filename.c_str())) {
+		snprintf(filename, PATH_MAX, "%s/%s", Options.hyper_path, kernal_filename.c_str());
+	} else if (!find_hyper_file(kernal_filename, filename)) {
+		a = 4; // FNF
+		set_status(a);
+		status |= 1;
+		return;
+	}
 
 	uint16_t start = RAM[a] | RAM[a + 1] << 8;
 	uint16_t end   = x | y << 8;
@@ -226,8 +411,8 @@ void SAVE()
 
 	SDL_RWops *f = SDL_RWFromFile(filename, "wb");
 	if (!f) {
-		a           = 4; // FNF
-		RAM[STATUS] = a;
+		a = 4; // FNF
+		set_status(a);
 		status |= 1;
 		return;
 	}
@@ -238,7 +423,10 @@ void SAVE()
 	SDL_RWwrite(f, RAM + start, 1, end - start);
 	SDL_RWclose(f);
 
+	// No waiting for the directory's mtime to change before a LOAD"$" shows the new file.
+	Dir_valid = false;
+
 	status &= 0xfe;
-	RAM[STATUS] = 0;
-	a           = 0;
+	set_status(0);
+	a = 0;
 }
@@ -0,0 +1,155 @@
+#include "lz.h"
+
+#include <algorithm>
+#include <string.h>
+
+// Every sequence is a token byte, literals, then a match copied from earlier output:
+//   token:   literal count (high nibble), match length - Min_match (low nibble)
+//            a nibble of 15 is continued in extra bytes, each adding up to 255
+//   offset:  2 bytes, little endian, how far back the match starts
+// The last sequence has literals only and ends the input.
+
+static constexpr size_t Min_match  = 4;
+static constexpr size_t Max_offset = 0xffff;
+static constexpr int    Hash_bits  = 12;
+static constexpr int    Skip_log2  = 6;
+
+static uint32_t read32(const uint8_t *p)
+{
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static uint32_t hash4(uint32_t value)
+{
+	return (value * 2654435761u) >> (32 - Hash_bits);
+}
+
+static void put_length(std::vector<uint8_t> &dst, size_t length)
+{
+	while (length >= 255) {
+		dst.push_back(255);
+		length -= 255;
+	}
+	dst.push_back((uint8_t)length);
+}
+
+static void put_sequence(std::vector<uint8_t> &dst, const uint8_t *literals, size_t num_literals, size_t match_length, size_t offset)
+{
+	const size_t literal_code = std::min<size_t>(num_literals, 15);
+	const size_t match_code   = match_length > 0 ? std::min<size_t>(match_length - Min_match, 15) : 0;
+
+	dst.push_back((uint8_t)(literal_code << 4 | match_code));
+	if (literal_code == 15) {
+		put_length(dst, num_literals - 15);
+	}
+	dst.insert(dst.end(), literals, literals + num_literals);
+
+	if (match_length > 0) {
+		dst.push_back((uint8_t)(offset & 0xff));
+		dst.push_back((uint8_t)(offset >> 8));
+		if (match_code == 15) {
+			put_length(dst, match_length - Min_match - 15);
+		}
+	}
+}
+
+static bool get_length(const uint8_t *&src, const uint8_t *end, size_t &length)
+{
+	uint8_t byte;
+	do {
+		if (src == end) {
+			return false;
+		}
+		byte = *src++;
+		length += byte;
+	} while (byte == 255);
+	return true;
+}
+
+void lz_compress(const uint8_t *src, size_t size, std::vector<uint8_t> &dst)
+{
+	static uint32_t table[1 << Hash_bits];
+	memset(table, 0, sizeof(table));
+
+	dst.clear();
+
+	size_t anchor = 0;
+	size_t pos    = 0;
+	while (pos + Min_match <= size) {
+		const uint32_t value     = read32(src + pos);
+		const uint32_t hash      = hash4(value);
+		const size_t   candidate = table[hash];
+		table[hash]              = (uint32_t)pos;
+
+		if (candidate < pos && pos - candidate <= Max_offset && read32(src + candidate) == value) {
+			size_t length = Min_match;
+			while (pos + length < size && src[candidate + length] == src[pos + length]) {
+				++length;
+			}
+			put_sequence(dst, src + anchor, pos - anchor, length, pos - candidate);
+			pos += length;
+			anchor = pos;
+		} else {
+			// Move on faster the longer nothing matched.
+			pos += 1 + ((pos - anchor) >> Skip_log2);
+		}
+	}
+	put_sequence(dst, src + anchor, size - anchor, 0, 0);
+}
+
+bool lz_decompress(const uint8_t *src, size_t size, uint8_t *dst, size_t dst_size)
+{
+	const uint8_t *end = src + size;
+	size_t         out = 0;
+
+	while (src < end) {
+		const uint8_t token = *src++;
+
+		size_t num_literals = token >> 4;
+		if (num_literals == 15 && !get_length(src, end, num_literals)) {
+			return false;
+		}
+		if (num_literals > (size_t)(end - src) || num_literals > dst_size - out) {
+			return false;
+		}
+		memcpy(dst + out, src, num_literals);
+		src += num_literals;
+		out += num_literals;
+
+		if (src == end) {
+			break;
+		}
+
+		if (end - src < 2) {
+			return false;
+		}
+		const size_t offset = src[0] | src[1] << 8;
+		src += 2;
+
+		size_t match_length = token & 0xf;
+		if (match_length == 15 && !get_length(src, end, match_length)) {
+			return false;
+		}
+		match_length += Min_match;
+		if (offset == 0 || offset > out || match_length > dst_size - out) {
+			return false;
+		}
+
+		// Matches may overlap what they produce. Runs of one byte value are common.
+		const uint8_t *from = dst + out - offset;
+		if (offset >= match_length) {
+			memcpy(dst + out, from, match_length);
+		} else if (offset == 1) {
+			memset(dst + out, *from, match_length);
+		} else {
+			for (size_t i = 0; i < match_length; ++i) {
+				dst[out + i] = from[i];
+			}
+		}
+		out += match_length;
+	}
+
+	return out == dst_size;
+}
@@ -0,0 +1,19 @@
+#pragma once
+#if !defined(LZ_H)
+#	define LZ_H
+
+#	include <stddef.h>
+#	include <stdint.h>
+#	include <vector>
+
+// A small LZ77 codec in the spirit of LZ4: byte-aligned, no entropy coding, fast
+// both ways. Meant for data with long runs (like XOR deltas, which are mostly
+// zeros), not for getting files as small as possible.
+
+// Replaces the contents of dst, keeping its capacity.
+void lz_compress(const uint8_t *src, size_t size, std::vector<uint8_t> &dst);
+
+// Fails unless src decompresses to exactly dst_size bytes.
+bool lz_decompress(const uint8_t *src, size_t size, uint8_t *dst, size_t dst_size);
+
+#endif
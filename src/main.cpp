@@ -8,33 +8,45 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #ifdef __MINGW32__
 #	include <ctype.h>
 #endif
 #include "SDL.h"
 #include "audio.h"
+#include "call_stack.h"
 #include "cpu/fake6502.h"
 #include "debugger.h"
 #include "display.h"
 #include "gif_recorder.h"
 #include "glue.h"
 #include "i2c.h"
+#include "instant_boot.h"
 #include "joystick.h"
 #include "keyboard.h"
 #include "loadsave.h"
 #include "memory.h"
 #include "midi.h"
+#include "movie.h"
+#include "noise.h"
+#include "offline_render.h"
 #include "options.h"
 #include "overlay/cpu_visualization.h"
 #include "overlay/overlay.h"
+#include "overlay/raster_timeline.h"
 #include "ps2.h"
+#include "rewind.h"
 #include "ring_buffer.h"
 #include "rom_symbols.h"
 #include "rtc.h"
+#include "run_ahead.h"
 #include "sdl_events.h"
+#include "sound_recorder.h"
+#include "state.h"
 #include "symbols.h"
 #include "timing.h"
+#include "trace.h"
 #include "unicode.h"
 #include "utf8.h"
 #include "utf8_encode.h"
@@ -43,6 +55,7 @@
 #include "vera/vera_video.h"
 #include "version.h"
 #include "via.h"
+#include "video_recorder.h"
 #include "wav_recorder.h"
 #include "ym2151/ym2151.h"
 
@@ -108,6 +121,8 @@ void machine_reset()
 	vera_video_reset();
 	YM_reset();
 	reset6502();
+	call_stack_reset();
+	rewind_clear();
 }
 
 void machine_toggle_warp()
@@ -119,10 +134,47 @@ void machine_toggle_warp()
 
 static bool is_kernal()
 {
-	return read6502(0xfff6) == 'M' && // only for KERNAL
-	       read6502(0xfff7) == 'I' &&
-	       read6502(0xfff8) == 'S' &&
-	       read6502(0xfff9) == 'T';
+	return debug_read6502(0xfff6) == 'M' && // only for KERNAL
+	       debug_read6502(0xfff7) == 'I' &&
+	       debug_read6502(0xfff8) == 'S' &&
+	       debug_read6502(0xfff9) == 'T';
+}
+
+static void inject_prg()
+{
+	if (prg_file) {
+		uint8_t  start_lo = SDL_ReadU8(prg_file);
+		uint8_t  start_hi = SDL_ReadU8(prg_file);
+		uint16_t start;
+		if (prg_override_start >= 0) {
+			start = prg_override_start;
+		} else {
+			start = start_hi << 8 | start_lo;
+		}
+		uint16_t size = (uint16_t)SDL_RWread(prg_file, RAM + start, 1, 65536 - start);
+		uint16_t end  = start + size;
+		memory_mark_dirty(start, size);
+		movie_record_ram(start, size);
+		SDL_RWclose(prg_file);
+		prg_file = NULL;
+		if (start == 0x0801) {
+			// set start of variables
+			RAM[VARTAB]     = end & 0xff;
+			RAM[VARTAB + 1] = end >> 8;
+			memory_mark_dirty(VARTAB, 2);
+			movie_record_ram(VARTAB, 2);
+		}
+
+		if (Options.run_after_load) {
+			if (start == 0x0801) {
+				keyboard_add_text("RUN\r");
+			} else {
+				char sys_text[10];
+				sprintf(sys_text, "SYS$%04X\r", start);
+				keyboard_add_text(sys_text);
+			}
+		}
+	}
 }
 
 #undef main
@@ -131,16 +183,33 @@ int main(int argc, char **argv)
 	const char *base_path = SDL_GetBasePath();
 	load_options(base_path, argc, argv);
 
+	if (strlen(Options.decode_trace_path) > 0) {
+		return trace_decode(Options.decode_trace_path, stdout) ? 0 : 1;
+	}
+
 	if (Options.log_video) {
 		vera_video_set_log_video(true);
 	}
 
+	const bool headless = strlen(Options.render_path) > 0;
+	if (headless) {
+		Options.warp_factor = 1;
+	}
+
+	const bool replaying = headless && strlen(Options.replay_path) > 0;
+	if (!headless && strlen(Options.replay_path) > 0) {
+		printf("-playlog requires -render.\n");
+		exit(1);
+	}
+
+	const bool playing_movie = strlen(Options.play_movie_path) > 0;
+
 	if (Options.warp_factor > 0) {
 		vera_video_set_cheat_mask(0x3f);
 	}
 
-	// Load ROM
-	{
+	// Load ROM (replaying a sound log never runs the CPU, so doesn't need one)
+	if (!replaying) {
 		SDL_RWops *f = nullptr;
 
 		option_source optsrc  = option_get_source("rom");
@@ -152,24 +221,30 @@ int main(int argc, char **argv)
 		char base_path_buffer[PATH_MAX];
 		int  base_path_len = options_get_base_path(base_path_buffer, Options.rom_path);
 
+		const char *rom_path = nullptr;
+
 		if (optsrc == option_source::DEFAULT) {
 			f = SDL_RWFromFile(base_path_buffer, "rb");
 			if (f) {
+				rom_path = base_path_buffer;
 				goto have_rom;
 			}
 
 			f = SDL_RWFromFile(rel_path_buffer, "rb");
 			if (f) {
+				rom_path = rel_path_buffer;
 				goto have_rom;
 			}
 		} else {
 			f = SDL_RWFromFile(rel_path_buffer, "rb");
 			if (f) {
+				rom_path = rel_path_buffer;
 				goto have_rom;
 			}
 
 			f = SDL_RWFromFile(base_path_buffer, "rb");
 			if (f) {
+				rom_path = base_path_buffer;
 				goto have_rom;
 			}
 		}
@@ -178,8 +253,10 @@ int main(int argc, char **argv)
 		exit(1);
 
 	have_rom:
-		printf("Using ROM at %s\n\t-rom sourced from: %s\n", base_path_buffer, srcname);
-		SDL_RWread(f, ROM, ROM_SIZE, 1);
+		printf("Using ROM at %s\n\t-rom sourced from: %s\n", rom_path, srcname);
+		if (!Options.instant_boot || !memory_map_rom(rom_path)) {
+			SDL_RWread(f, ROM, ROM_SIZE, 1);
+		}
 		SDL_RWclose(f);
 	}
 
@@ -193,6 +270,7 @@ int main(int argc, char **argv)
 		}
 	}
 
+	sdcard_set_overlay(Options.sdcard_overlay, Options.sdcard_commit);
 	if (strlen(Options.sdcard_path) > 0) {
 		sdcard_set_file(Options.sdcard_path);
 	}
@@ -249,18 +327,33 @@ int main(int argc, char **argv)
 	SDL_SetHint(SDL_HINT_VIDEO_X11_NET_WM_BYPASS_COMPOSITOR, "0");
 #endif
 
-	SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS | SDL_INIT_GAMECONTROLLER | SDL_INIT_AUDIO);
+	if (headless) {
+		SDL_Init(SDL_INIT_EVENTS);
+
+		audio_init_offline();
+		audio_set_render_callback(offline_render_process);
+	} else {
+		SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS | SDL_INIT_GAMECONTROLLER | SDL_INIT_AUDIO);
 
-	if (!Options.no_sound) {
-		audio_init(strlen(Options.audio_dev_name) > 0 ? Options.audio_dev_name : nullptr, Options.audio_buffers);
-		audio_set_render_callback(wav_recorder_process);
+		if (!Options.no_sound) {
+			audio_init(strlen(Options.audio_dev_name) > 0 ? Options.audio_dev_name : nullptr, Options.audio_buffers);
+			audio_set_render_callback(wav_recorder_process);
+		}
+	}
+
+	if (headless || !Options.no_sound) {
 		YM_set_irq_enabled(Options.ym_irq);
 		YM_set_strict_busy(Options.ym_strict);
+		audio_set_source_volume(AUDIO_SOURCE_YM, Options.ym_volume / 100.0f);
+		audio_set_source_volume(AUDIO_SOURCE_PSG, Options.psg_volume / 100.0f);
+		audio_set_source_volume(AUDIO_SOURCE_PCM, Options.pcm_volume / 100.0f);
+		audio_set_dc_filter_enabled(Options.dc_filter);
 	}
 
+	noise_seed((uint32_t)time(NULL));
 	memory_init();
 
-	{
+	if (!headless) {
 		display_settings init_settings;
 		init_settings.video_rect.w  = 640;
 		init_settings.video_rect.h  = 480;
@@ -275,28 +368,71 @@ int main(int argc, char **argv)
 		gif_recorder_set_path(Options.gif_path);
 	}
 
-	if (strlen(Options.wav_path) > 0) {
+	if (strlen(Options.video_path) > 0 && !headless) {
+		video_recorder_set_path(Options.video_path);
+	}
+
+	wav_recorder_set_format(Options.wav_float, Options.wav_multitrack);
+	if (headless) {
+		offline_render_set_path(Options.render_path);
+	} else if (strlen(Options.wav_path) > 0) {
 		wav_recorder_set_path(Options.wav_path);
 	}
 
+	if (strlen(Options.sound_path) > 0 && !replaying) {
+		sound_recorder_set_path(Options.sound_path);
+	}
+
 	gif_recorder_init(SCREEN_WIDTH, SCREEN_HEIGHT);
 	wav_recorder_init();
+	video_recorder_init();
 
-	joystick_init();
+	if (!headless) {
+		joystick_init();
+	}
 
 	midi_init();
 
 	rtc_init(Options.set_system_time);
 
-	machine_reset();
+	if (!replaying && !playing_movie && instant_boot_restore()) {
+		// We're where BASIC first reads a line, which the emulator loop won't see again.
+		inject_prg();
+	} else {
+		machine_reset();
+	}
+
+	if (strlen(Options.state_path) > 0 && !machine_load_state_file(Options.state_path)) {
+		exit(1);
+	}
+
+	rewind_init(Options.rewind_seconds);
+
+	if (playing_movie) {
+		if (!movie_replay_start(Options.play_movie_path)) {
+			exit(1);
+		}
+	} else if (strlen(Options.movie_path) > 0 && !movie_record_start(Options.movie_path)) {
+		exit(1);
+	}
+
+	if (strlen(Options.trace_path) > 0 && !trace_start(Options.trace_path)) {
+		exit(1);
+	}
 
 	timing_init();
 
+	if (replaying) {
+		if (!offline_render_replay(Options.replay_path)) {
+			exit(1);
+		}
+	} else {
 #ifdef __EMSCRIPTEN__
-	emscripten_set_main_loop(emulator_loop, 0, 1);
+		emscripten_set_main_loop(emulator_loop, 0, 1);
 #else
-	emulator_loop();
+		emulator_loop();
 #endif
+	}
 
 	if (nvram_dirty && strlen(Options.nvram_path) > 0) {
 		SDL_RWops *f = SDL_RWFromFile(Options.nvram_path, "wb");
@@ -309,90 +445,128 @@ int main(int argc, char **argv)
 
 	SDL_free(const_cast<char *>(base_path));
 
+	movie_stop();
+	trace_stop();
+	sound_recorder_shutdown();
+	sdcard_shutdown();
 	audio_close();
+	video_recorder_shutdown();
 	wav_recorder_shutdown();
 	gif_recorder_shutdown();
-	display_shutdown();
+	if (!headless) {
+		display_shutdown();
+	}
 	SDL_Quit();
 
 	return 0;
 }
 
-//
-// Trace functionality preserved for comparison with official emulator releases
-//
-#if defined(TRACE)
-#	include "rom_labels.h"
-char *label_for_address(uint16_t address)
+bool machine_step(bool &new_frame)
 {
-	uint16_t *addresses;
-	char **   labels;
-	int       count;
-	switch (memory_get_rom_bank()) {
-		case 0:
-			addresses = addresses_bank0;
-			labels    = labels_bank0;
-			count     = sizeof(addresses_bank0) / sizeof(uint16_t);
-			break;
-		case 1:
-			addresses = addresses_bank1;
-			labels    = labels_bank1;
-			count     = sizeof(addresses_bank1) / sizeof(uint16_t);
-			break;
-		case 2:
-			addresses = addresses_bank2;
-			labels    = labels_bank2;
-			count     = sizeof(addresses_bank2) / sizeof(uint16_t);
-			break;
-		case 3:
-			addresses = addresses_bank3;
-			labels    = labels_bank3;
-			count     = sizeof(addresses_bank3) / sizeof(uint16_t);
-			break;
-		case 4:
-			addresses = addresses_bank4;
-			labels    = labels_bank4;
-			count     = sizeof(addresses_bank4) / sizeof(uint16_t);
-			break;
-		case 5:
-			addresses = addresses_bank5;
-			labels    = labels_bank5;
-			count     = sizeof(addresses_bank5) / sizeof(uint16_t);
+	movie_replay_step();
+
+	if (trace_is_enabled()) {
+		trace_instruction();
+	}
+
+	uint64_t old_clockticks6502 = clockticks6502;
+	step6502();
+	cpu_visualization_step();
+	uint8_t clocks = (uint8_t)(clockticks6502 - old_clockticks6502);
+	raster_timeline_step(clocks);
+	new_frame = vera_video_step(MHZ, clocks);
+	audio_render(clocks);
+
+	if (vera_video_get_irq_out() || YM_irq()) {
+		if (!(status & 4)) {
+			debugger_interrupt();
+			raster_timeline_interrupt();
+			irq6502();
+		}
+	}
+
+	switch (pc) {
+#ifdef LOAD_HYPERCALLS
+		case 0xffd5:
+		case 0xffd8:
+			if (is_kernal() && RAM[FA] == 8 && !sdcard_is_attached()) {
+				if (pc == 0xffd5) {
+					LOAD();
+				} else {
+					SAVE();
+				}
+				pc = (RAM[0x100 + sp + 1] | (RAM[0x100 + sp + 2] << 8)) + 1;
+				sp += 2;
+				return true;
+			}
 			break;
-#	if 0
-		case 6:
-			addresses = addresses_bank6;
-			labels    = labels_bank6;
-			count     = sizeof(addresses_bank6) / sizeof(uint16_t);
+#endif
+		case 0xffd2:
+			if (Options.echo_mode != ECHO_MODE_NONE && is_kernal()) {
+				uint8_t c = a;
+				if (Options.echo_mode == ECHO_MODE_COOKED) {
+					if (c == 0x0d) {
+						printf("\n");
+					} else if (c == 0x0a) {
+						// skip
+					} else if (c < 0x20 || c >= 0x80) {
+						printf("\\X%02X", c);
+					} else {
+						printf("%c", c);
+					}
+				} else if (Options.echo_mode == ECHO_MODE_ISO) {
+					if (c == 0x0d) {
+						printf("\n");
+					} else if (c == 0x0a) {
+						// skip
+					} else if (c < 0x20 || (c >= 0x80 && c < 0xa0)) {
+						printf("\\X%02X", c);
+					} else {
+						print_iso8859_15_char(c);
+					}
+				} else {
+					printf("%c", c);
+				}
+				fflush(stdout);
+			}
 			break;
-		case 7:
-			addresses = addresses_bank7;
-			labels = labels_bank7;
-			count = sizeof(addresses_bank7) / sizeof(uint16_t);
+
+		case 0xffcf:
+			if (is_kernal()) {
+				// as soon as BASIC starts reading a line, inject the app into RAM
+				instant_boot_capture();
+				if (!movie_is_replaying()) {
+					inject_prg();
+				}
+			}
 			break;
-#	endif
-		default:
-			addresses = NULL;
-			labels    = NULL;
-	}
 
-	if (!addresses) {
-		return NULL;
+		case 0xffff:
+			if (save_on_exit) {
+				machine_dump();
+			}
+			return false;
 	}
 
-	for (int i = 0; i < count; i++) {
-		if (address == addresses[i]) {
-			return labels[i];
-		}
+	// Typing during the boot would end up in the cached state.
+	if (!instant_boot_pending() && !movie_is_replaying()) {
+		keyboard_process();
 	}
-	return NULL;
+	return true;
 }
-#endif
 
 void emulator_loop()
 {
+	const bool headless      = offline_render_is_enabled();
+	const bool playing_movie = movie_is_replaying();
+
 	for (;;) {
 		if (debugger_is_paused()) {
+			if (headless) {
+				// Nobody is around to resume us.
+				break;
+			}
+			debugger_step_back_process();
 			vera_video_force_redraw_screen();
 			display_process();
 			if (!sdl_events_update()) {
@@ -402,62 +576,36 @@ void emulator_loop()
 			continue;
 		}
 
-		//
-		// Trace functionality preserved for comparison with official emulator releases
-		//
-#if defined(TRACE)
-		{
-			printf("[%6d] ", instruction_counter);
-
-			char *label     = label_for_address(pc);
-			int   label_len = label ? strlen(label) : 0;
-			if (label) {
-				printf("%s", label);
-			}
-			for (int i = 0; i < 20 - label_len; i++) {
-				printf(" ");
-			}
-			printf(" %02x:.,%04x ", memory_get_rom_bank(), pc);
-			char disasm_line[15];
-			int  len = disasm(pc, disasm_line, sizeof(disasm_line), 0);
-			for (int i = 0; i < len; i++) {
-				printf("%02x ", debug_read6502(pc + i));
-			}
-			for (int i = 0; i < 9 - 3 * len; i++) {
-				printf(" ");
-			}
-			printf("%s", disasm_line);
-			for (int i = 0; i < 15 - strlen(disasm_line); i++) {
-				printf(" ");
-			}
-
-			printf("a=$%02x x=$%02x y=$%02x s=$%02x p=", a, x, y, sp);
-			for (int i = 7; i >= 0; i--) {
-				printf("%c", (status & (1 << i)) ? "czidb.vn"[i] : '-');
-			}
-
-			printf("\n");
+		bool new_frame;
+		if (!machine_step(new_frame)) {
+			return;
 		}
-#endif
 
-		uint64_t old_clockticks6502 = clockticks6502;
-		step6502();
-		cpu_visualization_step();
-		uint8_t clocks = (uint8_t)(clockticks6502 - old_clockticks6502);
-		bool new_frame = vera_video_step(MHZ, clocks);
-		audio_render(clocks);
+		if (new_frame && headless) {
+			// A movie plays to its end, even through silence.
+			if (playing_movie ? !movie_is_replaying() : offline_render_is_finished()) {
+				break;
+			}
+		} else if (new_frame) {
+			call_stack_new_frame();
 
-		if (new_frame) {
-			midi_process();
+			// MIDI input would reach the sound chips without going through a movie.
+			if (!movie_is_recording() && !movie_is_replaying()) {
+				midi_process();
+			}
 			gif_recorder_update(vera_video_get_framebuffer());
+			video_recorder_update(vera_video_get_framebuffer());
 			static uint32_t last_display_us = timing_total_microseconds();
 			if (timing_total_microseconds() - last_display_us > 16000) { // Close enough I'm willing to pay for OpenGL's sync.
-				display_process();
+				run_ahead_display(Options.run_ahead);
 				last_display_us = timing_total_microseconds();
 			}
 			if (!sdl_events_update()) {
 				break;
 			}
+			// Between instructions, with this frame's input in, so going back here and
+			// running on is the same as never having left.
+			rewind_capture();
 
 			timing_update();
 #ifdef __EMSCRIPTEN__
@@ -465,102 +613,5 @@ void emulator_loop()
 			return 0;
 #endif
 		}
-
-		if (vera_video_get_irq_out() || YM_irq()) {
-			if (!(status & 4)) {
-				debugger_interrupt();
-				irq6502();
-			}
-		}
-
-		switch (pc) {
-#ifdef LOAD_HYPERCALLS
-			case 0xffd5:
-			case 0xffd8:
-				if (is_kernal() && RAM[FA] == 8 && !sdcard_is_attached()) {
-					if (pc == 0xffd5) {
-						LOAD();
-					} else {
-						SAVE();
-					}
-					pc = (RAM[0x100 + sp + 1] | (RAM[0x100 + sp + 2] << 8)) + 1;
-					sp += 2;
-					continue;
-				}
-				break;
-#endif
-			case 0xffd2:
-				if (Options.echo_mode != ECHO_MODE_NONE && is_kernal()) {
-					uint8_t c = a;
-					if (Options.echo_mode == ECHO_MODE_COOKED) {
-						if (c == 0x0d) {
-							printf("\n");
-						} else if (c == 0x0a) {
-							// skip
-						} else if (c < 0x20 || c >= 0x80) {
-							printf("\\X%02X", c);
-						} else {
-							printf("%c", c);
-						}
-					} else if (Options.echo_mode == ECHO_MODE_ISO) {
-						if (c == 0x0d) {
-							printf("\n");
-						} else if (c == 0x0a) {
-							// skip
-						} else if (c < 0x20 || (c >= 0x80 && c < 0xa0)) {
-							printf("\\X%02X", c);
-						} else {
-							print_iso8859_15_char(c);
-						}
-					} else {
-						printf("%c", c);
-					}
-					fflush(stdout);
-				}
-				break;
-
-			case 0xffcf:
-				if (is_kernal()) {
-					// as soon as BASIC starts reading a line...
-					if (prg_file) {
-						// ...inject the app into RAM
-						uint8_t  start_lo = SDL_ReadU8(prg_file);
-						uint8_t  start_hi = SDL_ReadU8(prg_file);
-						uint16_t start;
-						if (prg_override_start >= 0) {
-							start = prg_override_start;
-						} else {
-							start = start_hi << 8 | start_lo;
-						}
-						uint16_t end = start + (uint16_t)SDL_RWread(prg_file, RAM + start, 1, 65536 - start);
-						SDL_RWclose(prg_file);
-						prg_file = NULL;
-						if (start == 0x0801) {
-							// set start of variables
-							RAM[VARTAB]     = end & 0xff;
-							RAM[VARTAB + 1] = end >> 8;
-						}
-
-						if (Options.run_after_load) {
-							if (start == 0x0801) {
-								keyboard_add_text("RUN\r");
-							} else {
-								char sys_text[10];
-								sprintf(sys_text, "SYS$%04X\r", start);
-								keyboard_add_text(sys_text);
-							}
-						}
-					}
-				}
-				break;
-
-			case 0xffff:
-				if (save_on_exit) {
-					machine_dump();
-				}
-				return;
-		}
-
-		keyboard_process();
 	}
 }
@@ -0,0 +1,168 @@
+#include "mapped_file.h"
+
+#if defined(_WIN32)
+#	include <windows.h>
+#else
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+mapped_file::~mapped_file()
+{
+	close();
+}
+
+#if defined(_WIN32)
+
+bool mapped_file::open(const char *path, bool writable)
+{
+	close();
+
+	HANDLE file = CreateFileA(path, writable ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0 || static_cast<uint64_t>(size.QuadPart) > SIZE_MAX) {
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) {
+		CloseHandle(file);
+		return false;
+	}
+
+	void *view = MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+	if (view == nullptr) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	m_file     = file;
+	m_mapping  = mapping;
+	m_data     = static_cast<uint8_t *>(view);
+	m_size     = static_cast<size_t>(size.QuadPart);
+	m_writable = writable;
+	return true;
+}
+
+void mapped_file::close()
+{
+	if (m_data != nullptr) {
+		if (m_writable) {
+			flush_all(true);
+		}
+		UnmapViewOfFile(m_data);
+		CloseHandle(m_mapping);
+		CloseHandle(m_file);
+	}
+
+	m_data    = nullptr;
+	m_size    = 0;
+	m_file    = nullptr;
+	m_mapping = nullptr;
+}
+
+void mapped_file::flush(size_t offset, size_t length, bool wait)
+{
+	if (m_data == nullptr || !m_writable || offset >= m_size) {
+		return;
+	}
+	if (length > m_size - offset) {
+		length = m_size - offset;
+	}
+
+	FlushViewOfFile(m_data + offset, length);
+	if (wait) {
+		FlushFileBuffers(m_file);
+	}
+}
+
+void mapped_file::prefetch(size_t, size_t)
+{
+	// PrefetchVirtualMemory needs Windows 8; the cache manager's own read-ahead has to do.
+}
+
+#else
+
+bool mapped_file::open(const char *path, bool writable)
+{
+	close();
+
+	const int fd = ::open(path, writable ? O_RDWR : O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0 || static_cast<uint64_t>(st.st_size) > SIZE_MAX) {
+		::close(fd);
+		return false;
+	}
+
+	void *map = mmap(nullptr, static_cast<size_t>(st.st_size), writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		::close(fd);
+		return false;
+	}
+
+	m_fd       = fd;
+	m_data     = static_cast<uint8_t *>(map);
+	m_size     = static_cast<size_t>(st.st_size);
+	m_writable = writable;
+	return true;
+}
+
+void mapped_file::close()
+{
+	if (m_data != nullptr) {
+		if (m_writable) {
+			flush_all(true);
+		}
+		munmap(m_data, m_size);
+		::close(m_fd);
+	}
+
+	m_data = nullptr;
+	m_size = 0;
+	m_fd   = -1;
+}
+
+void mapped_file::flush(size_t offset, size_t length, bool wait)
+{
+	if (m_data == nullptr || !m_writable || offset >= m_size) {
+		return;
+	}
+	if (length > m_size - offset) {
+		length = m_size - offset;
+	}
+
+	// msync wants a page-aligned start.
+	static const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	const size_t        start     = offset - offset % page_size;
+
+	msync(m_data + start, length + (offset - start), wait ? MS_SYNC : MS_ASYNC);
+}
+
+void mapped_file::prefetch(size_t offset, size_t length)
+{
+	if (m_data == nullptr || offset >= m_size) {
+		return;
+	}
+	if (length > m_size - offset) {
+		length = m_size - offset;
+	}
+
+	static const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	const size_t        start     = offset - offset % page_size;
+
+	madvise(m_data + start, length + (offset - start), MADV_WILLNEED);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,46 @@
+#pragma once
+#if !defined(MAPPED_FILE_H)
+#	define MAPPED_FILE_H
+
+#	include <stddef.h>
+#	include <stdint.h>
+
+// A file mapped into memory in its entirety. Writable mappings are shared,
+// so stores into data() end up in the file; flush() controls when.
+class mapped_file
+{
+public:
+	mapped_file() = default;
+	~mapped_file();
+
+	mapped_file(const mapped_file &) = delete;
+	mapped_file &operator=(const mapped_file &) = delete;
+
+	bool open(const char *path, bool writable);
+	void close();
+
+	// Write back dirty pages in [offset, offset + length). With wait, returns once they're on disk.
+	void flush(size_t offset, size_t length, bool wait);
+	void flush_all(bool wait) { flush(0, m_size, wait); }
+
+	// Hint that [offset, offset + length) will be read soon.
+	void prefetch(size_t offset, size_t length);
+
+	bool     is_open() const { return m_data != nullptr; }
+	uint8_t *data() const { return m_data; }
+	size_t   size() const { return m_size; }
+
+private:
+	uint8_t *m_data     = nullptr;
+	size_t   m_size     = 0;
+	bool     m_writable = false;
+
+#	if defined(_WIN32)
+	void *m_file    = nullptr;
+	void *m_mapping = nullptr;
+#	else
+	int m_fd = -1;
+#	endif
+};
+
+#endif
\ No newline at end of file
@@ -4,13 +4,20 @@
 
 #include "memory.h"
 #include "cpu/fake6502.h"
+#include "debugger.h"
 #include "gif_recorder.h"
+#include "sound_recorder.h"
+#include "video_recorder.h"
 #include "wav_recorder.h"
 #include "glue.h"
+#include "mapped_file.h"
 #include "ps2.h"
+#include "state.h"
+#include "trace.h"
 #include "vera/vera_video.h"
 #include "via.h"
 #include "ym2151/ym2151.h"
+#include <algorithm>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
@@ -19,8 +26,19 @@
 #define RAM_BANK (RAM[0])
 #define ROM_BANK (RAM[1])
 
+static uint8_t     Rom_buffer[ROM_SIZE];
+static mapped_file Rom_file;
+
 uint8_t *RAM;
-uint8_t  ROM[ROM_SIZE];
+uint8_t *ROM = Rom_buffer;
+
+// One flag per 256-byte page of RAM, set by every write.
+static uint8_t Dirty_pages[(0xa000 + NUM_MAX_RAM_BANKS * 8192) >> 8];
+
+// One set of watch_flags per 256-byte page of the CPU's address space, all banks alike.
+static uint8_t Watch_pages[0x100];
+
+static bool Trace_accesses = false;
 
 static uint8_t addr_ym = 0;
 
@@ -117,6 +135,47 @@ void memory_reset()
 	memory_set_rom_bank(0);
 }
 
+bool memory_map_rom(const char *path)
+{
+	if (!Rom_file.open(path, false)) {
+		return false;
+	}
+	if (Rom_file.size() < ROM_SIZE) {
+		Rom_file.close();
+		return false;
+	}
+
+	ROM = Rom_file.data();
+	return true;
+}
+
+void memory_save_restore(state_stream &state)
+{
+	state.memory(RAM, RAM_SIZE);
+}
+
+uint8_t *memory_get_dirty_pages()
+{
+	return Dirty_pages;
+}
+
+uint8_t *memory_get_watch_pages()
+{
+	return Watch_pages;
+}
+
+void memory_trace_accesses(bool enable)
+{
+	Trace_accesses = enable;
+}
+
+void memory_mark_dirty(uint32_t offset, uint32_t size)
+{
+	if (size > 0) {
+		memset(Dirty_pages + (offset >> 8), 1, ((offset + size - 1) >> 8) - (offset >> 8) + 1);
+	}
+}
+
 //
 // Banked RAM access
 //
@@ -140,12 +199,18 @@ static uint8_t real_ram_read(uint16_t address)
 
 static void debug_ram_write(uint16_t address, uint8_t bank, uint8_t value)
 {
-	RAM[((uint32_t)bank << 13) + address] = value;
+	const uint32_t offset = ((uint32_t)bank << 13) + address;
+
+	RAM[offset]              = value;
+	Dirty_pages[offset >> 8] = 1;
 }
 
 static void real_ram_write(uint16_t address, uint8_t value)
 {
-	RAM[(effective_ram_bank() << 13) + address] = value;
+	const uint32_t offset = (effective_ram_bank() << 13) + address;
+
+	RAM[offset]              = value;
+	Dirty_pages[offset >> 8] = 1;
 }
 
 //
@@ -177,12 +242,12 @@ uint8_t debug_emu_read(uint8_t reg)
 		case 4: return save_on_exit ? 1 : 0;
 		case 5: return gif_recorder_get_state();
 		case 6: return wav_recorder_get_state();
-		//case 7: return -1;
+		case 7: return sound_recorder_get_state();
 		case 8: return (clockticks6502 >> 0) & 0xff;
 		case 9: return (clockticks6502 >> 8) & 0xff;
 		case 10: return (clockticks6502 >> 16) & 0xff;
 		case 11: return (clockticks6502 >> 24) & 0xff;
-		// case 12: return -1;
+		case 12: return video_recorder_get_state();
 		case 13: return Options.keymap;
 		case 14: return '1'; // emulator detection
 		case 15: return '6'; // emulator detection
@@ -200,12 +265,12 @@ uint8_t real_emu_read(uint8_t reg)
 		case 4: return save_on_exit ? 1 : 0;
 		case 5: return gif_recorder_get_state();
 		case 6: return wav_recorder_get_state();
-		//case 7: return -1;
+		case 7: return sound_recorder_get_state();
 		case 8: return (clockticks6502 >> 0) & 0xff;
 		case 9: return (clockticks6502 >> 8) & 0xff;
 		case 10: return (clockticks6502 >> 16) & 0xff;
 		case 11: return (clockticks6502 >> 24) & 0xff;
-		// case 12: return -1;
+		case 12: return video_recorder_get_state();
 		case 13: return Options.keymap;
 		case 14: return '1'; // emulator detection
 		case 15: return '6'; // emulator detection
@@ -226,6 +291,8 @@ void emu_write(uint8_t reg, uint8_t value)
 		case 4: save_on_exit = v; break;
 		case 5: gif_recorder_set((gif_recorder_command_t)value); break;
 		case 6: wav_recorder_set((wav_recorder_command_t)value); break;
+		case 7: sound_recorder_set((sound_recorder_command_t)value); break;
+		case 12: video_recorder_set((video_recorder_command_t)value); break;
 		default: break; // printf("WARN: Invalid register %x\n", DEVICE_EMULATOR + reg);
 	}
 }
@@ -236,7 +303,9 @@ void emu_write(uint8_t reg, uint8_t value)
 
 static void sound_write(uint16_t address, uint8_t value)
 {
-	YM_write(static_cast<uint8_t>(address & 1), value);
+	if (YM_write(static_cast<uint8_t>(address & 1), value) && (address & 1)) {
+		sound_recorder_ym_write(YM_last_address(), value);
+	}
 }
 
 static uint8_t sound_read(uint16_t address)
@@ -307,7 +376,10 @@ static void debug_write(uint16_t address, uint8_t bank, uint8_t value)
 {
 	switch (MAP[(address >> (BYTE * 8)) & 0xff]) {
 		case MEMMAP_NULL: break;
-		case MEMMAP_DIRECT: RAM[address] = value; break;
+		case MEMMAP_DIRECT:
+			RAM[address]              = value;
+			Dirty_pages[address >> 8] = 1;
+			break;
 		case MEMMAP_RAMBANK: debug_ram_write(address, bank, value); break;
 		case MEMMAP_ROMBANK: /* Lelz you can't do that. */ break;
 		case MEMMAP_IO: real_write<memory_map_io, 0>(address, value); break;
@@ -330,7 +402,10 @@ static void real_write(uint16_t address, uint8_t value)
 {
 	switch (MAP[(address >> (BYTE * 8)) & 0xff]) {
 		case MEMMAP_NULL: break;
-		case MEMMAP_DIRECT: RAM[address] = value; break;
+		case MEMMAP_DIRECT:
+			RAM[address]              = value;
+			Dirty_pages[address >> 8] = 1;
+			break;
 		case MEMMAP_RAMBANK: real_ram_write(address, value); break;
 		case MEMMAP_ROMBANK: /* Lelz you can't do that. */ break;
 		case MEMMAP_IO: real_write<memory_map_io, 0>(address, value); break;
@@ -365,9 +440,12 @@ uint8_t debug_read6502(uint16_t address, uint8_t bank)
 uint8_t read6502(uint16_t address)
 {
 	uint8_t value = real_read<memory_map_hi, 1>(address);
-#if defined(TRACE)
-	printf("%04X -> %02X\n", address, value);
-#endif
+	if (Trace_accesses) {
+		trace_access(address, value, false);
+	}
+	if (Watch_pages[address >> 8] & WATCH_READ) {
+		debugger_watch_cpu(address, memory_get_current_bank(address), WATCH_READ, value, value);
+	}
 	return value;
 }
 
@@ -378,9 +456,16 @@ void debug_write6502(uint16_t address, uint8_t bank, uint8_t value)
 
 void write6502(uint16_t address, uint8_t value)
 {
-#if defined(TRACE)
-	printf("%02X -> %04X\n", value, address);
-#endif
+	if (Trace_accesses) {
+		trace_access(address, value, true);
+	}
+	if (Watch_pages[address >> 8] & (WATCH_WRITE | WATCH_CHANGE)) {
+		const uint8_t bank      = memory_get_current_bank(address);
+		const uint8_t old_value = debug_read6502(address, bank);
+		real_write<memory_map_hi, 1>(address, value);
+		debugger_watch_cpu(address, bank, WATCH_WRITE, old_value, value);
+		return;
+	}
 	real_write<memory_map_hi, 1>(address, value);
 }
 
@@ -404,7 +489,8 @@ void memory_save(SDL_RWops *f, bool dump_ram, bool dump_bank)
 
 void memory_set_ram_bank(uint8_t bank)
 {
-	RAM_BANK = bank & (NUM_MAX_RAM_BANKS - 1);
+	RAM_BANK       = bank & (NUM_MAX_RAM_BANKS - 1);
+	Dirty_pages[0] = 1;
 }
 
 uint8_t memory_get_ram_bank()
@@ -412,9 +498,49 @@ uint8_t memory_get_ram_bank()
 	return RAM_BANK;
 }
 
+// How many of the bytes from the banked address on come before a page watched for
+// writes. The address runs on into the next bank at $C000.
+static uint32_t unwatched_bytes(uint16_t address, uint32_t size)
+{
+	uint32_t n = 0;
+	while (n < size && !(Watch_pages[(0xa000 + ((address - 0xa000 + n) & 0x1fff)) >> 8] & (WATCH_WRITE | WATCH_CHANGE))) {
+		n += 0x100 - ((address + n) & 0xff);
+	}
+	return std::min(n, size);
+}
+
+void memory_write_banked_range(uint8_t &bank, uint16_t &address, const uint8_t *src, uint32_t size)
+{
+	while (size > 0) {
+		// The banks follow each other in RAM, so one copy can run on until
+		// the bank number wraps around to the first bank.
+		const uint32_t offset = ((uint32_t)(bank % Options.num_ram_banks) << 13) + address;
+		uint32_t       n      = unwatched_bytes(address, std::min(size, RAM_SIZE - offset));
+		if (n == 0) {
+			// Watched pages go through the watchpoints a byte at a time.
+			const uint8_t old_value = RAM[offset];
+			RAM[offset]             = *src;
+			memory_mark_dirty(offset, 1);
+			debugger_watch_cpu(address, bank, WATCH_WRITE, old_value, *src);
+			n = 1;
+		} else {
+			memcpy(RAM + offset, src, n);
+			memory_mark_dirty(offset, n);
+		}
+		src += n;
+		size -= n;
+
+		const uint32_t bank_offset = address - 0xa000 + n;
+
+		bank    = (uint8_t)(bank + (bank_offset >> 13));
+		address = (uint16_t)(0xa000 + (bank_offset & 0x1fff));
+	}
+}
+
 void memory_set_rom_bank(uint8_t bank)
 {
-	ROM_BANK = bank & (NUM_ROM_BANKS - 1);
+	ROM_BANK       = bank & (NUM_ROM_BANKS - 1);
+	Dirty_pages[0] = 1;
 }
 
 uint8_t memory_get_rom_bank()
@@ -10,9 +10,30 @@
 #include <stdint.h>
 #include <stdio.h>
 
+class state_stream;
+
 void memory_init();
 void memory_reset();
 
+// Use the ROM image in place instead of copying it. Pages are only read in as
+// the CPU touches them. Fails if the file can't be mapped or is too short.
+bool memory_map_rom(const char *path);
+
+void memory_save_restore(state_stream &state);
+
+// One flag per 256-byte page of RAM, set whenever the page is written to. Whoever
+// looks at the flags clears them. Code writing to RAM directly must call
+// memory_mark_dirty().
+uint8_t *memory_get_dirty_pages();
+void     memory_mark_dirty(uint32_t offset, uint32_t size);
+
+// One set of watch_flags (see debugger.h) per 256-byte page of the CPU's address space.
+// Accesses to pages with no flags set don't go near the debugger.
+uint8_t *memory_get_watch_pages();
+
+// Have every CPU access reported to trace_access() (see trace.h).
+void memory_trace_accesses(bool enable);
+
 uint8_t debug_read6502(uint16_t address);
 uint8_t debug_read6502(uint16_t address, uint8_t bank);
 uint8_t read6502(uint16_t address);
@@ -27,6 +48,10 @@ void memory_set_rom_bank(uint8_t bank);
 uint8_t memory_get_ram_bank();
 uint8_t memory_get_rom_bank();
 
+// Copy into banked RAM starting at bank:address ($A000-$BFFF), continuing into the
+// following banks. Leaves bank:address pointing past the last byte written.
+void memory_write_banked_range(uint8_t &bank, uint16_t &address, const uint8_t *src, uint32_t size);
+
 uint8_t memory_get_current_bank(uint16_t address);
 
 #endif
@@ -0,0 +1,452 @@
+#include "movie.h"
+
+#include <SDL.h>
+#include <algorithm>
+#include <deque>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "cpu/fake6502.h"
+#include "debugger.h"
+#include "fnv1a.h"
+#include "glue.h"
+#include "joystick.h"
+#include "mapped_file.h"
+#include "memory.h"
+#include "ps2.h"
+#include "rewind.h"
+#include "state.h"
+
+// A movie file is
+//   movie_header
+//   the machine state to start from, state_size bytes (see state.h)
+//   events, each:  clocks since the previous event (varint), type, then
+//     ps2:         port, byte
+//     joystick:    port, buttons (uint32_t, little endian)
+//     ram:         offset (varint), size (varint), bytes
+//     reset, nmi, end: nothing
+// Varints hold 7 bits per byte, least significant first, with bit 7 set if more follow.
+//
+// Whether recording or not, input is also kept in memory as long as the rewind buffer
+// has frames from before it.
+
+enum class movie_event : uint8_t {
+	end,
+	ps2,
+	joystick,
+	ram,
+	reset,
+	nmi,
+};
+
+static constexpr uint32_t Movie_version  = 1;
+static constexpr char     Movie_magic[4] = { 'B', '1', '6', 'M' };
+static constexpr size_t   Flush_size     = 64 * 1024;
+
+struct movie_header {
+	char     magic[4];
+	uint32_t version;
+	uint64_t rom_hash; // replaying with another ROM is allowed, but unlikely to work
+	uint32_t state_size;
+	uint32_t reserved;
+};
+
+struct input_event {
+	uint64_t             clock;
+	movie_event          type;
+	uint8_t              port;
+	uint32_t             value; // PS/2 byte, buttons or RAM offset
+	std::vector<uint8_t> bytes; // RAM contents
+};
+
+static char     Movie_path[PATH_MAX];
+static uint64_t Last_clock = 0;
+
+static SDL_RWops           *Record_file = nullptr;
+static std::vector<uint8_t> Record_buffer;
+
+static mapped_file    Replay_file;
+static const uint8_t *Replay_pos = nullptr;
+static const uint8_t *Replay_end = nullptr;
+static input_event    Next_event;
+
+static std::deque<input_event> History;
+static uint64_t                History_start     = 0; // position of History.front()
+static uint64_t                History_replay    = 0; // position of the next event to feed again
+static bool                    Replaying_history = false;
+
+static uint64_t rom_hash()
+{
+	return fnv1a(Fnv1a_offset_basis, ROM, ROM_SIZE);
+}
+
+static void put_varint(uint64_t value)
+{
+	while (value >= 0x80) {
+		Record_buffer.push_back((uint8_t)(value | 0x80));
+		value >>= 7;
+	}
+	Record_buffer.push_back((uint8_t)value);
+}
+
+static bool get_varint(uint64_t &value)
+{
+	value = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		if (Replay_pos == Replay_end) {
+			return false;
+		}
+		const uint8_t byte = *Replay_pos++;
+		value |= (uint64_t)(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void flush_record()
+{
+	if (Record_buffer.empty()) {
+		return;
+	}
+	if (SDL_RWwrite(Record_file, Record_buffer.data(), Record_buffer.size(), 1) != 1) {
+		printf("Cannot write to %s! Stopped recording.\n", Movie_path);
+		SDL_RWclose(Record_file);
+		Record_file = nullptr;
+	}
+	Record_buffer.clear();
+}
+
+static void write_event(const input_event &event)
+{
+	put_varint(event.clock - Last_clock);
+	Last_clock = event.clock;
+	Record_buffer.push_back((uint8_t)event.type);
+
+	switch (event.type) {
+		case movie_event::ps2:
+			Record_buffer.push_back(event.port);
+			Record_buffer.push_back((uint8_t)event.value);
+			break;
+		case movie_event::joystick:
+			Record_buffer.push_back(event.port);
+			Record_buffer.insert(Record_buffer.end(), (const uint8_t *)&event.value, (const uint8_t *)(&event.value + 1));
+			break;
+		case movie_event::ram:
+			put_varint(event.value);
+			put_varint(event.bytes.size());
+			Record_buffer.insert(Record_buffer.end(), event.bytes.begin(), event.bytes.end());
+			break;
+		default:
+			break;
+	}
+
+	if (Record_buffer.size() >= Flush_size) {
+		flush_record();
+	}
+}
+
+static bool read_event(input_event &event)
+{
+	uint64_t delta;
+	if (!get_varint(delta) || Replay_pos == Replay_end) {
+		return false;
+	}
+	event.clock += delta;
+	event.type = (movie_event)*Replay_pos++;
+
+	switch (event.type) {
+		case movie_event::ps2:
+			if (Replay_end - Replay_pos < 2 || Replay_pos[0] > 1) {
+				return false;
+			}
+			event.port  = Replay_pos[0];
+			event.value = Replay_pos[1];
+			Replay_pos += 2;
+			return true;
+
+		case movie_event::joystick:
+			if (Replay_end - Replay_pos < 1 + (ptrdiff_t)sizeof(event.value) || Replay_pos[0] >= NUM_JOYSTICKS) {
+				return false;
+			}
+			event.port = Replay_pos[0];
+			memcpy(&event.value, Replay_pos + 1, sizeof(event.value));
+			Replay_pos += 1 + sizeof(event.value);
+			return true;
+
+		case movie_event::ram: {
+			uint64_t offset;
+			uint64_t size;
+			if (!get_varint(offset) || !get_varint(size) || offset > RAM_SIZE || size > RAM_SIZE - offset || size > (uint64_t)(Replay_end - Replay_pos)) {
+				return false;
+			}
+			event.value = (uint32_t)offset;
+			event.bytes.assign(Replay_pos, Replay_pos + size);
+			Replay_pos += size;
+			return true;
+		}
+
+		case movie_event::reset:
+		case movie_event::nmi:
+		case movie_event::end:
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+static void apply_event(const input_event &event)
+{
+	switch (event.type) {
+		case movie_event::ps2:
+			ps2_buffer_replay(event.port, (uint8_t)event.value);
+			break;
+		case movie_event::joystick:
+			joystick_replay_port_buttons(event.port, event.value);
+			break;
+		case movie_event::ram:
+			memcpy(RAM + event.value, event.bytes.data(), event.bytes.size());
+			memory_mark_dirty(event.value, (uint32_t)event.bytes.size());
+			break;
+		case movie_event::reset:
+			machine_reset();
+			break;
+		case movie_event::nmi:
+			nmi6502();
+			debugger_interrupt();
+			break;
+		default:
+			break;
+	}
+}
+
+static void keep_history(const input_event &event)
+{
+	// Nothing to go back to yet.
+	if (rewind_num_frames() > 0) {
+		History.push_back(event);
+	}
+}
+
+static void record(input_event &&event)
+{
+	if (Record_file != nullptr) {
+		write_event(event);
+	}
+	keep_history(event);
+}
+
+bool movie_record_start(const char *path)
+{
+	movie_stop();
+
+	SDL_RWops *f = SDL_RWFromFile(path, "wb");
+	if (f == nullptr) {
+		printf("Cannot write to %s!\n", path);
+		return false;
+	}
+
+	std::vector<uint8_t> state;
+	machine_save_state(state);
+
+	movie_header header;
+	memcpy(header.magic, Movie_magic, sizeof(header.magic));
+	header.version    = Movie_version;
+	header.rom_hash   = rom_hash();
+	header.state_size = (uint32_t)state.size();
+	header.reserved   = 0;
+
+	Record_buffer.clear();
+	Record_buffer.insert(Record_buffer.end(), (const uint8_t *)&header, (const uint8_t *)(&header + 1));
+	Record_buffer.insert(Record_buffer.end(), state.begin(), state.end());
+
+	Record_file = f;
+	Last_clock  = clockticks6502;
+	snprintf(Movie_path, sizeof(Movie_path), "%s", path);
+
+	// What the controller ports show isn't part of the machine state.
+	for (int i = 0; i < NUM_JOYSTICKS; ++i) {
+		write_event(input_event{ clockticks6502, movie_event::joystick, (uint8_t)i, joystick_get_port_buttons(i), {} });
+	}
+	flush_record();
+
+	if (Record_file == nullptr) {
+		return false;
+	}
+	printf("Recording movie to %s.\n", path);
+	return true;
+}
+
+bool movie_replay_start(const char *path)
+{
+	movie_stop();
+
+	if (!Replay_file.open(path, false)) {
+		printf("Cannot open %s!\n", path);
+		return false;
+	}
+
+	movie_header header;
+	if (Replay_file.size() < sizeof(header)) {
+		printf("%s is not a movie, or truncated.\n", path);
+		Replay_file.close();
+		return false;
+	}
+	memcpy(&header, Replay_file.data(), sizeof(header));
+
+	if (memcmp(header.magic, Movie_magic, sizeof(header.magic)) != 0 || Replay_file.size() - sizeof(header) < header.state_size) {
+		printf("%s is not a movie, or truncated.\n", path);
+		Replay_file.close();
+		return false;
+	}
+	if (header.version != Movie_version) {
+		printf("Movie version %u is not supported (expected %u).\n", header.version, Movie_version);
+		Replay_file.close();
+		return false;
+	}
+	if (header.rom_hash != rom_hash()) {
+		printf("Warning: %s was recorded with a different ROM.\n", path);
+	}
+
+	const uint8_t *state = Replay_file.data() + sizeof(header);
+	if (!machine_load_state(state, header.state_size)) {
+		printf("Cannot load the machine state from %s.\n", path);
+		Replay_file.close();
+		return false;
+	}
+	// The rewind buffer's history doesn't lead up to the movie.
+	rewind_clear();
+
+	Replay_pos       = state + header.state_size;
+	Replay_end       = Replay_file.data() + Replay_file.size();
+	Next_event.clock = clockticks6502;
+	snprintf(Movie_path, sizeof(Movie_path), "%s", path);
+
+	if (!read_event(Next_event)) {
+		printf("%s is not a movie, or truncated.\n", path);
+		movie_stop();
+		return false;
+	}
+	printf("Playing movie %s.\n", path);
+	return true;
+}
+
+void movie_stop()
+{
+	if (Record_file != nullptr) {
+		write_event(input_event{ clockticks6502, movie_event::end, 0, 0, {} });
+		flush_record();
+		if (Record_file != nullptr) {
+			SDL_RWclose(Record_file);
+			Record_file = nullptr;
+			printf("Saved movie to %s.\n", Movie_path);
+		}
+	}
+
+	if (Replay_pos != nullptr) {
+		Replay_file.close();
+		Replay_pos = nullptr;
+		Replay_end = nullptr;
+	}
+}
+
+bool movie_is_recording()
+{
+	return Record_file != nullptr;
+}
+
+bool movie_is_replaying()
+{
+	return Replay_pos != nullptr || Replaying_history;
+}
+
+void movie_replay_step()
+{
+	while (Replaying_history) {
+		const uint64_t index = History_replay - History_start;
+		if (index >= History.size()) {
+			// Caught up, the host takes over again.
+			Replaying_history = false;
+			break;
+		}
+		if (History[index].clock > clockticks6502) {
+			break;
+		}
+		++History_replay;
+		apply_event(History[index]);
+	}
+
+	while (Replay_pos != nullptr && Next_event.clock <= clockticks6502) {
+		if (Next_event.type == movie_event::end) {
+			printf("Movie %s has ended.\n", Movie_path);
+			movie_stop();
+			break;
+		}
+		apply_event(Next_event);
+		keep_history(Next_event);
+		if (!read_event(Next_event)) {
+			printf("Movie %s is damaged, stopped playing it.\n", Movie_path);
+			movie_stop();
+		}
+	}
+}
+
+void movie_record_ps2(int port, uint8_t byte)
+{
+	record(input_event{ clockticks6502, movie_event::ps2, (uint8_t)port, byte, {} });
+}
+
+void movie_record_joystick(int port, uint32_t buttons)
+{
+	record(input_event{ clockticks6502, movie_event::joystick, (uint8_t)port, buttons, {} });
+}
+
+void movie_record_ram(uint32_t offset, uint32_t size)
+{
+	record(input_event{ clockticks6502, movie_event::ram, 0, offset, std::vector<uint8_t>(RAM + offset, RAM + offset + size) });
+}
+
+void movie_record_reset()
+{
+	record(input_event{ clockticks6502, movie_event::reset, 0, 0, {} });
+}
+
+void movie_record_nmi()
+{
+	record(input_event{ clockticks6502, movie_event::nmi, 0, 0, {} });
+}
+
+uint64_t movie_history_position()
+{
+	return Replaying_history ? History_replay : History_start + History.size();
+}
+
+void movie_history_replay(uint64_t position)
+{
+	History_replay    = std::max(position, History_start);
+	Replaying_history = History_replay < History_start + History.size();
+}
+
+void movie_history_truncate(uint64_t position)
+{
+	if (position < History_start + History.size()) {
+		History.resize(position > History_start ? (size_t)(position - History_start) : 0);
+	}
+	Replaying_history = false;
+}
+
+void movie_history_forget(uint64_t position)
+{
+	// What is still being fed again stays.
+	if (Replaying_history) {
+		position = std::min(position, History_replay);
+	}
+	while (History_start < position && !History.empty()) {
+		History.pop_front();
+		++History_start;
+	}
+}
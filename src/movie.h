@@ -0,0 +1,51 @@
+#pragma once
+#if !defined(MOVIE_H)
+#	define MOVIE_H
+
+#	include <stdint.h>
+
+// A movie is a snapshot of the machine followed by every input the machine got
+// afterwards, stamped with the CPU clock it arrived at. Starting from the snapshot
+// and feeding the same input at the same clocks replays the session exactly, since
+// nothing else from the host reaches the machine: its randomness comes from noise.h
+// and the RTC is part of the snapshot. Files read from the SD card or through
+// hypercalls are read again, so they must not have changed.
+
+bool movie_record_start(const char *path);
+bool movie_replay_start(const char *path);
+
+// Finishes the recording, or abandons the replay.
+void movie_stop();
+
+bool movie_is_recording();
+bool movie_is_replaying();
+
+// Call between instructions. Feeds the input that is due.
+void movie_replay_step();
+
+// Called wherever input reaches the machine. Nothing happens unless recording.
+void movie_record_ps2(int port, uint8_t byte);
+void movie_record_joystick(int port, uint32_t buttons);
+void movie_record_ram(uint32_t offset, uint32_t size); // for text typed straight into the keyboard buffer and such
+void movie_record_reset();
+void movie_record_nmi();
+
+// Input is also kept in memory, numbered in the order it arrived, for as long as the
+// rewind buffer has frames from before it. That way the machine can be taken back to a
+// frame and run on along the same path it took before (see rewind.h).
+
+// Where the input so far ends, or while it's being fed again, how far that got.
+uint64_t movie_history_position();
+
+// Feeds the input from the position on again as its clocks come up. Host input is
+// ignored until it runs out.
+void movie_history_replay(uint64_t position);
+
+// Forgets the input from the position on, since the machine went back to before it
+// and will take a different path.
+void movie_history_truncate(uint64_t position);
+
+// Forgets the input from before the position.
+void movie_history_forget(uint64_t position);
+
+#endif
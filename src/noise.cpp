@@ -0,0 +1,24 @@
+#include "noise.h"
+
+#include "state.h"
+
+static uint32_t Noise_state = 1;
+
+void noise_seed(uint32_t seed)
+{
+	// xorshift never leaves 0.
+	Noise_state = seed != 0 ? seed : 1;
+}
+
+uint8_t noise_byte()
+{
+	Noise_state ^= Noise_state << 13;
+	Noise_state ^= Noise_state >> 17;
+	Noise_state ^= Noise_state << 5;
+	return (uint8_t)(Noise_state >> 24);
+}
+
+void noise_save_restore(state_stream &state)
+{
+	state.field(Noise_state);
+}
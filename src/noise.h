@@ -0,0 +1,17 @@
+#pragma once
+#if !defined(NOISE_H)
+#	define NOISE_H
+
+#	include <stdint.h>
+
+class state_stream;
+
+// Stands in for what the real machine leaves to chance, like VRAM contents at
+// power-on or the VIA timers that aren't emulated yet. Unlike rand(), its state
+// is part of the machine state, so replays and rewinds see the same values again.
+
+void    noise_seed(uint32_t seed);
+uint8_t noise_byte();
+void    noise_save_restore(state_stream &state);
+
+#endif
@@ -0,0 +1,165 @@
+#include "offline_render.h"
+
+#include "audio.h"
+#include "glue.h"
+#include "sound_recorder.h"
+#include "wav_recorder.h"
+#include "ym2151/ym2151.h"
+
+static constexpr int Song_end_silence_seconds   = 3;
+static constexpr int Song_start_timeout_seconds = 60;
+static constexpr int Replay_tail_seconds        = 10;
+static constexpr int Replay_step_clocks         = 8000;
+
+static bool Render_enabled  = false;
+static bool Render_finished = false;
+static bool Signal_started  = false;
+
+static uint64_t Render_max_samples = 0; // 0 = stop at the end of the song
+static uint64_t Samples_rendered   = 0; // counted from the first non-silent sample
+static uint64_t Samples_waited     = 0; // silence before the song started
+static uint64_t Silent_samples     = 0; // silence not yet written to the file
+
+static void flush_silence()
+{
+	wav_recorder_add_silence(static_cast<int>(Silent_samples));
+	Silent_samples = 0;
+}
+
+static void finish(const char *reason)
+{
+	if (Render_finished) {
+		return;
+	}
+
+	Render_finished = true;
+	printf("Offline render finished after %.2f seconds: %s\n", static_cast<double>(Samples_rendered) / audio_get_sample_rate(), reason);
+}
+
+void offline_render_set_path(const char *path)
+{
+	char wav_path[PATH_MAX];
+	snprintf(wav_path, PATH_MAX, "%s", path);
+	wav_path[PATH_MAX - 1] = '\0';
+
+	char *comma = strrchr(wav_path, ',');
+	if (comma != nullptr) {
+		char *      end     = nullptr;
+		const float seconds = strtof(comma + 1, &end);
+		if (end != comma + 1 && *end == '\0' && seconds > 0.0f) {
+			Render_max_samples = static_cast<uint64_t>(seconds * SAMPLERATE);
+			*comma             = '\0';
+		}
+	}
+
+	// Start paused; recording begins once the first non-silent buffer arrives.
+	strcat(wav_path, ",wait");
+	wav_recorder_set_path(wav_path);
+
+	Render_enabled   = true;
+	Render_finished  = false;
+	Signal_started   = false;
+	Samples_rendered = 0;
+	Samples_waited   = 0;
+	Silent_samples   = 0;
+}
+
+bool offline_render_is_enabled()
+{
+	return Render_enabled;
+}
+
+bool offline_render_is_finished()
+{
+	return Render_finished;
+}
+
+void offline_render_process(const int16_t *samples, const int num_samples)
+{
+	if (!Render_enabled || Render_finished) {
+		return;
+	}
+
+	bool silent = true;
+	for (int i = 0; i < 2 * num_samples; ++i) {
+		if (samples[i] != 0) {
+			silent = false;
+			break;
+		}
+	}
+
+	const uint64_t sample_rate = audio_get_sample_rate();
+
+	if (!Signal_started) {
+		if (silent) {
+			Samples_waited += num_samples;
+			if (Samples_waited >= Song_start_timeout_seconds * sample_rate) {
+				finish("no audio was produced");
+			}
+			return;
+		}
+		Signal_started = true;
+		wav_recorder_set(RECORD_WAV_RECORD);
+	}
+
+	if (Render_max_samples > 0 && Samples_rendered + num_samples > Render_max_samples) {
+		const int remaining = static_cast<int>(Render_max_samples - Samples_rendered);
+		flush_silence();
+		wav_recorder_process(samples, remaining);
+		Samples_rendered += remaining;
+		finish("reached requested length");
+		return;
+	}
+
+	// Hold back silence so that a song's trailing silence is not written out;
+	// it is only emitted once more audio follows it.
+	Samples_rendered += num_samples;
+	if (silent) {
+		Silent_samples += num_samples;
+		if (Render_max_samples == 0 && Silent_samples >= Song_end_silence_seconds * sample_rate) {
+			Samples_rendered -= Silent_samples;
+			finish("end of song");
+		}
+	} else {
+		flush_silence();
+		wav_recorder_process(samples, num_samples);
+	}
+}
+
+static void render_clocks(int clocks)
+{
+	while (clocks > 0 && !Render_finished) {
+		const int step = clocks < Replay_step_clocks ? clocks : Replay_step_clocks;
+		audio_render(step);
+		clocks -= step;
+	}
+}
+
+bool offline_render_replay(const char *log_path)
+{
+	if (!sound_recorder_replay_open(log_path)) {
+		return false;
+	}
+
+	// The log only holds writes the chip accepted, and the initial state dump is
+	// written all at once, so busy-flag enforcement would only drop writes here.
+	YM_set_strict_busy(false);
+
+	int clocks;
+	while (!Render_finished && (clocks = sound_recorder_replay_step()) >= 0) {
+		render_clocks(clocks);
+	}
+	sound_recorder_replay_close();
+
+	// Let the last notes ring out. Without a fixed length, a note that is never
+	// released would keep us going forever, so cap how long we wait for silence.
+	if (Render_max_samples > 0) {
+		while (!Render_finished) {
+			render_clocks(Replay_step_clocks);
+		}
+	} else {
+		render_clocks(Replay_tail_seconds * MHZ * 1000000);
+		finish("end of sound log");
+	}
+	return true;
+}
@@ -0,0 +1,17 @@
+#pragma once
+#if !defined(OFFLINE_RENDER_H)
+#	define OFFLINE_RENDER_H
+
+// Headless, faster-than-realtime rendering of the machine's audio output to a WAV file.
+// The path may be suffixed with ,<seconds> to render a fixed length instead of stopping
+// at the end of the song (detected as a stretch of silence after the audio first starts).
+
+void offline_render_set_path(const char *path);
+bool offline_render_is_enabled();
+bool offline_render_is_finished();
+void offline_render_process(const int16_t *samples, const int num_samples);
+
+// Drive the sound chips from a captured sound log instead of running the CPU.
+bool offline_render_replay(const char *log_path);
+
+#endif
@@ -33,9 +33,16 @@ static void usage()
 	printf("\tInject a BASIC program in ASCII encoding through the\n");
 	printf("\tkeyboard.\n");
 
+	printf("-dcfilter\n");
+	printf("\tRemove DC offset from the mixed audio output.\n");
+
 	printf("-debug <address>\n");
 	printf("\tSet a breakpoint in the debugger\n");
 
+	printf("-decodetrace <file.b16t>\n");
+	printf("\tPrint a trace made with -trace as text, one instruction per line,\n");
+	printf("\twith labels from the -sym and -stds symbol files, then exit.\n");
+
 	printf("-dump {C|R|B|V}...\n");
 	printf("\tConfigure system dump: (C)PU, (R)AM, (B)anked-RAM, (V)RAM\n");
 	printf("\tMultiple characters are possible, e.g. -dump CV ; Default: RB\n");
@@ -62,6 +69,11 @@ static void usage()
 	printf("-help\n");
 	printf("\tPrint this message and exit.\n");
 
+	printf("-instantboot\n");
+	printf("\tCache the machine state from when BASIC is first ready next to box16.ini,\n");
+	printf("\tand start from it instead of a reset when the ROM, NVRAM and machine options\n");
+	printf("\tmatch. The ROM is used in place instead of being copied. Not used with -sdcard.\n");
+
 	printf("-keymap <keymap>\n");
 	printf("\tEnable a specific keyboard layout decode table.\n");
 
@@ -72,6 +84,14 @@ static void usage()
 	printf("-nobinds\n");
 	printf("\tDisable most emulator keyboard shortcuts.\n");
 
+	printf("-nofastspi\n");
+	printf("\tFeed SD card data to VERA's SPI controller one byte at a time,\n");
+	printf("\tinstead of a whole block at once. The 6502 sees the same timing either way.\n");
+
+	printf("-movie <file.b16m>\n");
+	printf("\tRecord all input to a movie file, starting from a snapshot of the\n");
+	printf("\tmachine, so that -playmovie can replay the session exactly.\n");
+
 	printf("-nosound\n");
 	printf("\tDisables audio. Incompatible with -sound.\n");
 
@@ -79,11 +99,27 @@ static void usage()
 	printf("\tSpecify NVRAM image. By default, the machine starts with\n");
 	printf("\tempty NVRAM and does not save it to disk.\n");
 
+	printf("-pcmvolume <percent>\n");
+	printf("\tSet the mixer volume of VERA's PCM channel (0-200). Default: 100\n");
+
+	printf("-playlog <file.vgm>\n");
+	printf("\tWith -render, play back a sound log captured with -soundlog\n");
+	printf("\tthrough the sound chips instead of running a program.\n");
+
+	printf("-playmovie <file.b16m>\n");
+	printf("\tReplay a movie recorded with -movie. Host input is ignored until it\n");
+	printf("\tends. With -render, runs to its end, then exits. Files read through the SD card\n");
+	printf("\tor hypercalls must not have changed since the recording; -sdoverlay mem\n");
+	printf("\tkeeps the card as it was.\n");
+
 	printf("-prg <app.prg>[,<load_addr>]\n");
 	printf("\tLoad application from the local disk into RAM\n");
 	printf("\t(.PRG file with 2 byte start address header)\n");
 	printf("\tThe override load address is hex without a prefix.\n");
 
+	printf("-psgvolume <percent>\n");
+	printf("\tSet the mixer volume of VERA's PSG (0-200). Default: 100\n");
+
 	printf("-quality {nearest|linear|best}\n");
 	printf("\tScaling algorithm quality\n");
 
@@ -91,6 +127,16 @@ static void usage()
 	printf("\tSpecify banked RAM size in KB (8, 16, 32, ..., 2048).\n");
 	printf("\tThe default is 512.\n");
 
+	printf("-render <file.wav>[,<seconds>]\n");
+	printf("\tRun headless in warp mode with no audio device, rendering the\n");
+	printf("\taudio output to a wav, then exit. Leading silence is skipped.\n");
+	printf("\tBy default, rendering ends after 3 seconds of silence;\n");
+	printf("\tuse ,<seconds> to render a fixed length instead.\n");
+
+	printf("-rewind <seconds>\n");
+	printf("\tKeep a snapshot of every frame for the last <seconds> of\n");
+	printf("\temulation. Ctrl-Backspace goes back a few frames at a time.\n");
+
 	printf("-rom <rom.bin>\n");
 	printf("\tOverride KERNAL/BASIC/* ROM file.\n");
 
@@ -101,15 +147,47 @@ static void usage()
 	printf("\tStart the -prg/-bas program using RUN or SYS, depending\n");
 	printf("\ton the load address.\n");
 
+	printf("-runahead <frames>\n");
+	printf("\tHide up to <frames> frames of a game's own input lag by running\n");
+	printf("\tahead before every frame is shown and rolling back afterwards.\n");
+	printf("\tEmulates that many extra frames per frame, so keep it small.\n");
+
 	printf("-scale {1|2|3|4}\n");
 	printf("\tScale output to an integer multiple of 640x480\n");
 
 	printf("-sdcard <sdcard.img>\n");
 	printf("\tSpecify SD card image (partition map + FAT32)\n");
+	printf("\tor a host directory, which is presented as a FAT32 card. Files written\n");
+	printf("\tby the X16 are copied back to the directory when the card is detached.\n");
+
+	printf("-sdcommit\n");
+	printf("\tWith -sdoverlay, write the changes back to the SD card image on exit\n");
+	printf("\tinstead of discarding them.\n");
+
+	printf("-sdoverlay {mem|<overlay file>}\n");
+	printf("\tOpen the SD card image read-only, and keep writes to it in memory\n");
+	printf("\tor in a sparse overlay file instead. The overlay file is recreated on\n");
+	printf("\tstart and deleted on exit. Lets many instances share one image.\n");
+
+	printf("-sdsync {exit|async|sync}\n");
+	printf("\tWhen writes to the SD card image are flushed to disk:\n");
+	printf("\texit: when the card is detached or the emulator exits (default).\n");
+	printf("\tasync: start writing back after every block written.\n");
+	printf("\tsync: wait for every block written to reach the disk.\n");
 	
 	printf("-sound <output device>\n");
 	printf("\tSet the output device used for audio emulation. Incompatible with -nosound.\n");
 
+	printf("-soundlog <file.vgm>[,wait]\n");
+	printf("\tRecord all YM2151, PSG and PCM register writes to a VGM file.\n");
+	printf("\tUse ,wait to start paused.\n");
+	printf("\tPOKE $9FB7,1 to start recording.\n");
+	printf("\tPOKE $9FB7,0 to stop.\n");
+
+	printf("-state <file.state>\n");
+	printf("\tStart from a machine state saved with Machine > Save State.\n");
+	printf("\tThe SD card's contents aren't part of the state.\n");
+
 	printf("-stds\n");
 	printf("\tLoad standard (ROM) symbol files\n");
 
@@ -119,9 +197,22 @@ static void usage()
 	printf("-test {0, 1, 2, 3}\n");
 	printf("\tImmediately invoke the TEST command with the provided test number.\n");
 
+	printf("-trace <file.b16t>\n");
+	printf("\tRecord every instruction executed from boot, with its registers and\n");
+	printf("\tmemory accesses, to a binary trace. Use -decodetrace to read it.\n");
+
 	printf("-version\n");
 	printf("\tPrint additional version information the emulator and ROM.\n");
 
+	printf("-video <file>[,wait]\n");
+	printf("\tRecord the video output at the full frame rate.\n");
+	printf("\t<file.y4m> writes a YUV4MPEG2 stream, <file.png> a numbered PNG sequence,\n");
+	printf("\t|<command> pipes a YUV4MPEG2 stream to a program, anything else raw RGB24 frames.\n");
+	printf("\tAudio is recorded alongside, to the -wav path or <file>.wav.\n");
+	printf("\tUse ,wait to start paused.\n");
+	printf("\tPOKE $9FBC,1 to start recording.\n");
+	printf("\tPOKE $9FBC,0 to pause.\n");
+
 	printf("-warp\n");
 	printf("\tEnable warp mode, run emulator as fast as possible.\n");
 	
@@ -132,12 +223,22 @@ static void usage()
 	printf("\tPOKE $9FB5,2 to start recording.\n");
 	printf("\tPOKE $9FB5,1 to capture a single frame.\n");
 	printf("\tPOKE $9FB5,0 to pause.\n");
+
+	printf("-wavfloat\n");
+	printf("\tRecord wavs as 32-bit float instead of 16-bit PCM.\n");
+
+	printf("-wavtracks\n");
+	printf("\tAlso record the unmixed YM2151, PSG and PCM output when recording a wav,\n");
+	printf("\tas <name>-ym.wav, <name>-psg.wav and <name>-pcm.wav.\n");
 	
 	printf("-ymirq\n");
 	printf("\tEnable the YM2151's IRQ generation.\n");
 	
 	printf("-ymstrict\n");
 	printf("\tEnable strict enforcement of YM behaviors.\n");
+
+	printf("-ymvolume <percent>\n");
+	printf("\tSet the mixer volume of the YM2151 (0-200). Default: 100\n");
 	printf("\n");
 
 	exit(1);
@@ -210,6 +311,11 @@ static void parse_cmdline(mINI::INIStructure &ini, int argc, char **argv)
 
 			argc--;
 			argv++;
+		} else if (!strcmp(argv[0], "-dcfilter")) {
+			argc--;
+			argv++;
+			ini["main"]["dcfilter"] = "true";
+
 		} else if (!strcmp(argv[0], "-debug")) {
 			argc--;
 			argv++;
@@ -221,6 +327,17 @@ static void parse_cmdline(mINI::INIStructure &ini, int argc, char **argv)
 			uint32_t bp = strtol(argv[0], NULL, 16);
 			debugger_add_breakpoint((uint16_t)(bp & 0xfffF), (uint8_t)(bp >> 16));
 
+			argc--;
+			argv++;
+		} else if (!strcmp(argv[0], "-decodetrace")) {
+			argc--;
+			argv++;
+			if (!argc || argv[0][0] == '-') {
+				usage();
+			}
+
+			ini["main"]["decodetrace"] = argv[0];
+
 			argc--;
 			argv++;
 		} else if (!strcmp(argv[0], "-dump")) {
@@ -279,6 +396,11 @@ static void parse_cmdline(mINI::INIStructure &ini, int argc, char **argv)
 			argv++;
 
 			usage();
+		} else if (!strcmp(argv[0], "-instantboot")) {
+			argc--;
+			argv++;
+			ini["main"]["instantboot"] = "true";
+
 		} else if (!strcmp(argv[0], "-keymap")) {
 			argc--;
 			argv++;
@@ -299,6 +421,17 @@ static void parse_cmdline(mINI::INIStructure &ini, int argc, char **argv)
 
 			ini["main"]["log"] = argv[0];
 
+			argc--;
+			argv++;
+		} else if (!strcmp(argv[0], "-movie")) {
+			argc--;
+			argv++;
+			if (!argc || argv[0][0] == '-') {
+				usage();
+			}
+
+			ini["main"]["movie"] = argv[0];
+
 			argc--;
 			argv++;
 		} else if (!strcmp(argv[0], "-nobinds")) {
@@ -306,6 +439,11 @@ static void parse_cmdline(mINI::INIStructure &ini, int argc, char **argv)
 			argv++;
 			ini["main"]["nobinds"] = "true";
 
+		} else if (!strcmp(argv[0], "-nofastspi")) {
+			argc--;
+			argv++;
+			ini["main"]["nofastspi"] = "true";
+
 		} else if (!strcmp(argv[0], "-nosound")) {
 			argc--;
 			argv++;
@@ -319,6 +457,39 @@ static void parse_cmdline(mINI::INIStructure &ini, int argc, char **argv)
 				usage();
 			}
 			ini["main"]["nvram"] = argv[0];
+			argc--;
+			argv++;
+		} else if (!strcmp(argv[0], "-pcmvolume")) {
+			argc--;
+			argv++;
+			if (!argc || argv[0][0] == '-') {
+				usage();
+			}
+
+			ini["main"]["pcmvolume"] = argv[0];
+
+			argc--;
+			argv++;
+		} else if (!strcmp(argv[0], "-playlog")) {
+			argc--;
+			argv++;
+			if (!argc || argv[0][0] == '-') {
+				usage();
+			}
+
+			ini["main"]["playlog"] = argv[0];
+
+			argc--;
+			argv++;
+		} else if (!strcmp(argv[0], "-playmovie")) {
+			argc--;
+			argv++;
+			if (!argc || argv[0][0] == '-') {
+				usage();
+			}
+
+			ini["main"]["playmovie"] = argv[0];
+
 			argc--;
 			argv++;
 		} else if (!strcmp(argv[0], "-prg")) {
@@ -330,6 +501,17 @@ static void parse_cmdline(mINI::INIStructure &ini, int argc, char **argv)
 
 			ini["main"]["prg"] = argv[0];
 
+			argc--;
+			argv++;
+		} else if (!strcmp(argv[0], "-psgvolume")) {
+			argc--;
+			argv++;
+			if (!argc || argv[0][0] == '-') {
+				usage();
+			}
+
+			ini["main"]["psgvolume"] = argv[0];
+
 			argc--;
 			argv++;
 		} else if (!strcmp(argv[0], "-quality")) {
@@ -352,6 +534,28 @@ static void parse_cmdline(mINI::INIStructure &ini, int argc, char **argv)
 
 			ini["main"]["ram"] = argv[0];
 
+			argc--;
+			argv++;
+		} else if (!strcmp(argv[0], "-render")) {
+			argc--;
+			argv++;
+			if (!argc || argv[0][0] == '-') {
+				usage();
+			}
+
+			ini["main"]["render"] = argv[0];
+
+			argc--;
+			argv++;
+		} else if (!strcmp(argv[0], "-rewind")) {
+			argc--;
+			argv++;
+			if (!argc || argv[0][0] == '-') {
+				usage();
+			}
+
+			ini["main"]["rewind"] = argv[0];
+
 			argc--;
 			argv++;
 		} else if (!strcmp(argv[0], "-rom")) {
@@ -376,6 +580,17 @@ static void parse_cmdline(mINI::INIStructure &ini, int argc, char **argv)
 
 			ini["main"]["run"] = "true";
 
+		} else if (!strcmp(argv[0], "-runahead")) {
+			argc--;
+			argv++;
+			if (!argc || argv[0][0] == '-') {
+				usage();
+			}
+
+			ini["main"]["runahead"] = argv[0];
+
+			argc--;
+			argv++;
 		} else if (!strcmp(argv[0], "-scale")) {
 			argc--;
 			argv++;
@@ -396,6 +611,33 @@ static void parse_cmdline(mINI::INIStructure &ini, int argc, char **argv)
 
 			ini["main"]["sdcard"] = argv[0];
 
+			argc--;
+			argv++;
+		} else if (!strcmp(argv[0], "-sdcommit")) {
+			argc--;
+			argv++;
+			ini["main"]["sdcommit"] = "true";
+
+		} else if (!strcmp(argv[0], "-sdoverlay")) {
+			argc--;
+			argv++;
+			if (!argc || argv[0][0] == '-') {
+				usage();
+			}
+
+			ini["main"]["sdoverlay"] = argv[0];
+
+			argc--;
+			argv++;
+		} else if (!strcmp(argv[0], "-sdsync")) {
+			argc--;
+			argv++;
+			if (!argc || argv[0][0] == '-') {
+				usage();
+			}
+
+			ini["main"]["sdsync"] = argv[0];
+
 			argc--;
 			argv++;
 		} else if (!strcmp(argv[0], "-sound")) {
@@ -404,6 +646,28 @@ static void parse_cmdline(mINI::INIStructure &ini, int argc, char **argv)
 
 			ini["main"]["sound"] = argv[0];
 
+			argc--;
+			argv++;
+		} else if (!strcmp(argv[0], "-soundlog")) {
+			argc--;
+			argv++;
+			if (!argc || argv[0][0] == '-') {
+				usage();
+			}
+
+			ini["main"]["soundlog"] = argv[0];
+
+			argc--;
+			argv++;
+		} else if (!strcmp(argv[0], "-state")) {
+			argc--;
+			argv++;
+			if (!argc || argv[0][0] == '-') {
+				usage();
+			}
+
+			ini["main"]["state"] = argv[0];
+
 			argc--;
 			argv++;
 		} else if (!strcmp(argv[0], "-stds")) {
@@ -436,6 +700,17 @@ static void parse_cmdline(mINI::INIStructure &ini, int argc, char **argv)
 
 			ini["main"]["test"] = argv[0];
 
+			argc--;
+			argv++;
+		} else if (!strcmp(argv[0], "-trace")) {
+			argc--;
+			argv++;
+			if (!argc || argv[0][0] == '-') {
+				usage();
+			}
+
+			ini["main"]["trace"] = argv[0];
+
 			argc--;
 			argv++;
 		} else if (!strcmp(argv[0], "-version")) {
@@ -444,6 +719,17 @@ static void parse_cmdline(mINI::INIStructure &ini, int argc, char **argv)
 			argv++;
 			exit(0);
 
+		} else if (!strcmp(argv[0], "-video")) {
+			argc--;
+			argv++;
+			if (!argc || argv[0][0] == '-') {
+				usage();
+			}
+
+			ini["main"]["video"] = argv[0];
+
+			argv++;
+			argc--;
 		} else if (!strcmp(argv[0], "-warp")) {
 			argc--;
 			argv++;
@@ -461,6 +747,16 @@ static void parse_cmdline(mINI::INIStructure &ini, int argc, char **argv)
 
 			argv++;
 			argc--;
+		} else if (!strcmp(argv[0], "-wavfloat")) {
+			argc--;
+			argv++;
+			ini["main"]["wavfloat"] = "true";
+
+		} else if (!strcmp(argv[0], "-wavtracks")) {
+			argc--;
+			argv++;
+			ini["main"]["wavtracks"] = "true";
+
 		} else if (!strcmp(argv[0], "-ymirq")) {
 			argc--;
 			argv++;
@@ -471,6 +767,17 @@ static void parse_cmdline(mINI::INIStructure &ini, int argc, char **argv)
 			argv++;
 			ini["main"]["ymstrict"] = "true";
 
+		} else if (!strcmp(argv[0], "-ymvolume")) {
+			argc--;
+			argv++;
+			if (!argc || argv[0][0] == '-') {
+				usage();
+			}
+
+			ini["main"]["ymvolume"] = argv[0];
+
+			argc--;
+			argv++;
 		} else {
 			usage();
 		}
@@ -578,6 +885,29 @@ static void set_options(mINI::INIStructure &ini)
 		strcpy(Options.sdcard_path, ini["main"]["sdcard"].c_str());
 	}
 
+	if (ini["main"].has("sdoverlay")) {
+		strcpy(Options.sdcard_overlay, ini["main"]["sdoverlay"].c_str());
+	}
+
+	if (ini["main"].has("sdcommit")) {
+		if (!strcmp(ini["main"]["sdcommit"].c_str(), "true")) {
+			Options.sdcard_commit = true;
+		}
+	}
+
+	if (ini["main"].has("sdsync")) {
+		char const *sync = ini["main"]["sdsync"].c_str();
+		if (!strcmp(sync, "exit")) {
+			Options.sdcard_sync = sdcard_sync_t::EXIT;
+		} else if (!strcmp(sync, "async")) {
+			Options.sdcard_sync = sdcard_sync_t::ASYNC;
+		} else if (!strcmp(sync, "sync")) {
+			Options.sdcard_sync = sdcard_sync_t::SYNC;
+		} else {
+			usage();
+		}
+	}
+
 	if (ini["main"].has("warp")) {
 		if (!strcmp(ini["main"]["warp"].c_str(), "true")) {
 			Options.warp_factor = 1;
@@ -642,10 +972,58 @@ static void set_options(mINI::INIStructure &ini)
 		strcpy(Options.gif_path, ini["main"]["gif"].c_str());
 	}
 
+	if (ini["main"].has("video")) {
+		strcpy(Options.video_path, ini["main"]["video"].c_str());
+	}
+
 	if (ini["main"].has("wav")) {
 		strcpy(Options.wav_path, ini["main"]["wav"].c_str());
 	}
 
+	if (ini["main"].has("wavfloat")) {
+		if (!strcmp(ini["main"]["wavfloat"].c_str(), "true")) {
+			Options.wav_float = true;
+		}
+	}
+
+	if (ini["main"].has("wavtracks")) {
+		if (!strcmp(ini["main"]["wavtracks"].c_str(), "true")) {
+			Options.wav_multitrack = true;
+		}
+	}
+
+	if (ini["main"].has("render")) {
+		strcpy(Options.render_path, ini["main"]["render"].c_str());
+	}
+
+	if (ini["main"].has("soundlog")) {
+		strcpy(Options.sound_path, ini["main"]["soundlog"].c_str());
+	}
+
+	if (ini["main"].has("playlog")) {
+		strcpy(Options.replay_path, ini["main"]["playlog"].c_str());
+	}
+
+	if (ini["main"].has("state")) {
+		strcpy(Options.state_path, ini["main"]["state"].c_str());
+	}
+
+	if (ini["main"].has("movie")) {
+		strcpy(Options.movie_path, ini["main"]["movie"].c_str());
+	}
+
+	if (ini["main"].has("playmovie")) {
+		strcpy(Options.play_movie_path, ini["main"]["playmovie"].c_str());
+	}
+
+	if (ini["main"].has("trace")) {
+		strcpy(Options.trace_path, ini["main"]["trace"].c_str());
+	}
+
+	if (ini["main"].has("decodetrace")) {
+		strcpy(Options.decode_trace_path, ini["main"]["decodetrace"].c_str());
+	}
+
 	if (ini["main"].has("stds")) {
 		if (!strcmp(ini["main"]["stds"].c_str(), "true")) {
 			symbols_load_file("kernal.sym", 0);
@@ -707,18 +1085,38 @@ static void set_options(mINI::INIStructure &ini)
 		Options.audio_buffers = (int)strtol(ini["main"]["abufs"].c_str(), NULL, 10);
 	}
 
+	if (ini["main"].has("rewind")) {
+		Options.rewind_seconds = (int)strtol(ini["main"]["rewind"].c_str(), NULL, 10);
+	}
+
+	if (ini["main"].has("runahead")) {
+		Options.run_ahead = (int)strtol(ini["main"]["runahead"].c_str(), NULL, 10);
+	}
+
 	if (ini["main"].has("rtc")) {
 		if (!strcmp(ini["main"]["rtc"].c_str(), "true")) {
 			Options.set_system_time = true;
 		}
 	}
 
+	if (ini["main"].has("instantboot")) {
+		if (!strcmp(ini["main"]["instantboot"].c_str(), "true")) {
+			Options.instant_boot = true;
+		}
+	}
+
 	if (ini["main"].has("nobinds")) {
 		if (!strcmp(ini["main"]["nobinds"].c_str(), "true")) {
 			Options.no_keybinds = true;
 		}
 	}
 
+	if (ini["main"].has("nofastspi")) {
+		if (!strcmp(ini["main"]["nofastspi"].c_str(), "true")) {
+			Options.no_fast_spi = true;
+		}
+	}
+
 	if (ini["main"].has("ymirq")) {
 		if (!strcmp(ini["main"]["ymirq"].c_str(), "true")) {
 			Options.ym_irq = true;
@@ -730,6 +1128,25 @@ static void set_options(mINI::INIStructure &ini)
 			Options.ym_strict = true;
 		}
 	}
+
+	auto volume_option = [&](const char *name, int &volume) {
+		if (ini["main"].has(name)) {
+			volume = atoi(ini["main"][name].c_str());
+			if (volume < 0 || volume > 200) {
+				usage();
+			}
+		}
+	};
+
+	volume_option("ymvolume", Options.ym_volume);
+	volume_option("psgvolume", Options.psg_volume);
+	volume_option("pcmvolume", Options.pcm_volume);
+
+	if (ini["main"].has("dcfilter")) {
+		if (!strcmp(ini["main"]["dcfilter"].c_str(), "true")) {
+			Options.dc_filter = true;
+		}
+	}
 }
 
 static void set_ini(mINI::INIStructure &ini, bool all)
@@ -768,6 +1185,15 @@ static void set_ini(mINI::INIStructure &ini, bool all)
 		return "none";
 	};
 
+	auto sdcard_sync_str = [](sdcard_sync_t sync) -> const char * {
+		switch (sync) {
+			case sdcard_sync_t::EXIT: return "exit";
+			case sdcard_sync_t::ASYNC: return "async";
+			case sdcard_sync_t::SYNC: return "sync";
+		}
+		return "exit";
+	};
+
 	auto quality_str = [](scale_quality_t q) -> const char * {
 		switch (q) {
 			case scale_quality_t::NEAREST: return "nearest";
@@ -788,6 +1214,9 @@ static void set_ini(mINI::INIStructure &ini, bool all)
 	set_option("test", Options.test_number, Default_options.test_number);
 	set_option("nvram", Options.nvram_path, Default_options.nvram_path);
 	set_option("sdcard", Options.sdcard_path, Default_options.sdcard_path);
+	set_option("sdoverlay", Options.sdcard_overlay, Default_options.sdcard_overlay);
+	set_option("sdcommit", Options.sdcard_commit, Default_options.sdcard_commit);
+	set_option("sdsync", sdcard_sync_str(Options.sdcard_sync), sdcard_sync_str(Default_options.sdcard_sync));
 	set_option("warp", Options.warp_factor > 0, Default_options.warp_factor > 0);
 	set_option("echo", echo_mode_str(Options.echo_mode), echo_mode_str(Default_options.echo_mode));
 
@@ -823,7 +1252,11 @@ static void set_ini(mINI::INIStructure &ini, bool all)
 	}
 
 	set_option("gif", Options.gif_path, Default_options.gif_path);
+	set_option("video", Options.video_path, Default_options.video_path);
 	set_option("wav", Options.wav_path, Default_options.wav_path);
+	set_option("wavfloat", Options.wav_float, Default_options.wav_float);
+	set_option("wavtracks", Options.wav_multitrack, Default_options.wav_multitrack);
+	set_option("soundlog", Options.sound_path, Default_options.sound_path);
 	set_option("stds", Options.load_standard_symbols, Default_options.load_standard_symbols);
 	set_option("scale", Options.window_scale, Default_options.window_scale);
 	set_option("quality", quality_str(Options.scale_quality), quality_str(Default_options.scale_quality));
@@ -831,9 +1264,17 @@ static void set_ini(mINI::INIStructure &ini, bool all)
 	set_option("sound", Options.audio_dev_name, Default_options.audio_dev_name);
 	set_option("abufs", Options.audio_buffers, Default_options.audio_buffers);
 	set_option("rtc", Options.set_system_time, Default_options.set_system_time);
+	set_option("instantboot", Options.instant_boot, Default_options.instant_boot);
+	set_option("rewind", Options.rewind_seconds, Default_options.rewind_seconds);
+	set_option("runahead", Options.run_ahead, Default_options.run_ahead);
 	set_option("nobinds", Options.no_keybinds, Default_options.no_keybinds);
+	set_option("nofastspi", Options.no_fast_spi, Default_options.no_fast_spi);
 	set_option("ymirq", Options.ym_irq, Default_options.ym_irq);
 	set_option("ymstrict", Options.ym_strict, Default_options.ym_strict);
+	set_option("ymvolume", Options.ym_volume, Default_options.ym_volume);
+	set_option("psgvolume", Options.psg_volume, Default_options.psg_volume);
+	set_option("pcmvolume", Options.pcm_volume, Default_options.pcm_volume);
+	set_option("dcfilter", Options.dc_filter, Default_options.dc_filter);
 }
 
 void apply_ini(mINI::INIStructure &dst, const mINI::INIStructure &src)
@@ -15,6 +15,12 @@ enum class scale_quality_t {
 	BEST
 };
 
+enum class sdcard_sync_t {
+	EXIT,
+	ASYNC,
+	SYNC
+};
+
 enum class option_source {
 	DEFAULT,
 	INIFILE,
@@ -22,14 +28,24 @@ enum class option_source {
 };
 
 struct options {
-	char hyper_path[PATH_MAX]  = ".";
-	char rom_path[PATH_MAX]    = "rom.bin";
-	char prg_path[PATH_MAX]    = "";
-	char bas_path[PATH_MAX]    = "";
-	char sdcard_path[PATH_MAX] = "";
-	char nvram_path[PATH_MAX]  = "";
-	char gif_path[PATH_MAX]    = "";
-	char wav_path[PATH_MAX]    = "";
+	char hyper_path[PATH_MAX]        = ".";
+	char rom_path[PATH_MAX]          = "rom.bin";
+	char prg_path[PATH_MAX]          = "";
+	char bas_path[PATH_MAX]          = "";
+	char sdcard_path[PATH_MAX]       = "";
+	char sdcard_overlay[PATH_MAX]    = "";
+	char nvram_path[PATH_MAX]        = "";
+	char gif_path[PATH_MAX]          = "";
+	char wav_path[PATH_MAX]          = "";
+	char video_path[PATH_MAX]        = "";
+	char render_path[PATH_MAX]       = "";
+	char sound_path[PATH_MAX]        = "";
+	char replay_path[PATH_MAX]       = "";
+	char state_path[PATH_MAX]        = "";
+	char movie_path[PATH_MAX]        = "";
+	char play_movie_path[PATH_MAX]   = "";
+	char trace_path[PATH_MAX]        = "";
+	char decode_trace_path[PATH_MAX] = "";
 
 	bool run_after_load = false;
 	bool run_geos       = false;
@@ -46,19 +62,31 @@ struct options {
 	bool        dump_vram    = false;
 	echo_mode_t echo_mode    = ECHO_MODE_NONE;
 
-	int             num_ram_banks = 64; // 512 KB default
-	uint8_t         keymap        = 0;  // KERNAL's default
-	int             test_number   = -1;
-	int             warp_factor   = 0;
-	int             window_scale  = 2;
-	scale_quality_t scale_quality = scale_quality_t::NEAREST;
+	int             num_ram_banks  = 64; // 512 KB default
+	uint8_t         keymap         = 0;  // KERNAL's default
+	int             test_number    = -1;
+	int             warp_factor    = 0;
+	int             window_scale   = 2;
+	int             rewind_seconds = 0;
+	int             run_ahead      = 0;
+	scale_quality_t scale_quality  = scale_quality_t::NEAREST;
+	sdcard_sync_t   sdcard_sync    = sdcard_sync_t::EXIT;
 
 	char audio_dev_name[PATH_MAX] = "";
 	bool no_sound                 = false;
 	int  audio_buffers            = 8;
+	int  ym_volume                = 100;
+	int  psg_volume               = 100;
+	int  pcm_volume               = 100;
+	bool wav_float                = false;
+	bool wav_multitrack           = false;
+	bool dc_filter                = false;
 
 	bool set_system_time = false;
+	bool instant_boot    = false;
 	bool no_keybinds     = false;
+	bool no_fast_spi     = false;
+	bool sdcard_commit   = false;
 	bool ym_irq          = false;
 	bool ym_strict       = false;
 };
@@ -1,9 +1,12 @@
 #include "options_menu.h"
 
+#include "audio.h"
 #include "display.h"
 #include "imgui/imgui.h"
 #include "nfd.h"
 #include "options.h"
+#include "rewind.h"
+#include "wav_recorder.h"
 #include "ym2151/ym2151.h"
 
 void draw_options_menu()
@@ -72,7 +75,36 @@ void draw_options_menu()
 
 	file_option("bin", Options.rom_path, "ROM path", "Location of the emulator ROM file.\nCommand line: -rom <path>");
 	file_option("bin;nvram", Options.nvram_path, "NVRAM path", "Location of NVRAM image file, if any.\nCommand line: -nvram <path>");
-	file_option("bin;img;sdcard", Options.sdcard_path, "SD Card path", "Location of SD card image file, if any.\nCommand line: -sdcard <path>");
+	file_option("bin;img;sdcard", Options.sdcard_path, "SD Card path", "Location of SD card image file, or a directory to present as one, if any.\nCommand line: -sdcard <path>");
+
+	static auto sdcard_sync_name = [](sdcard_sync_t sync) {
+		switch (sync) {
+			case sdcard_sync_t::EXIT: return "On exit";
+			case sdcard_sync_t::ASYNC: return "After writes";
+			case sdcard_sync_t::SYNC: return "Every write";
+			default: return "On exit";
+		}
+	};
+
+	if (ImGui::BeginCombo("SD Card sync", sdcard_sync_name(Options.sdcard_sync))) {
+		auto selection = [](sdcard_sync_t sync) {
+			if (ImGui::Selectable(sdcard_sync_name(sync), Options.sdcard_sync == sync)) {
+				Options.sdcard_sync = sync;
+			}
+		};
+
+		selection(sdcard_sync_t::EXIT);
+		selection(sdcard_sync_t::ASYNC);
+		selection(sdcard_sync_t::SYNC);
+
+		ImGui::EndCombo();
+	}
+	if (ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("When writes to the SD card image are flushed to disk:\nOn exit: When the card is detached or the emulator exits.\nAfter writes: Start writing back after every block written.\nEvery write: Wait for every block to reach the disk.\nCommand line: -sdsync {exit|async|sync}");
+	}
+	file_option("img;ovl", Options.sdcard_overlay, "SD Card overlay", "Open the SD card image read-only and keep writes in memory (\"mem\") or in a sparse overlay file.\nTakes effect the next time an SD card image is opened.\nCommand line: -sdoverlay {mem|<path>}");
+	bool_option(Options.sdcard_commit, "Commit SD Card overlay", "Write the overlay's changes back to the SD card image on exit instead of discarding them.\nCommand line: -sdcommit");
+	bool_option(Options.no_fast_spi, "No fast SPI", "Feed SD card data to VERA's SPI controller one byte at a time instead of a whole block at once.\nThe 6502 sees the same timing either way.\nCommand line: -nofastspi");
 
 	ImGui::NewLine();
 
@@ -182,6 +214,30 @@ void draw_options_menu()
 		ImGui::SetTooltip("Set X16 system time to current time reported by your OS.\nCommand line: -rtc");
 	}
 
+	bool_option(Options.instant_boot, "Instant Boot", "Start from a cached snapshot of the machine at the BASIC prompt.\nTakes effect on the next start.\nCommand line: -instantboot");
+
+	if (ImGui::InputInt("Rewind Seconds", &Options.rewind_seconds)) {
+		if (Options.rewind_seconds < 0) {
+			Options.rewind_seconds = 0;
+		}
+		rewind_init(Options.rewind_seconds);
+	}
+	if (ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("Keep a snapshot of every frame for this many seconds, to go back with Ctrl-Backspace.\n0 turns rewinding off.\nCommand line: -rewind <seconds>");
+	}
+
+	if (ImGui::InputInt("Run-Ahead Frames", &Options.run_ahead)) {
+		if (Options.run_ahead < 0) {
+			Options.run_ahead = 0;
+		}
+		if (Options.run_ahead > 8) {
+			Options.run_ahead = 8;
+		}
+	}
+	if (ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("Hide this many frames of a game's own input lag by running ahead and rolling back every frame.\nSet it to how many frames the game takes to react to input; every frame costs a whole extra frame of emulation.\nCommand line: -runahead <frames>");
+	}
+
 	bool warp_speed = Options.warp_factor;
 	if (ImGui::Checkbox("Warp Speed", &warp_speed)) {
 		Options.warp_factor = warp_speed ? 1 : 0;
@@ -240,6 +296,14 @@ void draw_options_menu()
 
 	file_option("gif", Options.gif_path, "GIF path", "Location to save gifs\nCommand line: -gif <path>[,wait]");
 	file_option("wav", Options.wav_path, "WAV path", "Location to save wavs\nCommand line: -wav <path>[,wait]");
+	if (bool_option(Options.wav_float, "WAV as float", "Record wavs as 32-bit float instead of 16-bit PCM.\nCommand line: -wavfloat")) {
+		wav_recorder_set_format(Options.wav_float, Options.wav_multitrack);
+	}
+	if (bool_option(Options.wav_multitrack, "WAV per-chip tracks", "Also record the unmixed YM2151, PSG and PCM output into separate wavs.\nCommand line: -wavtracks")) {
+		wav_recorder_set_format(Options.wav_float, Options.wav_multitrack);
+	}
+	file_option("y4m,png,rgb", Options.video_path, "Video path", "Location to save full frame rate video (.y4m, .png sequence, or raw RGB)\nCommand line: -video <path>[,wait]");
+	file_option("vgm", Options.sound_path, "Sound log path", "Location to save sound register logs (VGM)\nCommand line: -soundlog <path>[,wait]");
 	bool_option(Options.load_standard_symbols, "Load Standard Symbols", "Load all symbols files typically included with ROM distributions.\nCommand line: -stds");
 
 	bool_option(Options.no_keybinds, "No Keybinds", "Disable all emulator keyboard bindings.\nDoes not affect F12 (emulator debug break) or key shortcuts when the ASM Monitor is open.\nCommand line: -nobinds");
@@ -271,6 +335,30 @@ void draw_options_menu()
 		ImGui::SetTooltip("Number of audio buffers.\n(Deprecated: No longer has any effect.)\nCommand line: -abufs <qty>");
 	}
 
+	auto volume_option = [](int &volume, audio_source source, char const *name, char const *tip) {
+		if (ImGui::SliderInt(name, &volume, 0, 200, "%d%%")) {
+			audio_set_source_volume(source, volume / 100.0f);
+		}
+		if (ImGui::IsItemHovered()) {
+			ImGui::SetTooltip("%s", tip);
+		}
+		ImGui::SameLine();
+		ImGui::PushID(name);
+		bool muted = audio_get_source_muted(source);
+		if (ImGui::Checkbox("Mute", &muted)) {
+			audio_set_source_muted(source, muted);
+		}
+		ImGui::PopID();
+	};
+
+	volume_option(Options.ym_volume, AUDIO_SOURCE_YM, "YM2151 Volume", "Mixer volume of the YM2151.\nCommand line: -ymvolume <percent>");
+	volume_option(Options.psg_volume, AUDIO_SOURCE_PSG, "PSG Volume", "Mixer volume of VERA's PSG.\nCommand line: -psgvolume <percent>");
+	volume_option(Options.pcm_volume, AUDIO_SOURCE_PCM, "PCM Volume", "Mixer volume of VERA's PCM channel.\nCommand line: -pcmvolume <percent>");
+
+	if (bool_option(Options.dc_filter, "DC filter", "Remove any DC offset from the mixed audio output.\nCommand line: -dcfilter")) {
+		audio_set_dc_filter_enabled(Options.dc_filter);
+	}
+
 	if (bool_option(Options.ym_irq, "Enable YM2151 interrupts", "Enable interrupt generation from the YM2151 chip.\nCommand line: -ymirq")) {
 		YM_set_irq_enabled(Options.ym_irq);
 	}
@@ -2,6 +2,7 @@
 
 #include <SDL.h>
 
+#include <algorithm>
 #include <array>
 #include <functional>
 #include <nfd.h>
@@ -14,11 +15,13 @@
 #include "cpu_visualization.h"
 #include "disasm.h"
 #include "ram_dump.h"
+#include "raster_timeline.h"
 #include "util.h"
 #include "vram_dump.h"
 
 #include "audio.h"
 #include "bitutils.h"
+#include "call_stack.h"
 #include "cpu/fake6502.h"
 #include "debugger.h"
 #include "display.h"
@@ -26,10 +29,14 @@
 #include "joystick.h"
 #include "keyboard.h"
 #include "midi_overlay.h"
+#include "movie.h"
 #include "options_menu.h"
+#include "rewind.h"
 #include "smc.h"
+#include "state.h"
 #include "symbols.h"
 #include "timing.h"
+#include "trace.h"
 #include "vera/sdcard.h"
 #include "vera/vera_video.h"
 #include "psg_overlay.h"
@@ -41,6 +48,7 @@ bool Show_memory_dump_1    = false;
 bool Show_memory_dump_2    = false;
 bool Show_cpu_monitor      = false;
 bool Show_cpu_visualizer   = false;
+bool Show_raster_timeline  = false;
 bool Show_VRAM_visualizer  = false;
 bool Show_VERA_monitor     = false;
 bool Show_VERA_palette     = false;
@@ -209,6 +217,104 @@ static void draw_debugger_cpu_visualizer()
 	ImGui::Image((void *)(intptr_t)vis.get_texture_id(), vis_imsize, vis.get_top_left(0), vis.get_bottom_right(0));
 }
 
+static void draw_raster_timeline()
+{
+	static int num_frames = 8;
+	ImGui::PushItemWidth(128.0f);
+	ImGui::SliderInt("Frames", &num_frames, 1, Raster_timeline_frames);
+	ImGui::PopItemWidth();
+	ImGui::SameLine();
+	ImGui::TextDisabled("Grey: CPU busy. Red: in IRQ handler. Green: VRAM writes. Yellow: IRQ handler start to end.");
+
+	static constexpr float bar_width    = 64.0f;
+	static constexpr float vram_width   = 16.0f;
+	static constexpr float column_width = bar_width + vram_width + 8.0f;
+	static constexpr float text_height  = 20.0f;
+
+	static constexpr ImU32 background_color = IM_COL32(0x20, 0x20, 0x20, 0xFF);
+	static constexpr ImU32 visible_color    = IM_COL32(0x30, 0x30, 0x48, 0xFF);
+	static constexpr ImU32 busy_color       = IM_COL32(0xA0, 0xA0, 0xA0, 0xFF);
+	static constexpr ImU32 irq_color        = IM_COL32(0xE0, 0x40, 0x40, 0xFF);
+	static constexpr ImU32 vram_color       = IM_COL32(0x40, 0xE0, 0x40, 0xFF);
+	static constexpr ImU32 span_color       = IM_COL32(0xF0, 0xD0, 0x20, 0xFF);
+
+	const int             frames  = std::min(num_frames, raster_timeline_num_frames());
+	const vera_video_rect visible = vera_video_get_scan_visible();
+
+	ImDrawList  *draw_list = ImGui::GetWindowDrawList();
+	const ImVec2 topleft   = ImGui::GetCursorScreenPos();
+	ImGui::InvisibleButton("timeline", ImVec2(column_width * std::max(frames, 1), SCAN_HEIGHT + text_height));
+
+	// Oldest on the left, like a timeline.
+	for (int i = 0; i < frames; ++i) {
+		const raster_frame &frame = raster_timeline_get_frame(frames - 1 - i);
+		const float         x     = topleft.x + i * column_width;
+
+		draw_list->AddRectFilled(ImVec2(x, topleft.y), ImVec2(x + bar_width, topleft.y + SCAN_HEIGHT), background_color);
+		draw_list->AddRectFilled(ImVec2(x, topleft.y + visible.vstart), ImVec2(x + bar_width, topleft.y + visible.vstop), visible_color);
+
+		uint32_t total_clocks = 0;
+		uint32_t total_busy   = 0;
+		for (int line = 0; line < SCAN_HEIGHT; ++line) {
+			total_clocks += frame.clocks[line];
+			total_busy += frame.busy_clocks[line];
+			if (frame.clocks[line] == 0) {
+				continue;
+			}
+
+			const float y    = topleft.y + line;
+			const float busy = bar_width * frame.busy_clocks[line] / frame.clocks[line];
+			const float irq  = bar_width * frame.irq_clocks[line] / frame.clocks[line];
+			if (busy > irq) {
+				draw_list->AddRectFilled(ImVec2(x + irq, y), ImVec2(x + busy, y + 1), busy_color);
+			}
+			if (irq > 0) {
+				draw_list->AddRectFilled(ImVec2(x, y), ImVec2(x + irq, y + 1), irq_color);
+			}
+			if (frame.vram_writes[line] > 0) {
+				// A tight loop of STA VERA_DATA0 gets about 30 writes in per line.
+				const float writes = vram_width * std::min((int)frame.vram_writes[line], 32) / 32.0f;
+				draw_list->AddRectFilled(ImVec2(x + bar_width + 2, y), ImVec2(x + bar_width + 2 + std::max(writes, 1.0f), y + 1), vram_color);
+			}
+		}
+
+		for (int j = 0; j < frame.num_irqs; ++j) {
+			const raster_irq_span &span = frame.irqs[j];
+			draw_list->AddLine(ImVec2(x + 1, topleft.y + span.start_line), ImVec2(x + 1, topleft.y + span.end_line + 1), span_color, 2.0f);
+			draw_list->AddLine(ImVec2(x, topleft.y + span.start_line), ImVec2(x + 8, topleft.y + span.start_line), span_color);
+		}
+
+		char busy_text[16];
+		snprintf(busy_text, sizeof(busy_text), "%d%% busy", total_clocks > 0 ? (int)((uint64_t)total_busy * 100 / total_clocks) : 0);
+		draw_list->AddText(ImVec2(x, topleft.y + SCAN_HEIGHT + 2), ImGui::GetColorU32(ImGuiCol_Text), busy_text);
+	}
+
+	if (ImGui::IsItemHovered()) {
+		const ImVec2 mouse = ImGui::GetMousePos();
+		const int    i     = (int)((mouse.x - topleft.x) / column_width);
+		const int    line  = (int)(mouse.y - topleft.y);
+		if (i >= 0 && i < frames && line >= 0 && line < SCAN_HEIGHT) {
+			const raster_frame &frame = raster_timeline_get_frame(frames - 1 - i);
+
+			ImGui::BeginTooltip();
+			if (line >= visible.vstart && line < visible.vstop) {
+				ImGui::Text("Line %d (screen row %d)", line, line - visible.vstart);
+			} else {
+				ImGui::Text("Line %d (border)", line);
+			}
+			ImGui::Text("%u of %u cycles busy, %u in IRQ handler", frame.busy_clocks[line], frame.clocks[line], frame.irq_clocks[line]);
+			ImGui::Text("%u VRAM writes", frame.vram_writes[line]);
+			for (int j = 0; j < frame.num_irqs; ++j) {
+				const raster_irq_span &span = frame.irqs[j];
+				if (line >= span.start_line && line <= span.end_line) {
+					ImGui::Text("IRQ handler from line %u to %u", span.start_line, span.end_line);
+				}
+			}
+			ImGui::EndTooltip();
+		}
+	}
+}
+
 static void draw_debugger_vera_status()
 {
 	ImGui::BeginGroup();
@@ -1624,12 +1730,13 @@ static void draw_breakpoints()
 	{
 		ImGui::PushStyleVar(ImGuiStyleVar_IndentSpacing, 0.0f);
 		if (ImGui::TreeNodeEx("Breakpoints", ImGuiTreeNodeFlags_Framed | ImGuiTreeNodeFlags_DefaultOpen)) {
-			if (ImGui::BeginTable("breakpoints", 5)) {
+			if (ImGui::BeginTable("breakpoints", 6)) {
 				ImGui::TableSetupColumn("", ImGuiTableColumnFlags_WidthFixed, 16);
 				ImGui::TableSetupColumn("", ImGuiTableColumnFlags_WidthFixed, 16);
 				ImGui::TableSetupColumn("Address", ImGuiTableColumnFlags_WidthFixed, 64);
 				ImGui::TableSetupColumn("Bank", ImGuiTableColumnFlags_WidthFixed, 48);
 				ImGui::TableSetupColumn("Symbol");
+				ImGui::TableSetupColumn("Condition");
 				ImGui::TableHeadersRow();
 
 				const auto &breakpoints = debugger_get_breakpoints();
@@ -1688,6 +1795,13 @@ static void draw_breakpoints()
 						}
 					}
 
+					ImGui::TableNextColumn();
+					const char *condition = debugger_get_breakpoint_condition(address, bank);
+					const bool  log       = debugger_breakpoint_is_logpoint(address, bank);
+					if (*condition != '\0' || log) {
+						ImGui::Text("%s%s(%u hits)", condition, log ? " log " : " ", debugger_get_breakpoint_hits(address, bank));
+					}
+
 					ImGui::PopID();
 					ImGui::PopID();
 				}
@@ -1697,12 +1811,355 @@ static void draw_breakpoints()
 
 			static uint16_t new_address = 0;
 			static uint8_t  new_bank    = 0;
+			static char     new_condition[128];
+			static bool     new_log   = false;
+			static bool     new_error = false;
 			ImGui::InputHexLabel("New Address", new_address);
 			ImGui::SameLine();
 			ImGui::InputHexLabel("Bank", new_bank);
 			ImGui::SameLine();
+			ImGui::Text("If");
+			ImGui::SameLine();
+			ImGui::PushItemWidth(160.0f);
+			if (ImGui::InputText("##condition", new_condition, sizeof(new_condition))) {
+				new_error = false;
+			}
+			ImGui::PopItemWidth();
+			if (ImGui::IsItemHovered()) {
+				ImGui::SetTooltip("Stop only when this is non-zero, e.g. a == $40 && peek($22) > 3\n"
+				                  "Registers: a x y sp p pc, rambank rombank, clock, hits\n"
+				                  "Functions: peek(addr) peekw(addr) vram(addr) vera(reg)");
+			}
+			ImGui::SameLine();
+			ImGui::Checkbox("Log", &new_log);
+			if (ImGui::IsItemHovered()) {
+				ImGui::SetTooltip("Add to the log instead of stopping");
+			}
+			ImGui::SameLine();
 			if (ImGui::Button("Add")) {
-				debugger_add_breakpoint(new_address, new_bank);
+				new_error = !debugger_add_breakpoint(new_address, new_bank, new_condition, new_log);
+			}
+			if (new_error) {
+				ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", debugger_breakpoint_error());
+			}
+
+			ImGui::Dummy(ImVec2(0, 5));
+			ImGui::TreePop();
+		}
+		ImGui::PopStyleVar();
+	}
+	ImGui::EndGroup();
+}
+
+static void draw_breakpoint_log()
+{
+	ImGui::BeginGroup();
+	{
+		ImGui::PushStyleVar(ImGuiStyleVar_IndentSpacing, 0.0f);
+		if (ImGui::TreeNodeEx("Log", ImGuiTreeNodeFlags_Framed)) {
+			if (ImGui::Button("Clear")) {
+				debugger_clear_log();
+			}
+			ImGui::SameLine();
+			ImGui::Text("%d entries", (int)debugger_get_log_size());
+
+			if (ImGui::BeginChild("log", ImVec2(0, 160), true)) {
+				ImGuiListClipper clipper;
+				clipper.Begin((int)debugger_get_log_size());
+				while (clipper.Step()) {
+					for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i) {
+						const breakpoint_log_entry &entry = debugger_get_log_entry(i);
+						ImGui::Text("%12" SDL_PRIu64 "  %02X:%04X  a=%02X x=%02X y=%02X sp=%02X p=%02X  #%u", entry.clock, entry.bank, entry.address, entry.a, entry.x, entry.y, entry.sp, entry.status, entry.hits);
+					}
+				}
+				// Follow new entries, unless scrolled up to look at older ones.
+				if (ImGui::GetScrollY() >= ImGui::GetScrollMaxY()) {
+					ImGui::SetScrollHereY(1.0f);
+				}
+			}
+			ImGui::EndChild();
+
+			ImGui::Dummy(ImVec2(0, 5));
+			ImGui::TreePop();
+		}
+		ImGui::PopStyleVar();
+	}
+	ImGui::EndGroup();
+}
+
+static void draw_watchpoints()
+{
+	ImGui::BeginGroup();
+	{
+		ImGui::PushStyleVar(ImGuiStyleVar_IndentSpacing, 0.0f);
+		if (ImGui::TreeNodeEx("Watchpoints", ImGuiTreeNodeFlags_Framed | ImGuiTreeNodeFlags_DefaultOpen)) {
+			if (const watchpoint_hit *hit = debugger_get_watchpoint_hit()) {
+				const char *space = hit->space == watch_space::vram ? "VRAM " : "";
+				if (hit->flag == WATCH_READ) {
+					ImGui::Text("Stopped on read of %s%04X: %02X", space, hit->address, hit->value);
+				} else {
+					ImGui::Text("Stopped on write to %s%04X: %02X -> %02X", space, hit->address, hit->old_value, hit->value);
+				}
+			}
+
+			if (ImGui::BeginTable("watchpoints", 7)) {
+				ImGui::TableSetupColumn("", ImGuiTableColumnFlags_WidthFixed, 16);
+				ImGui::TableSetupColumn("Address", ImGuiTableColumnFlags_WidthFixed, 64);
+				ImGui::TableSetupColumn("Bank", ImGuiTableColumnFlags_WidthFixed, 48);
+				ImGui::TableSetupColumn("R", ImGuiTableColumnFlags_WidthFixed, 16);
+				ImGui::TableSetupColumn("W", ImGuiTableColumnFlags_WidthFixed, 16);
+				ImGui::TableSetupColumn("Chg", ImGuiTableColumnFlags_WidthFixed, 24);
+				ImGui::TableSetupColumn("Symbol");
+				ImGui::TableHeadersRow();
+
+				const auto &watchpoints = debugger_get_watchpoints();
+				for (auto &[wp, flags] : watchpoints) {
+					const auto [space, address, bank] = wp;
+					ImGui::PushID((int)space);
+					ImGui::PushID((int)address);
+					ImGui::PushID(bank);
+
+					ImGui::TableNextRow();
+					ImGui::TableNextColumn();
+					if (ImGui::TileButton(ICON_REMOVE)) {
+						debugger_remove_watchpoint(space, address, bank);
+						ImGui::PopID();
+						ImGui::PopID();
+						ImGui::PopID();
+						break;
+					}
+
+					ImGui::TableNextColumn();
+					if (space == watch_space::vram) {
+						ImGui::Text("%05X", address);
+					} else {
+						ImGui::Text("%04X", address);
+					}
+
+					ImGui::TableNextColumn();
+					if (space == watch_space::vram) {
+						ImGui::Text("VRAM");
+					} else if (address < 0xa000) {
+						ImGui::Text("--");
+					} else {
+						ImGui::Text("%s %02X", address < 0xc000 ? "RAM" : "ROM", bank);
+					}
+
+					bool changed = false;
+					for (uint8_t flag : { WATCH_READ, WATCH_WRITE, WATCH_CHANGE }) {
+						ImGui::TableNextColumn();
+						if (ImGui::TileButton((flags & flag) ? ICON_CHECKED : ICON_UNCHECKED)) {
+							debugger_add_watchpoint(space, address, bank, flags ^ flag);
+							changed = true;
+							break;
+						}
+					}
+					if (changed) {
+						ImGui::PopID();
+						ImGui::PopID();
+						ImGui::PopID();
+						break;
+					}
+
+					ImGui::TableNextColumn();
+					if (space == watch_space::cpu) {
+						for (auto &sym : symbols_find((uint16_t)address)) {
+							ImGui::Text("%s", sym.c_str());
+						}
+					}
+
+					ImGui::PopID();
+					ImGui::PopID();
+					ImGui::PopID();
+				}
+
+				ImGui::EndTable();
+			}
+
+			static uint32_t new_address = 0;
+			static uint8_t  new_bank    = 0;
+			static bool     new_vram    = false;
+			static int      new_flags   = WATCH_WRITE;
+			ImGui::InputHexLabel<uint32_t, 20>("New Address", new_address);
+			ImGui::SameLine();
+			ImGui::InputHexLabel("Bank", new_bank);
+			ImGui::SameLine();
+			ImGui::Checkbox("VRAM", &new_vram);
+			ImGui::SameLine();
+			ImGui::CheckboxFlags("R", &new_flags, WATCH_READ);
+			ImGui::SameLine();
+			ImGui::CheckboxFlags("W", &new_flags, WATCH_WRITE);
+			ImGui::SameLine();
+			ImGui::CheckboxFlags("Chg", &new_flags, WATCH_CHANGE);
+			ImGui::SameLine();
+			if (ImGui::Button("Add") && new_flags != 0) {
+				debugger_add_watchpoint(new_vram ? watch_space::vram : watch_space::cpu, new_address, new_bank, (uint8_t)new_flags);
+			}
+
+			ImGui::Dummy(ImVec2(0, 5));
+			ImGui::TreePop();
+		}
+		ImGui::PopStyleVar();
+	}
+	ImGui::EndGroup();
+}
+
+static const char *routine_name(uint16_t address, uint8_t bank)
+{
+	const symbol_list_type &symbols = symbols_find(address, bank);
+	return symbols.empty() ? "" : symbols.front().c_str();
+}
+
+static void show_in_disasm(uint16_t address, uint8_t bank)
+{
+	disasm.set_dump_start(address);
+	if (address >= 0xc000) {
+		disasm.set_rom_bank(bank);
+	} else if (address >= 0xa000) {
+		disasm.set_ram_bank(bank);
+	}
+}
+
+static void draw_call_stack()
+{
+	ImGui::BeginGroup();
+	{
+		ImGui::PushStyleVar(ImGuiStyleVar_IndentSpacing, 0.0f);
+		if (ImGui::TreeNodeEx("Call Stack", ImGuiTreeNodeFlags_Framed | ImGuiTreeNodeFlags_DefaultOpen)) {
+			if (ImGui::BeginTable("call stack", 5)) {
+				ImGui::TableSetupColumn("", ImGuiTableColumnFlags_WidthFixed, 32);
+				ImGui::TableSetupColumn("Routine", ImGuiTableColumnFlags_WidthFixed, 64);
+				ImGui::TableSetupColumn("Symbol");
+				ImGui::TableSetupColumn("From", ImGuiTableColumnFlags_WidthFixed, 48);
+				ImGui::TableSetupColumn("Cycles", ImGuiTableColumnFlags_WidthFixed, 80);
+				ImGui::TableHeadersRow();
+
+				static const char *kinds[] = { "jsr", "brk", "irq", "nmi" };
+
+				// Innermost first, like the stack itself.
+				for (int i = call_stack_depth() - 1; i >= 0; --i) {
+					const call_frame &frame = call_stack_get_frame(i);
+					ImGui::PushID(i);
+
+					ImGui::TableNextRow();
+					ImGui::TableNextColumn();
+					ImGui::TextDisabled("%s", kinds[(int)frame.kind]);
+
+					ImGui::TableNextColumn();
+					char addr_text[8];
+					sprintf(addr_text, "%02X:%04X", frame.bank, frame.address);
+					if (ImGui::Selectable(addr_text, false, ImGuiSelectableFlags_AllowDoubleClick)) {
+						show_in_disasm(frame.address, frame.bank);
+					}
+
+					ImGui::TableNextColumn();
+					ImGui::Text("%s", routine_name(frame.address, frame.bank));
+
+					ImGui::TableNextColumn();
+					char caller_text[5];
+					sprintf(caller_text, "%04X", frame.caller);
+					if (ImGui::Selectable(caller_text, false, ImGuiSelectableFlags_AllowDoubleClick)) {
+						show_in_disasm(frame.caller, memory_get_current_bank(frame.caller));
+					}
+
+					ImGui::TableNextColumn();
+					ImGui::Text("%" SDL_PRIu64, clockticks6502 - frame.entry_clock);
+
+					ImGui::PopID();
+				}
+
+				ImGui::EndTable();
+			}
+
+			ImGui::Dummy(ImVec2(0, 5));
+			ImGui::TreePop();
+		}
+		ImGui::PopStyleVar();
+	}
+	ImGui::EndGroup();
+}
+
+static void draw_routine_cycles()
+{
+	ImGui::BeginGroup();
+	{
+		ImGui::PushStyleVar(ImGuiStyleVar_IndentSpacing, 0.0f);
+		if (ImGui::TreeNodeEx("Routine Cycles", ImGuiTreeNodeFlags_Framed)) {
+			static bool totals = false;
+			ImGui::Checkbox("Since Reset", &totals);
+			ImGui::SameLine();
+			if (ImGui::Button("Reset")) {
+				call_stack_reset_profile();
+			}
+			ImGui::SameLine();
+			const uint64_t frame_clocks = call_stack_last_frame_clocks();
+			ImGui::Text("Last frame: %" SDL_PRIu64 " cycles", frame_clocks);
+
+			struct routine {
+				uint32_t              key;
+				const routine_cycles *cycles;
+			};
+			static std::vector<routine> routines;
+			routines.clear();
+			for (const auto &[key, profile] : call_stack_get_profile()) {
+				const routine_cycles &cycles = totals ? profile.total : profile.last_frame;
+				if (cycles.inclusive > 0) {
+					routines.push_back({ key, &cycles });
+				}
+			}
+			std::sort(routines.begin(), routines.end(), [](const routine &lhs, const routine &rhs) {
+				return lhs.cycles->exclusive > rhs.cycles->exclusive;
+			});
+
+			if (ImGui::BeginTable("routine cycles", 6, ImGuiTableFlags_ScrollY, ImVec2(0, 200))) {
+				ImGui::TableSetupScrollFreeze(0, 1);
+				ImGui::TableSetupColumn("Routine", ImGuiTableColumnFlags_WidthFixed, 64);
+				ImGui::TableSetupColumn("Symbol");
+				ImGui::TableSetupColumn("Calls", ImGuiTableColumnFlags_WidthFixed, 56);
+				ImGui::TableSetupColumn("Exclusive", ImGuiTableColumnFlags_WidthFixed, 80);
+				ImGui::TableSetupColumn("Inclusive", ImGuiTableColumnFlags_WidthFixed, 80);
+				ImGui::TableSetupColumn("Frame", ImGuiTableColumnFlags_WidthFixed, 48);
+				ImGui::TableHeadersRow();
+
+				ImGuiListClipper clipper;
+				clipper.Begin((int)routines.size());
+				while (clipper.Step()) {
+					for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i) {
+						const uint16_t        address = routines[i].key & 0xffff;
+						const uint8_t         bank    = routines[i].key >> 16;
+						const routine_cycles &cycles  = *routines[i].cycles;
+						ImGui::PushID(i);
+
+						ImGui::TableNextRow();
+						ImGui::TableNextColumn();
+						char addr_text[8];
+						sprintf(addr_text, "%02X:%04X", bank, address);
+						if (ImGui::Selectable(addr_text, false, ImGuiSelectableFlags_AllowDoubleClick)) {
+							show_in_disasm(address, bank);
+						}
+
+						ImGui::TableNextColumn();
+						ImGui::Text("%s", routine_name(address, bank));
+
+						ImGui::TableNextColumn();
+						ImGui::Text("%u", cycles.calls);
+
+						ImGui::TableNextColumn();
+						ImGui::Text("%" SDL_PRIu64, cycles.exclusive);
+
+						ImGui::TableNextColumn();
+						ImGui::Text("%" SDL_PRIu64, cycles.inclusive);
+
+						ImGui::TableNextColumn();
+						if (!totals && frame_clocks > 0) {
+							ImGui::Text("%d%%", (int)(cycles.exclusive * 100 / frame_clocks));
+						}
+
+						ImGui::PopID();
+					}
+				}
+
+				ImGui::EndTable();
 			}
 
 			ImGui::Dummy(ImVec2(0, 5));
@@ -1863,8 +2320,10 @@ static void draw_symbols_files()
 
 static void draw_debugger_controls()
 {
-	bool paused  = debugger_is_paused();
-	bool shifted = ImGui::IsKeyDown(SDL_SCANCODE_LSHIFT) || ImGui::IsKeyDown(SDL_SCANCODE_RSHIFT);
+	bool paused   = debugger_is_paused();
+	bool shifted  = ImGui::IsKeyDown(SDL_SCANCODE_LSHIFT) || ImGui::IsKeyDown(SDL_SCANCODE_RSHIFT);
+	bool ctrl     = ImGui::IsKeyDown(SDL_SCANCODE_LCTRL) || ImGui::IsKeyDown(SDL_SCANCODE_RCTRL);
+	bool can_back = paused && debugger_can_step_back();
 
 	static bool stop_hovered = false;
 	if (ImGui::TileButton(paused ? ICON_STOP_DISABLED : ICON_STOP, !paused, &stop_hovered) || (shifted && ImGui::IsKeyPressed(SDL_SCANCODE_F5))) {
@@ -1878,7 +2337,7 @@ static void draw_debugger_controls()
 	ImGui::SameLine();
 
 	static bool run_hovered = false;
-	if (ImGui::TileButton(paused ? ICON_RUN : ICON_RUN_DISABLED, paused, &run_hovered) || (!shifted && ImGui::IsKeyPressed(SDL_SCANCODE_F5))) {
+	if (ImGui::TileButton(paused ? ICON_RUN : ICON_RUN_DISABLED, paused, &run_hovered) || (!shifted && !ctrl && ImGui::IsKeyPressed(SDL_SCANCODE_F5))) {
 		debugger_continue_execution();
 		disasm.follow_pc();
 	}
@@ -1888,7 +2347,7 @@ static void draw_debugger_controls()
 	ImGui::SameLine();
 
 	static bool step_over_hovered = false;
-	if (ImGui::TileButton(paused ? ICON_STEP_OVER : ICON_STEP_OVER_DISABLED, paused, &step_over_hovered) || (!shifted && ImGui::IsKeyPressed(SDL_SCANCODE_F10))) {
+	if (ImGui::TileButton(paused ? ICON_STEP_OVER : ICON_STEP_OVER_DISABLED, paused, &step_over_hovered) || (!shifted && !ctrl && ImGui::IsKeyPressed(SDL_SCANCODE_F10))) {
 		debugger_step_over_execution();
 		disasm.follow_pc();
 	}
@@ -1898,7 +2357,7 @@ static void draw_debugger_controls()
 	ImGui::SameLine();
 
 	static bool step_into_hovered = false;
-	if (ImGui::TileButton(paused ? ICON_STEP_INTO : ICON_STEP_INTO_DISABLED, paused, &step_into_hovered) || (!shifted && ImGui::IsKeyPressed(SDL_SCANCODE_F11))) {
+	if (ImGui::TileButton(paused ? ICON_STEP_INTO : ICON_STEP_INTO_DISABLED, paused, &step_into_hovered) || (!shifted && !ctrl && ImGui::IsKeyPressed(SDL_SCANCODE_F11))) {
 		debugger_step_execution();
 		disasm.follow_pc();
 	}
@@ -1917,6 +2376,33 @@ static void draw_debugger_controls()
 	}
 	ImGui::SameLine();
 
+	if ((ImGui::SmallButton("Run Back") || (ctrl && ImGui::IsKeyPressed(SDL_SCANCODE_F5))) && can_back) {
+		debugger_continue_back_execution();
+		disasm.follow_pc();
+	}
+	if (can_back && ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("Run backwards to a breakpoint (Ctrl+F5)");
+	}
+	ImGui::SameLine();
+
+	if ((ImGui::SmallButton("Step Back Over") || (ctrl && ImGui::IsKeyPressed(SDL_SCANCODE_F10))) && can_back) {
+		debugger_step_back_over_execution();
+		disasm.follow_pc();
+	}
+	if (can_back && ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("Step Back Over (Ctrl+F10)");
+	}
+	ImGui::SameLine();
+
+	if ((ImGui::SmallButton("Step Back") || (ctrl && ImGui::IsKeyPressed(SDL_SCANCODE_F11))) && can_back) {
+		debugger_step_back_execution();
+		disasm.follow_pc();
+	}
+	if (can_back && ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("Step Back (Ctrl+F11)");
+	}
+	ImGui::SameLine();
+
 	char cycles_raw[32];
 	int  digits = sprintf(cycles_raw, "%" SDL_PRIu64, debugger_step_clocks());
 
@@ -1966,16 +2452,76 @@ static void draw_menu_bar()
 		}
 
 		if (ImGui::BeginMenu("Machine")) {
-			if (ImGui::MenuItem("Reset", Options.no_keybinds ? nullptr : "Ctrl-R")) {
+			if (ImGui::MenuItem("Reset", Options.no_keybinds ? nullptr : "Ctrl-R", false, !movie_is_replaying())) {
+				movie_record_reset();
 				machine_reset();
 			}
-			if (ImGui::MenuItem("NMI")) {
+			if (ImGui::MenuItem("NMI", nullptr, false, !movie_is_replaying())) {
+				movie_record_nmi();
 				nmi6502();
 				debugger_interrupt();
 			}
 			if (ImGui::MenuItem("Save Dump", Options.no_keybinds ? nullptr : "Ctrl-S")) {
 				machine_dump();
 			}
+			if (ImGui::MenuItem("Save State")) {
+				char *save_path = nullptr;
+				if (NFD_SaveDialog("state", nullptr, &save_path) == NFD_OKAY && save_path != nullptr) {
+					machine_save_state_file(save_path);
+				}
+			}
+			if (ImGui::MenuItem("Load State")) {
+				char *open_path = nullptr;
+				if (NFD_OpenDialog("state", nullptr, &open_path) == NFD_OKAY && open_path != nullptr) {
+					machine_load_state_file(open_path);
+				}
+			}
+			if (ImGui::MenuItem("Rewind", Options.no_keybinds ? nullptr : "Ctrl-Backspace", false, rewind_num_frames() > 0)) {
+				rewind_step_back(4);
+			}
+			if (movie_is_recording()) {
+				if (ImGui::MenuItem("Stop Recording Movie")) {
+					movie_stop();
+				}
+			} else if (movie_is_replaying()) {
+				if (ImGui::MenuItem("Stop Playing Movie")) {
+					movie_stop();
+				}
+			} else {
+				if (ImGui::MenuItem("Record Movie")) {
+					char *save_path = nullptr;
+					if (NFD_SaveDialog("b16m", nullptr, &save_path) == NFD_OKAY && save_path != nullptr) {
+						movie_record_start(save_path);
+					}
+				}
+				if (ImGui::MenuItem("Play Movie")) {
+					char *open_path = nullptr;
+					if (NFD_OpenDialog("b16m", nullptr, &open_path) == NFD_OKAY && open_path != nullptr) {
+						movie_replay_start(open_path);
+					}
+				}
+			}
+			if (ImGui::BeginMenu("Execution Trace")) {
+				if (ImGui::MenuItem("Record Trace to File", nullptr, false, !trace_is_enabled())) {
+					char *save_path = nullptr;
+					if (NFD_SaveDialog("b16t", nullptr, &save_path) == NFD_OKAY && save_path != nullptr) {
+						trace_start(save_path);
+					}
+				}
+				if (ImGui::MenuItem("Keep Trace in Memory", nullptr, false, !trace_is_enabled())) {
+					trace_start(nullptr);
+				}
+				if (ImGui::MenuItem("Stop Trace", nullptr, false, trace_is_enabled())) {
+					trace_stop();
+				}
+				if (ImGui::MenuItem("Save Trace", nullptr, false, trace_is_buffered())) {
+					char *save_path = nullptr;
+					if (NFD_SaveDialog("b16t", nullptr, &save_path) == NFD_OKAY && save_path != nullptr) {
+						trace_save(save_path);
+					}
+				}
+				ImGui::EndMenu();
+			}
 			if (ImGui::BeginMenu("Controller Ports")) {
 				joystick_for_each_slot([](int slot, int instance_id, SDL_GameController *controller) {
 					const char *name = nullptr;
@@ -2081,6 +2627,9 @@ static void draw_menu_bar()
 				if (ImGui::Checkbox("CPU Visualizer", &Show_cpu_visualizer)) {
 					cpu_visualization_enable(Show_cpu_visualizer);
 				}
+				if (ImGui::Checkbox("Raster Timeline", &Show_raster_timeline)) {
+					raster_timeline_enable(Show_raster_timeline);
+				}
 				ImGui::EndMenu();
 			}
 			if (ImGui::BeginMenu("VERA Debugging")) {
@@ -2163,6 +2712,10 @@ void overlay_draw()
 			ImGui::SameLine();
 			draw_debugger_cpu_status();
 			draw_breakpoints();
+			draw_breakpoint_log();
+			draw_watchpoints();
+			draw_call_stack();
+			draw_routine_cycles();
 			draw_symbols_list();
 			draw_symbols_files();
 		}
@@ -2179,6 +2732,14 @@ void overlay_draw()
 		ImGui::End();
 	}
 
+	if (Show_raster_timeline) {
+		if (ImGui::Begin("Raster Timeline", &Show_raster_timeline)) {
+			draw_raster_timeline();
+		}
+		ImGui::End();
+		raster_timeline_enable(Show_raster_timeline);
+	}
+
 	if (Show_VRAM_visualizer) {
 		if (ImGui::Begin("Tile Visualizer", &Show_VRAM_visualizer)) {
 			draw_debugger_vram_visualizer();
@@ -0,0 +1,122 @@
+#include "raster_timeline.h"
+
+#include <string.h>
+
+#include "glue.h"
+
+static bool         Enabled = false;
+static raster_frame Frames[Raster_timeline_frames + 1]; // the one being recorded, and the complete ones
+static int          Current    = 0;
+static int          Num_frames = 0;
+static bool         Partial    = false; // recording started part way through the current frame
+
+static uint16_t Last_line        = 0;
+static uint32_t Last_write_count = 0;
+
+static bool    In_irq = false;
+static uint8_t Irq_sp = 0; // before the interrupt pushed anything
+
+static void start_irq(uint16_t line)
+{
+	raster_frame &frame = Frames[Current];
+	if (frame.num_irqs < Raster_timeline_max_irqs) {
+		frame.irqs[frame.num_irqs++] = { line, line };
+	}
+	In_irq = true;
+}
+
+static void end_irq(uint16_t line)
+{
+	raster_frame &frame = Frames[Current];
+	if (frame.num_irqs > 0) {
+		frame.irqs[frame.num_irqs - 1].end_line = line;
+	}
+	In_irq = false;
+}
+
+static void end_frame()
+{
+	const bool in_irq = In_irq;
+	if (in_irq) {
+		end_irq(SCAN_HEIGHT - 1);
+	}
+
+	if (Partial) {
+		Partial = false;
+	} else {
+		Current = (Current + 1) % (Raster_timeline_frames + 1);
+		if (Num_frames < Raster_timeline_frames) {
+			++Num_frames;
+		}
+	}
+	memset(&Frames[Current], 0, sizeof(raster_frame));
+
+	// The handler runs on into the new frame.
+	if (in_irq) {
+		start_irq(0);
+	}
+}
+
+void raster_timeline_enable(bool enable)
+{
+	if (enable && !Enabled) {
+		Num_frames       = 0;
+		Partial          = true;
+		In_irq           = false;
+		Last_line        = vera_video_get_scan_pos_y();
+		Last_write_count = vera_video_get_data_write_count();
+		memset(&Frames[Current], 0, sizeof(raster_frame));
+	}
+	Enabled = enable;
+}
+
+void raster_timeline_step(uint8_t clocks)
+{
+	if (!Enabled) {
+		return;
+	}
+
+	const uint16_t line = vera_video_get_scan_pos_y();
+	if (line < Last_line) {
+		end_frame();
+	}
+	Last_line = line;
+
+	raster_frame &frame = Frames[Current];
+	frame.clocks[line] += clocks;
+	if (!waiting) {
+		frame.busy_clocks[line] += clocks;
+		if (In_irq) {
+			frame.irq_clocks[line] += clocks;
+		}
+	}
+
+	const uint32_t write_count = vera_video_get_data_write_count();
+	frame.vram_writes[line] += (uint16_t)(write_count - Last_write_count);
+	Last_write_count = write_count;
+
+	// RTI takes the stack back to where it was before the interrupt. (Or the handler
+	// took it further still, never to return.)
+	if (In_irq && sp >= Irq_sp) {
+		end_irq(line);
+	}
+}
+
+void raster_timeline_interrupt()
+{
+	if (!Enabled || In_irq) {
+		return;
+	}
+	Irq_sp = sp;
+	start_irq(vera_video_get_scan_pos_y());
+}
+
+int raster_timeline_num_frames()
+{
+	return Num_frames;
+}
+
+const raster_frame &raster_timeline_get_frame(int age)
+{
+	return Frames[(Current + Raster_timeline_frames - age) % (Raster_timeline_frames + 1)];
+}
@@ -0,0 +1,46 @@
+#pragma once
+#if !defined(RASTER_TIMELINE_H)
+#	define RASTER_TIMELINE_H
+
+#	include <stdint.h>
+
+#	include "vera/vera_video.h"
+
+// Where in the frame the CPU's time goes, scanline by scanline: how many cycles ran
+// instructions rather than waiting (WAI), how many of those were in an IRQ handler,
+// how many VRAM writes went through the data ports, and the lines each IRQ handler
+// started and ended on. The lines are VERA's scan lines, front and back porches
+// included, as vera_video_get_scan_pos_y() counts them.
+
+static constexpr int Raster_timeline_frames   = 16;
+static constexpr int Raster_timeline_max_irqs = 32;
+
+struct raster_irq_span {
+	uint16_t start_line;
+	uint16_t end_line; // a handler still running at the end of a frame is split across both
+};
+
+struct raster_frame {
+	uint16_t        clocks[SCAN_HEIGHT];
+	uint16_t        busy_clocks[SCAN_HEIGHT];
+	uint16_t        irq_clocks[SCAN_HEIGHT];
+	uint16_t        vram_writes[SCAN_HEIGHT];
+	int             num_irqs;
+	raster_irq_span irqs[Raster_timeline_max_irqs];
+};
+
+// Recording costs a little per instruction, so it's only on while someone is looking.
+// Turning it on forgets the frames recorded before.
+void raster_timeline_enable(bool enable);
+
+// Called by machine_step() after each instruction, before VERA is stepped past it.
+void raster_timeline_step(uint8_t clocks);
+
+// Called by machine_step() when an IRQ is taken, before the return address is pushed.
+void raster_timeline_interrupt();
+
+// Complete frames recorded, up to Raster_timeline_frames. Age 0 is the most recent.
+int                 raster_timeline_num_frames();
+const raster_frame &raster_timeline_get_frame(int age);
+
+#endif
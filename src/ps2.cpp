@@ -3,7 +3,9 @@
 // All rights reserved. License: 2-clause BSD
 
 #include "ps2.h"
+#include "movie.h"
 #include "ring_buffer.h"
+#include "state.h"
 #include <stdbool.h>
 #include <stdio.h>
 
@@ -27,7 +29,19 @@ static struct {
 
 ps2_port_t ps2_port[2];
 
+static uint64_t port_clocks[2] = { 0, 0 };
+
 void ps2_buffer_add(int i, uint8_t byte)
+{
+	// While a movie plays, it is the only source of input.
+	if (movie_is_replaying()) {
+		return;
+	}
+	movie_record_ps2(i, byte);
+	state[i].buffer.add(byte);
+}
+
+void ps2_buffer_replay(int i, uint8_t byte)
 {
 	state[i].buffer.add(byte);
 }
@@ -152,7 +166,6 @@ void ps2_step(int i, int clocks)
 
 void ps2_autostep(int i)
 {
-	static uint64_t port_clocks[2] = { 0, 0 };
 	extern uint64_t clockticks6502;
 
 	int clocks     = (int)(clockticks6502 - port_clocks[i]);
@@ -186,9 +199,9 @@ static bool mouse_send(int x, int y, int b)
 		    ((x >> 9) & 1) << 4 |
 		    1 << 3 |
 		    b;
-		state[1].buffer.add(byte0);
-		state[1].buffer.add(x);
-		state[1].buffer.add(y);
+		ps2_buffer_add(1, byte0);
+		ps2_buffer_add(1, x);
+		ps2_buffer_add(1, y);
 
 		return true;
 	} else {
@@ -199,6 +212,9 @@ static bool mouse_send(int x, int y, int b)
 
 void mouse_send_state()
 {
+	if (movie_is_replaying()) {
+		return;
+	}
 	do {
 		int send_diff_x = []() -> int {
 			if (mouse_diff_x > 255) {
@@ -241,10 +257,23 @@ void mouse_button_up(int num)
 
 void mouse_move(int x, int y)
 {
+	if (movie_is_replaying()) {
+		return;
+	}
 	mouse_diff_x += x;
 	mouse_diff_y += y;
 }
 
+void ps2_save_restore(state_stream &stream)
+{
+	stream.field(state);
+	stream.field(ps2_port);
+	stream.field(port_clocks);
+	stream.field(buttons);
+	stream.field(mouse_diff_x);
+	stream.field(mouse_diff_y);
+}
+
 uint8_t mouse_read(uint8_t reg)
 {
 	return 0xff;
@@ -7,6 +7,8 @@
 
 #include <stdint.h>
 
+class state_stream;
+
 #define PS2_DATA_MASK (0x01)
 #define PS2_CLK_MASK (0x02)
 #define PS2_VIA_MASK (0x03)
@@ -19,9 +21,11 @@ typedef struct {
 extern ps2_port_t ps2_port[2];
 
 void ps2_buffer_add(int i, uint8_t byte);
+void ps2_buffer_replay(int i, uint8_t byte);
 void ps2_step(int i);
 void ps2_step(int i, int clocks);
 void ps2_autostep(int i);
+void ps2_save_restore(state_stream &state);
 
     // fake mouse
 void    mouse_button_down(int num);
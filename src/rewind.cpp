@@ -0,0 +1,284 @@
+#include "rewind.h"
+
+#include <algorithm>
+#include <deque>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "cpu/fake6502.h"
+#include "glue.h"
+#include "lz.h"
+#include "memory.h"
+#include "movie.h"
+#include "state.h"
+#include "vera/vera_video.h"
+
+// Before compression, a frame is
+//   uint32_t  core state size, then the core state
+//   uint32_t  number of pages, then for each page:
+//   uint32_t  page number (RAM pages first, then VRAM), then Page_size bytes of XOR delta
+// XORing a page with its delta gives the page as of the frame before.
+
+static constexpr uint32_t Page_size         = 256;
+static constexpr int      Frames_per_second = 60;
+
+// However many seconds were asked for, frames with lots of changes add up quickly.
+static constexpr size_t Max_bytes = 512 * 1024 * 1024;
+
+struct tracked_memory {
+	uint8_t             *data;
+	uint8_t             *dirty; // one flag per page
+	uint32_t             num_pages;
+	std::vector<uint8_t> shadow; // the contents as of the newest frame
+};
+
+struct rewind_frame {
+	std::vector<uint8_t> data; // compressed
+	uint32_t             size; // uncompressed
+	uint64_t             clockticks;
+	uint64_t             history; // movie_history_position() when it was taken
+};
+
+static bool                     Enabled    = false;
+static size_t                   Max_frames = 0;
+static tracked_memory           Memories[2];
+static std::deque<rewind_frame> Frames;
+static size_t                   Total_bytes = 0;
+
+static std::vector<uint8_t> Core;
+static std::vector<uint8_t> Record;
+static std::vector<uint8_t> Spare; // a dropped frame's buffer, to compress the next one into
+
+static void put32(std::vector<uint8_t> &dst, uint32_t value)
+{
+	const size_t offset = dst.size();
+	dst.resize(offset + sizeof(value));
+	memcpy(dst.data() + offset, &value, sizeof(value));
+}
+
+static uint32_t get32(const uint8_t *src)
+{
+	uint32_t value;
+	memcpy(&value, src, sizeof(value));
+	return value;
+}
+
+static void drop_frame(rewind_frame &frame)
+{
+	Total_bytes -= frame.data.size();
+	Spare = std::move(frame.data);
+}
+
+void rewind_init(int seconds)
+{
+	Enabled    = seconds > 0;
+	Max_frames = Enabled ? (size_t)seconds * Frames_per_second : 0;
+
+	if (Enabled) {
+		Memories[0].data      = RAM;
+		Memories[0].dirty     = memory_get_dirty_pages();
+		Memories[0].num_pages = RAM_SIZE / Page_size;
+		Memories[1].data      = vera_video_get_vram();
+		Memories[1].dirty     = vera_video_get_dirty_pages();
+		Memories[1].num_pages = VRAM_SIZE / Page_size;
+	}
+	for (tracked_memory &memory : Memories) {
+		if (Enabled) {
+			memory.shadow.resize(memory.num_pages * Page_size);
+		} else {
+			memory.shadow.clear();
+			memory.shadow.shrink_to_fit();
+		}
+	}
+
+	rewind_clear();
+}
+
+void rewind_clear()
+{
+	Frames.clear();
+	Total_bytes = 0;
+	movie_history_forget(movie_history_position());
+
+	if (!Enabled) {
+		return;
+	}
+	for (tracked_memory &memory : Memories) {
+		memcpy(memory.shadow.data(), memory.data, memory.num_pages * Page_size);
+		memset(memory.dirty, 0, memory.num_pages);
+	}
+}
+
+void rewind_capture()
+{
+	if (!Enabled) {
+		return;
+	}
+
+	machine_save_core_state(Core);
+
+	Record.clear();
+	put32(Record, (uint32_t)Core.size());
+	Record.insert(Record.end(), Core.begin(), Core.end());
+
+	const size_t num_pages_offset = Record.size();
+	uint32_t     num_pages        = 0;
+	uint32_t     first_page       = 0;
+	put32(Record, 0);
+
+	for (tracked_memory &memory : Memories) {
+		for (uint32_t page = 0; page < memory.num_pages; ++page) {
+			if (!memory.dirty[page]) {
+				continue;
+			}
+			memory.dirty[page] = 0;
+
+			const uint8_t *data   = memory.data + page * Page_size;
+			uint8_t       *shadow = memory.shadow.data() + page * Page_size;
+			if (memcmp(data, shadow, Page_size) == 0) {
+				continue;
+			}
+
+			put32(Record, first_page + page);
+			const size_t offset = Record.size();
+			Record.resize(offset + Page_size);
+			for (uint32_t i = 0; i < Page_size; ++i) {
+				Record[offset + i] = data[i] ^ shadow[i];
+			}
+			memcpy(shadow, data, Page_size);
+			++num_pages;
+		}
+		first_page += memory.num_pages;
+	}
+	memcpy(Record.data() + num_pages_offset, &num_pages, sizeof(num_pages));
+
+	rewind_frame frame;
+	frame.data = std::move(Spare);
+	lz_compress(Record.data(), Record.size(), frame.data);
+	frame.size       = (uint32_t)Record.size();
+	frame.clockticks = clockticks6502;
+	frame.history    = movie_history_position();
+
+	Total_bytes += frame.data.size();
+	Frames.push_back(std::move(frame));
+
+	if (Frames.size() > Max_frames || Total_bytes > Max_bytes) {
+		while (Frames.size() > Max_frames || Total_bytes > Max_bytes) {
+			drop_frame(Frames.front());
+			Frames.pop_front();
+		}
+		movie_history_forget(Frames.empty() ? movie_history_position() : Frames.front().history);
+	}
+}
+
+static bool unpack_frame(const rewind_frame &frame)
+{
+	Record.resize(frame.size);
+	return lz_decompress(frame.data.data(), frame.data.size(), Record.data(), Record.size());
+}
+
+static void undo_pages()
+{
+	const uint8_t *src = Record.data();
+	src += sizeof(uint32_t) + get32(src);
+
+	const uint32_t num_pages = get32(src);
+	src += sizeof(num_pages);
+
+	for (uint32_t i = 0; i < num_pages; ++i) {
+		uint32_t page = get32(src);
+		src += sizeof(page);
+
+		tracked_memory *memory = Memories;
+		while (page >= memory->num_pages) {
+			page -= memory->num_pages;
+			++memory;
+		}
+
+		uint8_t *shadow = memory->shadow.data() + page * Page_size;
+		for (uint32_t j = 0; j < Page_size; ++j) {
+			shadow[j] ^= src[j];
+		}
+		memcpy(memory->data + page * Page_size, shadow, Page_size);
+		src += Page_size;
+	}
+}
+
+static bool go_back_to(size_t target, bool replay_input)
+{
+	// A movie can't follow the machine back in time.
+	movie_stop();
+
+	// Put back whatever was written since the newest frame.
+	for (tracked_memory &memory : Memories) {
+		for (uint32_t page = 0; page < memory.num_pages; ++page) {
+			if (memory.dirty[page]) {
+				memcpy(memory.data + page * Page_size, memory.shadow.data() + page * Page_size, Page_size);
+				memory.dirty[page] = 0;
+			}
+		}
+	}
+
+	bool ok = true;
+	while (ok && Frames.size() - 1 > target) {
+		ok = unpack_frame(Frames.back());
+		if (ok) {
+			undo_pages();
+		}
+		drop_frame(Frames.back());
+		Frames.pop_back();
+	}
+	ok = ok && unpack_frame(Frames.back()) && machine_load_core_state(Record.data() + sizeof(uint32_t), get32(Record.data()));
+
+	if (!ok) {
+		printf("Rewind history is damaged, dropping it.\n");
+		rewind_clear();
+		return false;
+	}
+
+	if (replay_input) {
+		movie_history_replay(Frames.back().history);
+	} else {
+		movie_history_truncate(Frames.back().history);
+	}
+	return true;
+}
+
+bool rewind_step_back(int frames)
+{
+	if (!Enabled || Frames.empty()) {
+		return false;
+	}
+
+	// Having run on since the newest frame, going back to it is the first step.
+	if (clockticks6502 != Frames.back().clockticks) {
+		--frames;
+	} else if (Frames.size() == 1) {
+		return false;
+	}
+	return go_back_to((size_t)std::max<int64_t>(0, (int64_t)Frames.size() - 1 - frames), false);
+}
+
+bool rewind_replay_from(uint64_t clockticks)
+{
+	if (!Enabled || Frames.empty() || Frames.front().clockticks > clockticks) {
+		return false;
+	}
+
+	size_t target = Frames.size() - 1;
+	while (Frames[target].clockticks > clockticks) {
+		--target;
+	}
+	return go_back_to(target, true);
+}
+
+uint64_t rewind_frame_clockticks(int index)
+{
+	return Frames[index].clockticks;
+}
+
+int rewind_num_frames()
+{
+	return (int)Frames.size();
+}
@@ -0,0 +1,35 @@
+#pragma once
+#if !defined(REWIND_H)
+#	define REWIND_H
+
+#	include <stdint.h>
+
+// Keeps a snapshot of every frame for the last few seconds. The core state (CPU,
+// chip registers and so on) is stored whole. Of RAM and VRAM, only the 256-byte pages
+// written to during the frame are stored, as XOR deltas against the frame before.
+// Each frame is then LZ-compressed.
+
+// Keep up to this many seconds of frames. 0 turns rewinding off.
+void rewind_init(int seconds);
+
+// Forget all frames, e.g. after the machine was reset.
+void rewind_clear();
+
+// Call once per frame.
+void rewind_capture();
+
+// Goes back this many frames, or as far as the history reaches. Returns false if
+// there's nothing to go back to.
+bool rewind_step_back(int frames);
+
+int rewind_num_frames();
+
+// The clock each frame was taken at, oldest first.
+uint64_t rewind_frame_clockticks(int index);
+
+// Goes back to the newest frame taken at or before the clock, and has the input that
+// followed it fed again (see movie.h), so running on retraces the same path. This is
+// what the debugger steps backwards with.
+bool rewind_replay_from(uint64_t clockticks);
+
+#endif
@@ -2,6 +2,7 @@
 
 #include <string.h>
 #include <algorithm>
+#include <atomic>
 
 template <typename T, int SIZE, bool ALLOW_OVERWRITE = true>
 class ring_buffer
@@ -31,6 +32,12 @@ public:
 		m_elems[index] = item;
 	}
 
+	void clear()
+	{
+		m_oldest = 0;
+		m_count  = 0;
+	}
+
 	const T &get_oldest() const
 	{
 		return m_elems[m_oldest];
@@ -221,3 +228,55 @@ private:
 	volatile size_t m_count;
 	T      m_elems[SIZE];
 };
+
+// Lock-free single-producer, single-consumer queue. Slots are filled and drained
+// in place: the producer calls begin_write()/end_write(), the consumer
+// begin_read()/end_read(). Each side must only be used from one thread.
+template <typename T, int SIZE>
+class spsc_queue
+{
+public:
+	spsc_queue()
+	    : m_read(0), m_write(0)
+	{
+		// Nothing to do.
+	}
+
+	T *begin_write()
+	{
+		const size_t write = m_write.load(std::memory_order_relaxed);
+		if (write - m_read.load(std::memory_order_acquire) >= SIZE) {
+			return nullptr;
+		}
+		return &m_elems[write % SIZE];
+	}
+
+	void end_write()
+	{
+		m_write.store(m_write.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	T *begin_read()
+	{
+		const size_t read = m_read.load(std::memory_order_relaxed);
+		if (read == m_write.load(std::memory_order_acquire)) {
+			return nullptr;
+		}
+		return &m_elems[read % SIZE];
+	}
+
+	void end_read()
+	{
+		m_read.store(m_read.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	size_t count() const
+	{
+		return m_write.load(std::memory_order_acquire) - m_read.load(std::memory_order_acquire);
+	}
+
+private:
+	std::atomic<size_t> m_read;
+	std::atomic<size_t> m_write;
+	T                   m_elems[SIZE];
+};
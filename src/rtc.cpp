@@ -10,6 +10,7 @@
 
 #include "rtc.h"
 #include "glue.h"
+#include "state.h"
 #include <stdbool.h>
 #include <stdio.h>
 #include <time.h>
@@ -40,16 +41,7 @@ void rtc_init(bool set_system_time)
 	clocks = 0;
 
 	if (set_system_time) {
-		running      = true;
-		time_t    t  = time(NULL);
-		struct tm tm = *localtime(&t);
-		seconds      = tm.tm_sec;
-		minutes      = tm.tm_min;
-		hours        = tm.tm_hour;
-		day_of_week  = 1;
-		day          = tm.tm_mday;
-		month        = tm.tm_mon + 1;
-		year         = tm.tm_year - 100;
+		rtc_set_system_time();
 	} else {
 		running     = false; // yes, the MCP7940N starts out this way!
 		seconds     = 0;
@@ -62,6 +54,36 @@ void rtc_init(bool set_system_time)
 	}
 }
 
+void rtc_set_system_time()
+{
+	running      = true;
+	time_t    t  = time(NULL);
+	struct tm tm = *localtime(&t);
+	seconds      = tm.tm_sec;
+	minutes      = tm.tm_min;
+	hours        = tm.tm_hour;
+	day_of_week  = 1;
+	day          = tm.tm_mday;
+	month        = tm.tm_mon + 1;
+	year         = tm.tm_year - 100;
+}
+
+void rtc_save_restore(state_stream &state)
+{
+	state.field(running);
+	state.field(vbaten);
+	state.field(h24);
+	state.field(clocks);
+	state.field(seconds);
+	state.field(minutes);
+	state.field(hours);
+	state.field(day_of_week);
+	state.field(day);
+	state.field(month);
+	state.field(year);
+	state.field(nvram);
+}
+
 static uint8_t days_per_month[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
 
 bool is_leap_year()
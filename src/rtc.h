@@ -7,6 +7,8 @@
 
 #include <stdint.h>
 
+class state_stream;
+
 extern bool    nvram_dirty;
 extern uint8_t nvram[0x40];
 
@@ -15,5 +17,6 @@ void    rtc_set_system_time();
 void    rtc_step(int c);
 uint8_t rtc_read(uint8_t offset);
 void    rtc_write(uint8_t offset, uint8_t value);
+void    rtc_save_restore(state_stream &state);
 
 #endif
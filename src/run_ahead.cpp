@@ -0,0 +1,71 @@
+#include "run_ahead.h"
+
+#include <vector>
+
+#include "audio.h"
+#include "call_stack.h"
+#include "cpu/fake6502.h"
+#include "debugger.h"
+#include "display.h"
+#include "glue.h"
+#include "sound_recorder.h"
+#include "state.h"
+#include "trace.h"
+#include "vera/sdcard.h"
+#include "vera/vera_video.h"
+#include "ym2151/ym2151.h"
+
+static std::vector<uint8_t> Saved_state;
+
+static void run_frame()
+{
+	for (;;) {
+		const uint64_t old_clockticks6502 = clockticks6502;
+		step6502();
+		const uint8_t clocks    = (uint8_t)(clockticks6502 - old_clockticks6502);
+		const bool    new_frame = vera_video_step(MHZ, clocks);
+		audio_render_silent(clocks);
+
+		if (vera_video_get_irq_out() || YM_irq()) {
+			if (!(status & 4)) {
+				irq6502();
+			}
+		}
+
+		if (new_frame) {
+			return;
+		}
+	}
+}
+
+void run_ahead_display(int frames)
+{
+	// In warp mode, nobody is waiting on input. The sound log would get the
+	// rolled back frames' register writes.
+	if (frames <= 0 || Options.warp_factor > 0 || sound_recorder_is_enabled()) {
+		display_process();
+		return;
+	}
+
+	machine_save_state(Saved_state);
+	sdcard_set_discard_writes(true);
+	debugger_enable_watchpoints(false);
+	call_stack_enable(false);
+	trace_suspend(true);
+
+	// Only the frame that gets shown needs drawing; the others are cheat frames.
+	const int cheat_mask = vera_video_get_cheat_mask();
+	for (int i = 0; i < frames; ++i) {
+		vera_video_set_cheat_mask(i + 1 < frames ? ~0 : cheat_mask);
+		run_frame();
+	}
+	vera_video_set_cheat_mask(cheat_mask);
+
+	display_process();
+
+	debugger_enable_watchpoints(true);
+	sdcard_set_discard_writes(false);
+	machine_load_state(Saved_state.data(), Saved_state.size());
+	call_stack_enable(true);
+	trace_suspend(false);
+}
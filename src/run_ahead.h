@@ -0,0 +1,12 @@
+#pragma once
+#if !defined(RUN_AHEAD_H)
+#	define RUN_AHEAD_H
+
+// Hides a game's own input lag: before a frame is shown, the machine runs on for a
+// few more frames with the input as it is now, the last of those is shown instead,
+// and the machine goes back to where it was. Only the real frames are heard.
+
+// Call instead of display_process() once a frame is complete.
+void run_ahead_display(int frames);
+
+#endif
@@ -9,7 +9,9 @@
 #include "overlay/overlay.h"
 #include "joystick.h"
 #include "keyboard.h"
+#include "movie.h"
 #include "ps2.h"
+#include "rewind.h"
 #include "vera/sdcard.h"
 #include "options.h"
 
@@ -80,7 +82,11 @@ bool sdl_events_update()
 								consumed = true;
 								break;
 							case SDLK_r:
-								machine_reset();
+								// While a movie plays, it is the only source of input.
+								if (!movie_is_replaying()) {
+									movie_record_reset();
+									machine_reset();
+								}
 								consumed = true;
 								break;
 							case SDLK_v:
@@ -105,6 +111,11 @@ bool sdl_events_update()
 								sdcard_detach();
 								consumed = true;
 								break;
+							case SDLK_BACKSPACE:
+								// Held down, key repeat rewinds at a few times real time.
+								rewind_step_back(4);
+								consumed = true;
+								break;
 						}
 					}
 					if (event.key.keysym.scancode == LSHORTCUT_KEY || event.key.keysym.scancode == RSHORTCUT_KEY) {
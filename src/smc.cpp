@@ -7,6 +7,7 @@
 #include "smc.h"
 
 #include "glue.h"
+#include "state.h"
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -55,3 +56,9 @@ void smc_write(uint8_t a, uint8_t v)
 			break;
 	}
 }
+
+void smc_save_restore(state_stream &state)
+{
+	state.field(power_led);
+	state.field(activity_led);
+}
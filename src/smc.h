@@ -7,10 +7,13 @@
 
 #include <stdint.h>
 
+class state_stream;
+
 extern uint8_t power_led;
 extern uint8_t activity_led;
 
 uint8_t smc_read(uint8_t offset);
 void    smc_write(uint8_t offset, uint8_t value);
+void    smc_save_restore(state_stream &state);
 
 #endif
@@ -0,0 +1,498 @@
+#include "sound_recorder.h"
+
+#include <vector>
+
+#include "SDL.h"
+#include "cpu/fake6502.h"
+#include "glue.h"
+#include "vera/vera_pcm.h"
+#include "vera/vera_psg.h"
+#include "vera/vera_video.h"
+#include "ym2151/ym2151.h"
+
+// Sound recorder states
+enum sound_recorder_state_t {
+	RECORD_SOUND_DISABLED = 0,
+	RECORD_SOUND_PAUSED,
+	RECORD_SOUND_RECORDING
+};
+
+static sound_recorder_state_t Sound_record_state = RECORD_SOUND_DISABLED;
+static char *                 Sound_path         = nullptr;
+
+static constexpr uint32_t Vgm_sample_rate = 44100;
+static constexpr uint32_t Cpu_clock_rate  = MHZ * 1000000;
+
+static constexpr uint8_t Vgm_cmd_ym2151    = 0x54;
+static constexpr uint8_t Vgm_cmd_wait      = 0x61;
+static constexpr uint8_t Vgm_cmd_wait_735  = 0x62;
+static constexpr uint8_t Vgm_cmd_wait_882  = 0x63;
+static constexpr uint8_t Vgm_cmd_end       = 0x66;
+static constexpr uint8_t Vgm_cmd_data      = 0x67;
+static constexpr uint8_t Vgm_cmd_wait_n    = 0x70;
+static constexpr uint8_t Vgm_cmd_vera_psg  = 0xD7;
+static constexpr uint8_t Vgm_cmd_vera_reg  = 0xD8;
+static constexpr uint8_t Vgm_cmd_vera_fifo = 0xD9;
+
+static constexpr uint8_t Vera_audio_ctrl = 0x1B;
+static constexpr uint8_t Vera_audio_rate = 0x1C;
+static constexpr uint8_t Vera_audio_data = 0x1D;
+
+static constexpr uint32_t Psg_registers_address = 0x1F9C0;
+
+#pragma pack(push, 1)
+struct vgm_header {
+	char     ident[4]          = { 'V', 'g', 'm', ' ' };
+	uint32_t eof_offset        = 0;
+	uint32_t version           = 0x171;
+	uint32_t sn76489_clock     = 0;
+	uint32_t ym2413_clock      = 0;
+	uint32_t gd3_offset        = 0;
+	uint32_t total_samples     = 0;
+	uint32_t loop_offset       = 0;
+	uint32_t loop_samples      = 0;
+	uint32_t rate              = 60;
+	uint16_t sn76489_feedback  = 0;
+	uint8_t  sn76489_width     = 0;
+	uint8_t  sn76489_flags     = 0;
+	uint32_t ym2612_clock      = 0;
+	uint32_t ym2151_clock      = YM_CLOCK_RATE;
+	uint32_t data_offset       = 0x100 - 0x34;
+	uint8_t  reserved[0x100 - 0x38] = {};
+};
+#pragma pack(pop)
+
+static_assert(sizeof(vgm_header) == 0x100, "VGM header must be 256 bytes");
+
+class sound_recorder
+{
+public:
+	void begin(const char *path);
+	void end();
+
+	void command(uint8_t cmd, uint8_t a, uint8_t b, uint8_t c);
+	void command(uint8_t cmd, uint8_t a, uint8_t b);
+	void fifo(uint8_t value);
+
+	bool is_open() const
+	{
+		return vgm_file != nullptr;
+	}
+
+private:
+	void sync();
+	void flush_fifo();
+	void flush();
+
+	vgm_header           header;
+	std::vector<uint8_t> buffer;
+	uint32_t             bytes_written = 0;
+
+	uint64_t base_clock    = 0; // the clock at which the log had base_samples
+	uint64_t base_samples  = 0;
+	uint64_t last_clock    = 0;
+	uint64_t samples_total = 0;
+
+	uint8_t pending_fifo[3];
+	int     pending_fifo_count = 0;
+
+	SDL_RWops *vgm_file = nullptr;
+};
+
+void sound_recorder::begin(const char *path)
+{
+	vgm_file = SDL_RWFromFile(path, "wb");
+	if (vgm_file == nullptr) {
+		printf("Cannot write to %s!\n", path);
+		return;
+	}
+
+	header = vgm_header();
+	if (SDL_RWwrite(vgm_file, &header, sizeof(header), 1) == 0) {
+		SDL_RWclose(vgm_file);
+		vgm_file = nullptr;
+		return;
+	}
+
+	buffer.clear();
+	buffer.reserve(64 * 1024);
+	bytes_written      = sizeof(header);
+	base_clock         = clockticks6502;
+	base_samples       = 0;
+	last_clock         = clockticks6502;
+	samples_total      = 0;
+	pending_fifo_count = 0;
+
+	// Capture the current state so the log plays back correctly when started mid-song.
+	// Skip the test register, key-on and the timer registers, which would have side effects.
+	for (int reg = 0x0F; reg < 0x100; ++reg) {
+		if (reg == 0x08 || (reg >= 0x10 && reg <= 0x14)) {
+			continue;
+		}
+		command(Vgm_cmd_ym2151, static_cast<uint8_t>(reg), YM_debug_read(static_cast<uint8_t>(reg)));
+	}
+	for (int reg = 0; reg < 64; ++reg) {
+		command(Vgm_cmd_vera_psg, static_cast<uint8_t>(reg), vera_video_space_read(Psg_registers_address + reg), 0);
+	}
+	command(Vgm_cmd_vera_reg, Vera_audio_ctrl, pcm_read_ctrl() & 0x3F, 0);
+	command(Vgm_cmd_vera_reg, Vera_audio_rate, pcm_read_rate(), 0);
+}
+
+void sound_recorder::end()
+{
+	if (vgm_file == nullptr) {
+		return;
+	}
+
+	sync();
+	flush_fifo();
+	buffer.push_back(Vgm_cmd_end);
+	flush();
+
+	if (vgm_file != nullptr) {
+		header.eof_offset    = bytes_written - 4;
+		header.total_samples = static_cast<uint32_t>(samples_total);
+		SDL_RWseek(vgm_file, 0, RW_SEEK_SET);
+		SDL_RWwrite(vgm_file, &header, sizeof(header), 1);
+		SDL_RWclose(vgm_file);
+		vgm_file = nullptr;
+	}
+}
+
+void sound_recorder::sync()
+{
+	// Rewinding, loading a state or stepping back in the debugger takes the clock back.
+	// The log goes on from where it is, as if the machine had carried on from there.
+	if (clockticks6502 < last_clock) {
+		base_clock   = clockticks6502;
+		base_samples = samples_total;
+	}
+	last_clock = clockticks6502;
+
+	const uint64_t target = base_samples + (clockticks6502 - base_clock) * Vgm_sample_rate / Cpu_clock_rate;
+	if (target <= samples_total) {
+		return;
+	}
+
+	// FIFO bytes are flushed before the wait, so they keep the time they were written at.
+	flush_fifo();
+
+	uint64_t wait = target - samples_total;
+	while (wait > 0) {
+		if (wait <= 16) {
+			buffer.push_back(static_cast<uint8_t>(Vgm_cmd_wait_n + wait - 1));
+			wait = 0;
+		} else if (wait == 735) {
+			buffer.push_back(Vgm_cmd_wait_735);
+			wait = 0;
+		} else if (wait == 882) {
+			buffer.push_back(Vgm_cmd_wait_882);
+			wait = 0;
+		} else {
+			const uint16_t n = wait > 0xFFFF ? 0xFFFF : static_cast<uint16_t>(wait);
+			buffer.push_back(Vgm_cmd_wait);
+			buffer.push_back(n & 0xFF);
+			buffer.push_back(n >> 8);
+			wait -= n;
+		}
+	}
+	samples_total = target;
+}
+
+void sound_recorder::command(uint8_t cmd, uint8_t a, uint8_t b)
+{
+	sync();
+	flush_fifo();
+	buffer.push_back(cmd);
+	buffer.push_back(a);
+	buffer.push_back(b);
+	if (buffer.size() >= 60 * 1024) {
+		flush();
+	}
+}
+
+void sound_recorder::command(uint8_t cmd, uint8_t a, uint8_t b, uint8_t c)
+{
+	sync();
+	flush_fifo();
+	buffer.push_back(cmd);
+	buffer.push_back(a);
+	buffer.push_back(b);
+	buffer.push_back(c);
+	if (buffer.size() >= 60 * 1024) {
+		flush();
+	}
+}
+
+void sound_recorder::fifo(uint8_t value)
+{
+	sync();
+	pending_fifo[pending_fifo_count++] = value;
+	if (pending_fifo_count == 3) {
+		buffer.push_back(Vgm_cmd_vera_fifo);
+		buffer.push_back(pending_fifo[0]);
+		buffer.push_back(pending_fifo[1]);
+		buffer.push_back(pending_fifo[2]);
+		pending_fifo_count = 0;
+		if (buffer.size() >= 60 * 1024) {
+			flush();
+		}
+	}
+}
+
+void sound_recorder::flush_fifo()
+{
+	for (int i = 0; i < pending_fifo_count; ++i) {
+		buffer.push_back(Vgm_cmd_vera_reg);
+		buffer.push_back(Vera_audio_data);
+		buffer.push_back(pending_fifo[i]);
+		buffer.push_back(0);
+	}
+	pending_fifo_count = 0;
+}
+
+void sound_recorder::flush()
+{
+	if (vgm_file != nullptr && !buffer.empty()) {
+		if (SDL_RWwrite(vgm_file, buffer.data(), buffer.size(), 1) == 0) {
+			printf("Error writing sound log, recording stopped.\n");
+			SDL_RWclose(vgm_file);
+			vgm_file = nullptr;
+		} else {
+			bytes_written += static_cast<uint32_t>(buffer.size());
+		}
+	}
+	buffer.clear();
+}
+
+static sound_recorder Sound_recorder;
+
+void sound_recorder_shutdown()
+{
+	if (Sound_record_state == RECORD_SOUND_RECORDING) {
+		Sound_recorder.end();
+	}
+}
+
+void sound_recorder_set(sound_recorder_command_t command)
+{
+	if (Sound_record_state != RECORD_SOUND_DISABLED) {
+		switch (command) {
+			case RECORD_SOUND_PAUSE:
+				if (Sound_record_state == RECORD_SOUND_RECORDING) {
+					Sound_recorder.end();
+				}
+				Sound_record_state = RECORD_SOUND_PAUSED;
+				break;
+			case RECORD_SOUND_RECORD:
+				if (Sound_record_state != RECORD_SOUND_RECORDING) {
+					Sound_record_state = RECORD_SOUND_RECORDING;
+					Sound_recorder.begin(Sound_path);
+				}
+				break;
+			default:
+				printf("Unknown command %d passed to sound_recorder_set.\n", (int)command);
+				break;
+		}
+	}
+}
+
+uint8_t sound_recorder_get_state()
+{
+	return (uint8_t)Sound_record_state;
+}
+
+bool sound_recorder_is_enabled()
+{
+	return Sound_record_state != RECORD_SOUND_DISABLED;
+}
+
+void sound_recorder_set_path(const char *path)
+{
+	if (Sound_record_state == RECORD_SOUND_RECORDING) {
+		Sound_recorder.end();
+	}
+
+	if (Sound_path != nullptr) {
+		delete[] Sound_path;
+		Sound_path = nullptr;
+	}
+
+	if (path != nullptr) {
+		Sound_path = new char[strlen(path) + 1];
+		strcpy(Sound_path, path);
+
+		const size_t len = strlen(Sound_path);
+		if (len >= 5 && !strcmp(Sound_path + len - 5, ",wait")) {
+			Sound_path[len - 5] = 0;
+			Sound_record_state  = RECORD_SOUND_PAUSED;
+		} else {
+			Sound_record_state = RECORD_SOUND_RECORDING;
+			Sound_recorder.begin(Sound_path);
+		}
+	} else {
+		Sound_record_state = RECORD_SOUND_DISABLED;
+	}
+}
+
+void sound_recorder_ym_write(uint8_t reg, uint8_t value)
+{
+	if (Sound_record_state == RECORD_SOUND_RECORDING && Sound_recorder.is_open()) {
+		Sound_recorder.command(Vgm_cmd_ym2151, reg, value);
+	}
+}
+
+void sound_recorder_psg_write(uint8_t reg, uint8_t value)
+{
+	if (Sound_record_state == RECORD_SOUND_RECORDING && Sound_recorder.is_open()) {
+		Sound_recorder.command(Vgm_cmd_vera_psg, reg & 0x3F, value, 0);
+	}
+}
+
+void sound_recorder_pcm_write(uint8_t reg, uint8_t value)
+{
+	if (Sound_record_state == RECORD_SOUND_RECORDING && Sound_recorder.is_open()) {
+		if (reg == Vera_audio_data) {
+			Sound_recorder.fifo(value);
+		} else {
+			Sound_recorder.command(Vgm_cmd_vera_reg, reg, value, 0);
+		}
+	}
+}
+
+//
+// Replay
+//
+
+static std::vector<uint8_t> Replay_data;
+static size_t               Replay_pos       = 0;
+static uint64_t             Replay_remainder = 0;
+
+bool sound_recorder_replay_open(const char *path)
+{
+	sound_recorder_replay_close();
+
+	SDL_RWops *f = SDL_RWFromFile(path, "rb");
+	if (f == nullptr) {
+		printf("Cannot open sound log %s!\n", path);
+		return false;
+	}
+
+	const Sint64 size = SDL_RWsize(f);
+	if (size > static_cast<Sint64>(sizeof(vgm_header))) {
+		Replay_data.resize(static_cast<size_t>(size));
+		if (SDL_RWread(f, Replay_data.data(), Replay_data.size(), 1) == 0) {
+			Replay_data.clear();
+		}
+	}
+	SDL_RWclose(f);
+
+	if (Replay_data.empty() || memcmp(Replay_data.data(), "Vgm ", 4) != 0) {
+		printf("%s is not a VGM file.\n", path);
+		Replay_data.clear();
+		return false;
+	}
+
+	auto read32 = [](const uint8_t *p) -> uint32_t {
+		return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+	};
+
+	const uint32_t version     = read32(&Replay_data[0x08]);
+	const uint32_t data_offset = version >= 0x150 ? read32(&Replay_data[0x34]) : 0;
+
+	Replay_pos       = data_offset ? 0x34 + data_offset : 0x40;
+	Replay_remainder = 0;
+	return Replay_pos < Replay_data.size();
+}
+
+static int replay_wait(uint32_t samples)
+{
+	// Carry the fractional clocks over, so long logs don't drift.
+	const uint64_t total = samples * static_cast<uint64_t>(Cpu_clock_rate) + Replay_remainder;
+	Replay_remainder     = total % Vgm_sample_rate;
+	return static_cast<int>(total / Vgm_sample_rate);
+}
+
+int sound_recorder_replay_step()
+{
+	const uint8_t *data = Replay_data.data();
+	const size_t   size = Replay_data.size();
+
+	auto has = [&](size_t n) {
+		return Replay_pos + n <= size;
+	};
+
+	while (has(1)) {
+		const uint8_t cmd = data[Replay_pos];
+		const uint8_t *op = data + Replay_pos + 1;
+
+		if (cmd == Vgm_cmd_end) {
+			break;
+		} else if (cmd == Vgm_cmd_ym2151 && has(3)) {
+			YM_write(0, op[0]);
+			YM_write(1, op[1]);
+			Replay_pos += 3;
+		} else if (cmd == Vgm_cmd_vera_psg && has(4)) {
+			psg_writereg(op[0], op[1]);
+			Replay_pos += 4;
+		} else if (cmd == Vgm_cmd_vera_reg && has(4)) {
+			switch (op[0]) {
+				case Vera_audio_ctrl: pcm_write_ctrl(op[1]); break;
+				case Vera_audio_rate: pcm_write_rate(op[1]); break;
+				case Vera_audio_data: pcm_write_fifo(op[1]); break;
+				default: break;
+			}
+			Replay_pos += 4;
+		} else if (cmd == Vgm_cmd_vera_fifo && has(4)) {
+			pcm_write_fifo(op[0]);
+			pcm_write_fifo(op[1]);
+			pcm_write_fifo(op[2]);
+			Replay_pos += 4;
+		} else if (cmd == Vgm_cmd_wait && has(3)) {
+			Replay_pos += 3;
+			return replay_wait(op[0] | (op[1] << 8));
+		} else if (cmd == Vgm_cmd_wait_735) {
+			Replay_pos += 1;
+			return replay_wait(735);
+		} else if (cmd == Vgm_cmd_wait_882) {
+			Replay_pos += 1;
+			return replay_wait(882);
+		} else if ((cmd & 0xF0) == Vgm_cmd_wait_n || (cmd & 0xF0) == 0x80) {
+			// 0x8n is "YM2612 DAC write, then wait n", which we can only honor as a wait.
+			Replay_pos += 1;
+			const uint32_t n = (cmd & 0xF0) == Vgm_cmd_wait_n ? (cmd & 0x0F) + 1 : (cmd & 0x0F);
+			if (n > 0) {
+				return replay_wait(n);
+			}
+		} else if (cmd == Vgm_cmd_data && has(7)) {
+			const uint32_t len = op[2] | (op[3] << 8) | (op[4] << 16) | (static_cast<uint32_t>(op[5]) << 24);
+			Replay_pos += 7 + static_cast<size_t>(len);
+		} else {
+			// Skip commands for chips we don't have, by their documented operand counts.
+			size_t len = 1;
+			if (cmd >= 0x30 && cmd <= 0x3F) {
+				len = 2;
+			} else if ((cmd >= 0x40 && cmd <= 0x4E) || (cmd >= 0x51 && cmd <= 0x5F) || (cmd >= 0xA0 && cmd <= 0xBF)) {
+				len = 3;
+			} else if (cmd == 0x4F || cmd == 0x50) {
+				len = 2;
+			} else if (cmd >= 0xC0 && cmd <= 0xDF) {
+				len = 4;
+			} else if (cmd >= 0xE0) {
+				len = 5;
+			}
+			Replay_pos += len;
+		}
+	}
+
+	Replay_pos = size;
+	return -1;
+}
+
+void sound_recorder_replay_close()
+{
+	Replay_data.clear();
+	Replay_data.shrink_to_fit();
+	Replay_pos       = 0;
+	Replay_remainder = 0;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#if !defined(SOUND_RECORDER_H)
+#	define SOUND_RECORDER_H
+
+//=============================================
+//
+// Sound register capture
+//
+// Every YM2151, VERA PSG and VERA PCM register write is logged with its
+// CPU cycle timestamp into a VGM (v1.71) file. The YM2151 part is plain
+// VGM and plays in any OPM-capable VGM player; VERA writes use commands
+// from VGM's reserved three-operand range, which players skip:
+//
+//   0xD7 rr dd 00  VERA PSG register rr = dd
+//   0xD8 rr dd 00  VERA register rr = dd ($1B: AUDIO_CTRL, $1C: AUDIO_RATE, $1D: AUDIO_DATA)
+//   0xD9 d0 d1 d2  Three consecutive AUDIO_DATA (PCM FIFO) writes
+//
+//---------------------------------------------
+
+enum sound_recorder_command_t {
+	RECORD_SOUND_PAUSE = 0,
+	RECORD_SOUND_RECORD,
+};
+
+void sound_recorder_shutdown();
+
+void    sound_recorder_set(sound_recorder_command_t command);
+uint8_t sound_recorder_get_state();
+
+// True once a log file was set, whether or not recording is paused.
+bool sound_recorder_is_enabled();
+
+void sound_recorder_set_path(const char *path);
+
+void sound_recorder_ym_write(uint8_t reg, uint8_t value);
+void sound_recorder_psg_write(uint8_t reg, uint8_t value);
+void sound_recorder_pcm_write(uint8_t reg, uint8_t value);
+
+// Replay a captured log through the synthesis chain, without running the CPU.
+// sound_recorder_replay_step() applies register writes up to the next wait and
+// returns its length in CPU clocks, or -1 once the log has ended.
+bool sound_recorder_replay_open(const char *path);
+int  sound_recorder_replay_step();
+void sound_recorder_replay_close();
+
+#endif
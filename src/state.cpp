@@ -0,0 +1,158 @@
+#include "state.h"
+
+#include <SDL.h>
+
+#include "audio.h"
+#include "call_stack.h"
+#include "cpu/fake6502.h"
+#include "glue.h"
+#include "i2c.h"
+#include "joystick.h"
+#include "mapped_file.h"
+#include "memory.h"
+#include "movie.h"
+#include "noise.h"
+#include "ps2.h"
+#include "rewind.h"
+#include "rtc.h"
+#include "smc.h"
+#include "vera/sdcard.h"
+#include "vera/vera_pcm.h"
+#include "vera/vera_psg.h"
+#include "vera/vera_spi.h"
+#include "vera/vera_video.h"
+#include "via.h"
+#include "ym2151/ym2151.h"
+
+// Bump whenever a module adds, removes or reorders a field.
+static constexpr uint32_t State_version  = 5;
+static constexpr char     State_magic[4] = { 'B', '1', '6', 'S' };
+
+struct state_header {
+	char     magic[4];
+	uint32_t version;
+	uint32_t num_ram_banks;
+	uint32_t size; // of the whole snapshot, header included
+};
+
+static void machine_save_restore(state_stream &state)
+{
+	save_restore6502(state);
+	memory_save_restore(state);
+	vera_video_save_restore(state);
+	vera_spi_save_restore(state);
+	sdcard_save_restore(state);
+	psg_save_restore(state);
+	pcm_save_restore(state);
+	audio_save_restore(state);
+	YM_save_restore(state);
+	via_save_restore(state);
+	ps2_save_restore(state);
+	joystick_save_restore(state);
+	i2c_save_restore(state);
+	smc_save_restore(state);
+	rtc_save_restore(state);
+	noise_save_restore(state);
+}
+
+void machine_save_state(std::vector<uint8_t> &buffer)
+{
+	state_stream state(buffer);
+
+	state_header header;
+	memcpy(header.magic, State_magic, sizeof(header.magic));
+	header.version       = State_version;
+	header.num_ram_banks = Options.num_ram_banks;
+	header.size          = 0;
+	state.field(header);
+
+	machine_save_restore(state);
+
+	header.size = (uint32_t)buffer.size();
+	memcpy(buffer.data(), &header, sizeof(header));
+}
+
+bool machine_load_state(const uint8_t *data, size_t size)
+{
+	state_header header;
+	if (size < sizeof(header)) {
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+
+	if (memcmp(header.magic, State_magic, sizeof(header.magic)) != 0 || header.size != size) {
+		printf("Not a machine state, or truncated.\n");
+		return false;
+	}
+	if (header.version != State_version) {
+		printf("Machine state version %u is not supported (expected %u).\n", header.version, State_version);
+		return false;
+	}
+	if (header.num_ram_banks != (uint32_t)Options.num_ram_banks) {
+		printf("Machine state has %u KB of banked RAM, but the machine has %d KB.\n", header.num_ram_banks * 8, Options.num_ram_banks * 8);
+		return false;
+	}
+
+	state_stream state(data + sizeof(header), size - sizeof(header));
+
+	audio_lock_scope lock;
+	machine_save_restore(state);
+	call_stack_reset();
+	return state.good();
+}
+
+void machine_save_core_state(std::vector<uint8_t> &buffer)
+{
+	state_stream state(buffer, false);
+	machine_save_restore(state);
+}
+
+bool machine_load_core_state(const uint8_t *data, size_t size)
+{
+	state_stream state(data, size, false);
+
+	audio_lock_scope lock;
+	machine_save_restore(state);
+	call_stack_reset();
+	return state.good();
+}
+
+bool machine_save_state_file(const char *path)
+{
+	std::vector<uint8_t> state;
+	machine_save_state(state);
+
+	SDL_RWops *f = SDL_RWFromFile(path, "wb");
+	if (f == nullptr) {
+		printf("Cannot write to %s!\n", path);
+		return false;
+	}
+	const bool written = SDL_RWwrite(f, state.data(), state.size(), 1) == 1;
+	SDL_RWclose(f);
+
+	if (!written) {
+		printf("Cannot write to %s!\n", path);
+		return false;
+	}
+	printf("Saved machine state to %s.\n", path);
+	return true;
+}
+
+bool machine_load_state_file(const char *path)
+{
+	mapped_file f;
+	if (!f.open(path, false)) {
+		printf("Cannot open %s!\n", path);
+		return false;
+	}
+	// A movie can't follow the machine to another state.
+	movie_stop();
+	if (!machine_load_state(f.data(), f.size())) {
+		printf("Cannot load machine state from %s.\n", path);
+		return false;
+	}
+	// The rewind buffer's history doesn't lead up to the loaded state.
+	rewind_clear();
+	printf("Loaded machine state from %s.\n", path);
+	return true;
+}
@@ -0,0 +1,92 @@
+#pragma once
+#if !defined(STATE_H)
+#	define STATE_H
+
+#	include <stddef.h>
+#	include <stdint.h>
+#	include <string.h>
+#	include <type_traits>
+#	include <vector>
+
+// Saves machine state into a byte buffer, or restores it from one. Every module
+// passes its fields through a single <module>_save_restore(state_stream &), so
+// the saving and restoring sides can't get out of step with each other.
+class state_stream
+{
+public:
+	// Saving: buffer is cleared first, but keeps its capacity.
+	explicit state_stream(std::vector<uint8_t> &buffer, bool with_memory = true)
+	    : m_buffer(&buffer),
+	      m_with_memory(with_memory)
+	{
+		buffer.clear();
+	}
+
+	// Restoring from [data, data + size).
+	state_stream(const uint8_t *data, size_t size, bool with_memory = true)
+	    : m_data(data),
+	      m_size(size),
+	      m_with_memory(with_memory)
+	{
+	}
+
+	bool saving() const { return m_buffer != nullptr; }
+
+	// False once a restore ran past the end of the data.
+	bool good() const { return m_good; }
+
+	void bytes(void *data, size_t size)
+	{
+		if (m_buffer != nullptr) {
+			const size_t offset = m_buffer->size();
+			m_buffer->resize(offset + size);
+			memcpy(m_buffer->data() + offset, data, size);
+		} else if (m_good && size <= m_size - m_offset) {
+			memcpy(data, m_data + m_offset, size);
+			m_offset += size;
+		} else {
+			m_good = false;
+		}
+	}
+
+	template <typename T>
+	void field(T &data)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "state fields are copied as raw bytes");
+		bytes(&data, sizeof(data));
+	}
+
+	// RAM, VRAM and the framebuffer. The rewind buffer keeps track of those page
+	// by page, so its streams leave them out.
+	void memory(void *data, size_t size)
+	{
+		if (m_with_memory) {
+			bytes(data, size);
+		}
+	}
+
+private:
+	std::vector<uint8_t> *m_buffer = nullptr;
+
+	const uint8_t *m_data   = nullptr;
+	size_t         m_size   = 0;
+	size_t         m_offset = 0;
+	bool           m_good   = true;
+
+	bool m_with_memory;
+};
+
+// Snapshot of the whole machine. Loading fails, leaving the machine untouched,
+// if the snapshot was taken with a different state version or RAM size, or is
+// truncated. An attached SD card's contents aren't part of the snapshot.
+void machine_save_state(std::vector<uint8_t> &buffer);
+bool machine_load_state(const uint8_t *data, size_t size);
+
+// Everything but the memories, for the rewind buffer.
+void machine_save_core_state(std::vector<uint8_t> &buffer);
+bool machine_load_core_state(const uint8_t *data, size_t size);
+
+bool machine_save_state_file(const char *path);
+bool machine_load_state_file(const char *path);
+
+#endif
@@ -159,7 +159,14 @@ bool symbols_load_file(const std::string &file_path, symbol_bank_type bank)
 				saddr_str >> std::hex;
 				saddr_str >> addr;
 			}
-			debugger_add_breakpoint(addr);
+
+			// Whatever follows the address is the condition.
+			std::string condition;
+			std::getline(sline, condition);
+			const size_t start = condition.find_first_not_of(" \t\r");
+			if (!debugger_add_breakpoint(addr, 0, start != std::string::npos ? condition.c_str() + start : "")) {
+				printf("Bad condition for breakpoint at $%04X: %s\n", addr, debugger_breakpoint_error());
+			}
 		}
 	}
 
@@ -0,0 +1,368 @@
+#include "trace.h"
+
+#include <SDL.h>
+#include <limits.h>
+#include <string.h>
+#include <vector>
+
+#include "cpu/fake6502.h"
+#include "cpu/mnemonics.h"
+#include "glue.h"
+#include "mapped_file.h"
+#include "memory.h"
+#include "symbols.h"
+
+// A trace file is a trace_header followed by trace_records, in the host's byte order.
+
+static constexpr int Max_accesses = 5;
+
+struct trace_access_record {
+	uint16_t address;
+	uint8_t  value;
+	uint8_t  write;
+};
+
+struct trace_record {
+	uint64_t            clock;
+	uint16_t            pc;
+	uint8_t             bank;
+	uint8_t             bytes[3];
+	uint8_t             a, x, y, sp, p;
+	uint8_t             num_accesses; // may be more than Max_accesses, only those are kept
+	trace_access_record accesses[Max_accesses];
+};
+static_assert(sizeof(trace_record) == 40, "trace_record is meant to pack into 40 bytes");
+
+struct trace_header {
+	char     magic[4];
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t reserved;
+};
+
+static constexpr uint32_t Trace_version  = 1;
+static constexpr char     Trace_magic[4] = { 'B', '1', '6', 'T' };
+static constexpr size_t   Ring_records   = 1024 * 1024;
+static constexpr size_t   Flush_records  = 16 * 1024;
+
+static bool         Enabled   = false;
+static bool         Suspended = false;
+static bool         Pending   = false; // Current is an instruction that ran, but isn't in Records yet
+static trace_record Current;
+
+static SDL_RWops *File = nullptr;
+static char       Path[PATH_MAX];
+
+// Written to File whenever full, or else a ring of the most recent records.
+static std::vector<trace_record> Records;
+static size_t                    Next    = 0;
+static bool                      Wrapped = false;
+
+static void stop_file()
+{
+	SDL_RWclose(File);
+	File    = nullptr;
+	Enabled = false;
+	memory_trace_accesses(false);
+}
+
+static void flush()
+{
+	if (Next > 0 && SDL_RWwrite(File, Records.data(), sizeof(trace_record), Next) != Next) {
+		printf("Cannot write to %s! Stopped tracing.\n", Path);
+		stop_file();
+	}
+	Next = 0;
+}
+
+static void commit()
+{
+	if (!Pending) {
+		return;
+	}
+	Pending         = false;
+	Records[Next++] = Current;
+
+	if (Next == Records.size()) {
+		if (File != nullptr) {
+			flush();
+		} else {
+			Next    = 0;
+			Wrapped = true;
+		}
+	}
+}
+
+static bool write_header(SDL_RWops *f)
+{
+	trace_header header;
+	memcpy(header.magic, Trace_magic, sizeof(header.magic));
+	header.version     = Trace_version;
+	header.record_size = sizeof(trace_record);
+	header.reserved    = 0;
+	return SDL_RWwrite(f, &header, sizeof(header), 1) == 1;
+}
+
+bool trace_start(const char *path)
+{
+	trace_stop();
+
+	if (path != nullptr) {
+		File = SDL_RWFromFile(path, "wb");
+		if (File == nullptr || !write_header(File)) {
+			printf("Cannot write to %s!\n", path);
+			if (File != nullptr) {
+				SDL_RWclose(File);
+				File = nullptr;
+			}
+			return false;
+		}
+		snprintf(Path, sizeof(Path), "%s", path);
+		Records.resize(Flush_records);
+		printf("Tracing to %s.\n", path);
+	} else {
+		Records.resize(Ring_records);
+	}
+
+	Next    = 0;
+	Wrapped = false;
+	Pending = false;
+	Enabled = true;
+	memory_trace_accesses(!Suspended);
+	return true;
+}
+
+void trace_stop()
+{
+	if (!Enabled) {
+		return;
+	}
+	commit();
+
+	if (File != nullptr) {
+		flush();
+		if (File != nullptr) {
+			stop_file();
+			printf("Saved trace to %s.\n", Path);
+		}
+		Records.clear();
+		Records.shrink_to_fit();
+	}
+	Enabled = false;
+	memory_trace_accesses(false);
+}
+
+bool trace_is_enabled()
+{
+	return Enabled;
+}
+
+bool trace_is_buffered()
+{
+	return File == nullptr && (Next > 0 || Wrapped || Pending);
+}
+
+void trace_suspend(bool suspend)
+{
+	Suspended = suspend;
+	if (!Enabled) {
+		return;
+	}
+	// The last instruction's accesses are all in; whatever runs next isn't its.
+	commit();
+	memory_trace_accesses(!Suspended);
+}
+
+bool trace_save(const char *path)
+{
+	if (File != nullptr) {
+		return false;
+	}
+	commit();
+
+	SDL_RWops *f = SDL_RWFromFile(path, "wb");
+	if (f == nullptr) {
+		printf("Cannot write to %s!\n", path);
+		return false;
+	}
+	bool written = write_header(f);
+	if (Wrapped) {
+		written = written && SDL_RWwrite(f, Records.data() + Next, sizeof(trace_record), Records.size() - Next) == Records.size() - Next;
+	}
+	written = written && SDL_RWwrite(f, Records.data(), sizeof(trace_record), Next) == Next;
+	SDL_RWclose(f);
+
+	if (!written) {
+		printf("Cannot write to %s!\n", path);
+		return false;
+	}
+	printf("Saved trace to %s.\n", path);
+	return true;
+}
+
+void trace_instruction()
+{
+	if (Suspended) {
+		return;
+	}
+	commit();
+
+	Current.clock = clockticks6502;
+	Current.pc    = pc;
+	Current.bank  = memory_get_current_bank(pc);
+	for (int i = 0; i < 3; ++i) {
+		Current.bytes[i] = debug_read6502(pc + i, Current.bank);
+	}
+	Current.a            = a;
+	Current.x            = x;
+	Current.y            = y;
+	Current.sp           = sp;
+	Current.p            = status;
+	Current.num_accesses = 0;
+	memset(Current.accesses, 0, sizeof(Current.accesses));
+	Pending = true;
+}
+
+void trace_access(uint16_t address, uint8_t value, bool write)
+{
+	if (!Pending) {
+		return;
+	}
+	// The instruction's own bytes are in the record already.
+	if (!write && (uint16_t)(address - Current.pc) < 3) {
+		return;
+	}
+	if (Current.num_accesses < Max_accesses) {
+		Current.accesses[Current.num_accesses] = trace_access_record{ address, value, write };
+	}
+	if (Current.num_accesses < UINT8_MAX) {
+		++Current.num_accesses;
+	}
+}
+
+//
+// Decoding
+//
+
+static int instruction_length(op_mode mode)
+{
+	switch (mode) {
+		case op_mode::MODE_A:
+		case op_mode::MODE_IMP:
+			return 1;
+		case op_mode::MODE_ZPREL:
+		case op_mode::MODE_ABSO:
+		case op_mode::MODE_ABSX:
+		case op_mode::MODE_ABSY:
+		case op_mode::MODE_AINX:
+		case op_mode::MODE_IND:
+			return 3;
+		default:
+			return 2;
+	}
+}
+
+static const char *symbol_for(uint16_t address, uint8_t bank)
+{
+	const symbol_list_type &symbols = symbols_find(address, address >= 0xa000 ? bank : 0);
+	return symbols.empty() ? nullptr : symbols.front().c_str();
+}
+
+// Returns the address the operand names, or -1 for none worth a symbol.
+static int disassemble(const trace_record &r, char *line, size_t size)
+{
+	const char    *mnemonic = mnemonics[r.bytes[0]];
+	const uint8_t  zp       = r.bytes[1];
+	const uint16_t abs      = r.bytes[1] | r.bytes[2] << 8;
+
+	switch (mnemonics_mode[r.bytes[0]]) {
+		case op_mode::MODE_IMP: snprintf(line, size, "%s", mnemonic); return -1;
+		case op_mode::MODE_A: snprintf(line, size, "%s a", mnemonic); return -1;
+		case op_mode::MODE_IMM: snprintf(line, size, "%s #$%02X", mnemonic, zp); return -1;
+		case op_mode::MODE_ZP: snprintf(line, size, "%s $%02X", mnemonic, zp); return zp;
+		case op_mode::MODE_ZPX: snprintf(line, size, "%s $%02X,x", mnemonic, zp); return zp;
+		case op_mode::MODE_ZPY: snprintf(line, size, "%s $%02X,y", mnemonic, zp); return zp;
+		case op_mode::MODE_INDX: snprintf(line, size, "%s ($%02X,x)", mnemonic, zp); return zp;
+		case op_mode::MODE_INDY: snprintf(line, size, "%s ($%02X),y", mnemonic, zp); return zp;
+		case op_mode::MODE_IND0: snprintf(line, size, "%s ($%02X)", mnemonic, zp); return zp;
+		case op_mode::MODE_ABSO: snprintf(line, size, "%s $%04X", mnemonic, abs); return abs;
+		case op_mode::MODE_ABSX: snprintf(line, size, "%s $%04X,x", mnemonic, abs); return abs;
+		case op_mode::MODE_ABSY: snprintf(line, size, "%s $%04X,y", mnemonic, abs); return abs;
+		case op_mode::MODE_AINX: snprintf(line, size, "%s ($%04X,x)", mnemonic, abs); return abs;
+		case op_mode::MODE_IND: snprintf(line, size, "%s ($%04X)", mnemonic, abs); return abs;
+
+		case op_mode::MODE_REL: {
+			const uint16_t target = r.pc + 2 + (int8_t)zp;
+			snprintf(line, size, "%s $%04X", mnemonic, target);
+			return target;
+		}
+		case op_mode::MODE_ZPREL: {
+			const uint16_t target = r.pc + 3 + (int8_t)r.bytes[2];
+			snprintf(line, size, "%s $%02X, $%04X", mnemonic, zp, target);
+			return target;
+		}
+	}
+	return -1;
+}
+
+bool trace_decode(const char *path, FILE *out)
+{
+	mapped_file f;
+	if (!f.open(path, false)) {
+		printf("Cannot open %s!\n", path);
+		return false;
+	}
+
+	trace_header header;
+	if (f.size() < sizeof(header)) {
+		printf("%s is not a trace.\n", path);
+		return false;
+	}
+	memcpy(&header, f.data(), sizeof(header));
+	if (memcmp(header.magic, Trace_magic, sizeof(header.magic)) != 0) {
+		printf("%s is not a trace.\n", path);
+		return false;
+	}
+	if (header.version != Trace_version || header.record_size != sizeof(trace_record)) {
+		printf("Trace version %u is not supported (expected %u).\n", header.version, Trace_version);
+		return false;
+	}
+
+	const size_t num_records = (f.size() - sizeof(header)) / sizeof(trace_record);
+	for (size_t i = 0; i < num_records; ++i) {
+		trace_record r;
+		memcpy(&r, f.data() + sizeof(header) + i * sizeof(trace_record), sizeof(r));
+
+		char        text[32];
+		const int   operand = disassemble(r, text, sizeof(text));
+		const int   length  = instruction_length(mnemonics_mode[r.bytes[0]]);
+		const char *label   = symbol_for(r.pc, r.bank);
+
+		char bytes[10] = "";
+		for (int j = 0; j < length; ++j) {
+			snprintf(bytes + j * 3, sizeof(bytes) - j * 3, "%02X ", r.bytes[j]);
+		}
+
+		char flags[9];
+		for (int j = 0; j < 8; ++j) {
+			flags[j] = (r.p & (0x80 >> j)) ? "nv-bdizc"[j] : '-';
+		}
+		flags[8] = '\0';
+
+		fprintf(out, "%12" SDL_PRIu64 "  %02X:%04X  %-20s %-9s %-16s", r.clock, r.bank, r.pc, label != nullptr ? label : "", bytes, text);
+
+		const char *operand_label = operand >= 0 ? symbol_for((uint16_t)operand, r.bank) : nullptr;
+		fprintf(out, " %-20s", operand_label != nullptr ? operand_label : "");
+
+		fprintf(out, " a=%02X x=%02X y=%02X sp=%02X p=%s", r.a, r.x, r.y, r.sp, flags);
+		for (int j = 0; j < r.num_accesses && j < Max_accesses; ++j) {
+			const trace_access_record &access = r.accesses[j];
+			fprintf(out, access.write ? "  %04X<-%02X" : "  %04X->%02X", access.address, access.value);
+		}
+		if (r.num_accesses > Max_accesses) {
+			fprintf(out, "  (+%d)", r.num_accesses - Max_accesses);
+		}
+		fprintf(out, "\n");
+	}
+	return true;
+}
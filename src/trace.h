@@ -0,0 +1,37 @@
+#pragma once
+#if !defined(TRACE_H)
+#	define TRACE_H
+
+#	include <stdint.h>
+#	include <stdio.h>
+
+// Records every instruction executed as a fixed-size binary record: the clock, bank,
+// PC, instruction bytes, registers before it ran, and the memory accesses it made
+// other than fetching itself. Cheap enough to leave on for minutes; the records are
+// turned into text afterwards with trace_decode() (-decodetrace).
+
+// With a path, records stream to that file. Without, the most recent million or so are
+// kept in memory for trace_save().
+bool trace_start(const char *path);
+void trace_stop();
+bool trace_is_enabled();
+bool trace_is_buffered();
+
+// While suspended, nothing is recorded: for run-ahead's frames and the debugger's
+// re-runs when stepping back, which the machine doesn't really execute (again).
+void trace_suspend(bool suspend);
+
+// Writes the records kept in memory, oldest first.
+bool trace_save(const char *path);
+
+// Writes a trace file as text, one instruction per line, disassembled, with symbols
+// from whatever symbol files are loaded.
+bool trace_decode(const char *path, FILE *out);
+
+// Called by machine_step() before each instruction while tracing.
+void trace_instruction();
+
+// Called by memory.cpp for every CPU access while tracing.
+void trace_access(uint16_t address, uint8_t value, bool write);
+
+#endif
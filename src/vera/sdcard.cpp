@@ -6,8 +6,16 @@
 #include "sdcard.h"
 
 #include <SDL.h>
+#include <array>
 #include <stdbool.h>
 #include <stdio.h>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "mapped_file.h"
+#include "options.h"
+#include "sdcard_vfat.h"
+#include "state.h"
 
 //#define VERBOSE 1
 
@@ -36,8 +44,11 @@ enum {
 	CMD58  = 58,        // READ_OCR
 };
 
-SDL_RWops *sdcard_file     = NULL;
-bool       sdcard_attached = false;
+// The image is memory-mapped when possible, so block reads are served straight from
+// the mapping. sdcard_file is the fallback for when mapping fails.
+static mapped_file sdcard_image;
+SDL_RWops *        sdcard_file     = NULL;
+bool               sdcard_attached = false;
 
 static uint8_t  rxbuf[3 + 512];
 static int      rxbuf_idx;
@@ -47,25 +58,189 @@ static bool     is_acmd        = false;
 static bool     is_idle        = true;
 static bool     is_initialized = false;
 
-static const uint8_t *response         = NULL;
-static int            response_length  = 0;
-static int            response_counter = 0;
+// A response is sent as up to three parts, so a data block can be sent
+// from the image mapping without copying it into a response buffer first.
+struct response_part {
+	const uint8_t *data;
+	int            length;
+};
+
+static response_part  response_parts[3];
+static int            response_part_count = 0;
+static int            response_part_index = 0;
+static const uint8_t *response            = NULL;
+static int            response_length     = 0;
+static int            response_counter    = 0;
 
 static bool selected = false;
 
+// Multi-block transfers (CMD18/CMD25) keep going until CMD12 or the stop token.
+static bool     multi_read    = false;
+static bool     multi_write   = false;
+static uint32_t multi_lba     = 0;
+static uint32_t prefetched_to = 0;
+static uint8_t  block_buf[512];
+
+// Read-ahead for the unmapped fallback, so a multi-block read isn't a seek and read per block.
+#define READAHEAD_BLOCKS 32
+static uint8_t  readahead_buf[512 * READAHEAD_BLOCKS];
+static uint32_t readahead_lba   = 0;
+static int      readahead_count = 0;
+
+static const uint8_t block_crc[] = { 0x00, 0x00 };
+
+// Copy-on-write overlay: the image is opened read-only, and written blocks are kept
+// in memory or in a sparse overlay file (at the same offsets as in the image) instead.
+// On close they're either discarded or committed to the image.
+enum class overlay_mode {
+	NONE,
+	MEMORY,
+	FILE
+};
+
+static char         image_path[PATH_MAX]   = "";
+static char         overlay_path[PATH_MAX] = ""; // empty for none, "mem" for memory
+static bool         overlay_commit         = false;
+static overlay_mode overlay                = overlay_mode::NONE;
+static SDL_RWops *  overlay_file           = NULL;
+static bool         discard_writes         = false;
+
+static std::unordered_map<uint32_t, std::array<uint8_t, 512>> overlay_memory;
+static std::unordered_set<uint32_t>                            overlay_file_blocks;
+
+static const uint8_t *read_block(uint32_t lba, uint8_t *buf);
+static void           write_image_block(uint32_t lba, const uint8_t *data);
+
+static bool sdcard_is_open()
+{
+	return sdcard_image.is_open() || sdcard_file != NULL || sdcard_vfat_is_open();
+}
+
+static bool sdcard_open_image(bool writable)
+{
+	// A directory is presented as a FAT32 card of its own.
+	if (sdcard_vfat_is_directory(image_path)) {
+		return sdcard_vfat_open(image_path);
+	}
+
+	if (sdcard_image.open(image_path, writable)) {
+		return true;
+	}
+	sdcard_file = SDL_RWFromFile(image_path, writable ? "r+b" : "rb");
+	return sdcard_file != NULL;
+}
+
+static void sdcard_close_image()
+{
+	sdcard_vfat_close();
+	sdcard_image.close();
+	if (sdcard_file != NULL) {
+		SDL_RWclose(sdcard_file);
+		sdcard_file = NULL;
+	}
+}
+
+static bool overlay_open()
+{
+	if (!strcmp(overlay_path, "mem")) {
+		overlay = overlay_mode::MEMORY;
+		return true;
+	}
+
+	overlay_file = SDL_RWFromFile(overlay_path, "w+b");
+	if (overlay_file == NULL) {
+		printf("Cannot create SD card overlay %s!\n", overlay_path);
+		return false;
+	}
+	overlay = overlay_mode::FILE;
+	return true;
+}
+
+static void overlay_close()
+{
+	if (overlay == overlay_mode::NONE) {
+		return;
+	}
+
+	const size_t num_blocks = overlay_memory.size() + overlay_file_blocks.size();
+	if (overlay_commit && num_blocks > 0) {
+		// Reopen the image for writing, and copy the changed blocks over.
+		sdcard_close_image();
+		if (sdcard_open_image(true)) {
+			uint8_t buf[512];
+			for (auto &block : overlay_memory) {
+				write_image_block(block.first, block.second.data());
+			}
+			for (uint32_t lba : overlay_file_blocks) {
+				write_image_block(lba, read_block(lba, buf));
+			}
+			printf("Committed %d changed SD card blocks to %s.\n", (int)num_blocks, image_path);
+		} else {
+			printf("Cannot open SDCard file %s for writing, changes are lost!\n", image_path);
+		}
+	}
+
+	overlay_memory.clear();
+	overlay_file_blocks.clear();
+	if (overlay_file != NULL) {
+		SDL_RWclose(overlay_file);
+		overlay_file = NULL;
+		remove(overlay_path);
+	}
+	overlay = overlay_mode::NONE;
+}
+
+static void sdcard_close()
+{
+	response        = NULL;
+	multi_read      = false;
+	multi_write     = false;
+	readahead_count = 0;
+
+	overlay_close();
+	sdcard_close_image();
+}
+
+void sdcard_set_overlay(char const *path, bool commit)
+{
+	strncpy(overlay_path, path != nullptr ? path : "", PATH_MAX - 1);
+	overlay_commit = commit;
+}
+
 void sdcard_set_file(char const *path)
 {
-	sdcard_file = SDL_RWFromFile(path, "r+b");
-	if (!sdcard_file) {
+	const bool use_overlay = overlay_path[0] != '\0';
+
+	sdcard_close();
+	sdcard_attached = false;
+
+	strncpy(image_path, path, PATH_MAX - 1);
+	if (!sdcard_open_image(!use_overlay)) {
 		printf("Cannot open SDCard file %s!\n", path);
 		return;
 	}
+	if (use_overlay && !overlay_open()) {
+		sdcard_close_image();
+		return;
+	}
 	sdcard_attach();
 }
 
+void sdcard_shutdown()
+{
+	sdcard_detach();
+	sdcard_close();
+}
+
+void sdcard_flush()
+{
+	sdcard_image.flush_all(true);
+	sdcard_vfat_sync();
+}
+
 void sdcard_attach()
 {
-	if (!sdcard_attached && sdcard_file) {
+	if (!sdcard_attached && sdcard_is_open()) {
 		printf("SD card attached.\n");
 		sdcard_attached = true;
 		is_initialized  = false;
@@ -77,12 +252,18 @@ void sdcard_detach()
 	if (sdcard_attached) {
 		printf("SD card detached.\n");
 		sdcard_attached = false;
+		sdcard_flush();
 	}
 }
 
+void sdcard_set_discard_writes(bool discard)
+{
+	discard_writes = discard;
+}
+
 bool sdcard_is_attached()
 {
-	return sdcard_file && sdcard_attached;
+	return sdcard_is_open() && sdcard_attached;
 }
 
 void sdcard_select(bool select)
@@ -94,44 +275,299 @@ void sdcard_select(bool select)
 #endif
 }
 
+static void set_response(const uint8_t *data, int length)
+{
+	response_parts[0]   = { data, length };
+	response_part_count = 1;
+	response_part_index = 0;
+	response            = data;
+	response_length     = length;
+	response_counter    = 0;
+}
+
+static void add_response(const uint8_t *data, int length)
+{
+	response_parts[response_part_count++] = { data, length };
+}
+
+static void queue_read_block();
+
+// Consume n bytes of the current response part, moving on to the next part (or block) at its end.
+static void advance_response(int n)
+{
+	response_counter += n;
+	if (response_counter == response_length) {
+		response_counter = 0;
+		if (++response_part_index < response_part_count) {
+			response        = response_parts[response_part_index].data;
+			response_length = response_parts[response_part_index].length;
+		} else {
+			response = NULL;
+			if (multi_read) {
+				queue_read_block();
+			}
+		}
+	}
+}
+
+static uint8_t next_response_byte()
+{
+	const uint8_t outbyte = response[response_counter];
+	advance_response(1);
+	return outbyte;
+}
+
+// Returns a pointer to the block in the image, or copies it into buf if it isn't mapped.
+static const uint8_t *read_image_block(uint32_t lba, uint8_t *buf)
+{
+	const uint64_t offset = (uint64_t)lba * 512;
+
+	if (sdcard_vfat_is_open()) {
+		sdcard_vfat_read(lba, buf);
+		return buf;
+	}
+
+	if (sdcard_image.is_open()) {
+		const size_t size = sdcard_image.size();
+		if (offset + 512 <= size) {
+			return sdcard_image.data() + offset;
+		}
+
+		const size_t avail = offset < size ? (size_t)(size - offset) : 0;
+		memcpy(buf, sdcard_image.data() + offset, avail);
+		memset(buf + avail, 0, 512 - avail);
+		printf("Warning: short read!\n");
+		return buf;
+	}
+
+	if (lba - readahead_lba < (uint32_t)readahead_count) {
+		return readahead_buf + (lba - readahead_lba) * 512;
+	}
+
+	if (multi_read) {
+		SDL_RWseek(sdcard_file, offset, RW_SEEK_SET);
+		const int bytes_read = (int)SDL_RWread(sdcard_file, readahead_buf, 1, sizeof(readahead_buf));
+		if (bytes_read >= 512) {
+			readahead_lba   = lba;
+			readahead_count = bytes_read / 512;
+			return readahead_buf;
+		}
+		readahead_count = 0;
+	}
+
+	SDL_RWseek(sdcard_file, offset, RW_SEEK_SET);
+	int bytes_read = (int)SDL_RWread(sdcard_file, buf, 1, 512);
+	if (bytes_read != 512) {
+		printf("Warning: short read!\n");
+	}
+	return buf;
+}
+
+// Send the next block of a multi-block read, hinting the OS to fetch the blocks after it.
+static void queue_read_block()
+{
+	static const uint8_t block_start[] = { 0xFE };
+
+	if (sdcard_image.is_open() && multi_lba >= prefetched_to) {
+		prefetched_to = multi_lba + READAHEAD_BLOCKS;
+		sdcard_image.prefetch((size_t)multi_lba * 512, READAHEAD_BLOCKS * 512);
+	}
+
+	set_response(block_start, sizeof(block_start));
+	add_response(read_block(multi_lba++, block_buf), 512);
+	add_response(block_crc, sizeof(block_crc));
+}
+
+static void write_image_block(uint32_t lba, const uint8_t *data)
+{
+	const uint64_t offset = (uint64_t)lba * 512;
+
+	if (sdcard_vfat_is_open()) {
+		sdcard_vfat_write(lba, data);
+		return;
+	}
+
+	if (sdcard_image.is_open()) {
+		if (offset + 512 > sdcard_image.size()) {
+			printf("Warning: write past the end of the SD card image!\n");
+			return;
+		}
+
+		memcpy(sdcard_image.data() + offset, data, 512);
+		switch (Options.sdcard_sync) {
+			case sdcard_sync_t::EXIT: break;
+			case sdcard_sync_t::ASYNC: sdcard_image.flush((size_t)offset, 512, false); break;
+			case sdcard_sync_t::SYNC: sdcard_image.flush((size_t)offset, 512, true); break;
+		}
+		return;
+	}
+
+	if (lba - readahead_lba < (uint32_t)readahead_count) {
+		memcpy(readahead_buf + (lba - readahead_lba) * 512, data, 512);
+	}
+
+	SDL_RWseek(sdcard_file, offset, RW_SEEK_SET);
+	int bytes_written = (int)SDL_RWwrite(sdcard_file, data, 1, 512);
+	if (bytes_written != 512) {
+		printf("Warning: short write!\n");
+	}
+}
+
+static const uint8_t *read_block(uint32_t lba, uint8_t *buf)
+{
+	switch (overlay) {
+		case overlay_mode::NONE:
+			break;
+
+		case overlay_mode::MEMORY: {
+			auto block = overlay_memory.find(lba);
+			if (block != overlay_memory.end()) {
+				return block->second.data();
+			}
+			break;
+		}
+
+		case overlay_mode::FILE:
+			if (overlay_file_blocks.count(lba)) {
+				SDL_RWseek(overlay_file, (Sint64)lba * 512, RW_SEEK_SET);
+				if (SDL_RWread(overlay_file, buf, 1, 512) != 512) {
+					printf("Warning: short read from SD card overlay!\n");
+				}
+				return buf;
+			}
+			break;
+	}
+
+	return read_image_block(lba, buf);
+}
+
+static void write_block(uint32_t lba, const uint8_t *data)
+{
+	if (discard_writes) {
+		return;
+	}
+
+	switch (overlay) {
+		case overlay_mode::NONE:
+			write_image_block(lba, data);
+			break;
+
+		case overlay_mode::MEMORY:
+			memcpy(overlay_memory[lba].data(), data, 512);
+			break;
+
+		case overlay_mode::FILE:
+			// Seeking past the end leaves a hole, so the file only takes up space for written blocks.
+			SDL_RWseek(overlay_file, (Sint64)lba * 512, RW_SEEK_SET);
+			if (SDL_RWwrite(overlay_file, data, 1, 512) != 512) {
+				printf("Warning: short write to SD card overlay!\n");
+			}
+			overlay_file_blocks.insert(lba);
+			break;
+	}
+}
+
 static void set_response_r1(void)
 {
 	static uint8_t r1;
-	r1              = is_idle ? 1 : 0;
-	response        = &r1;
-	response_length = 1;
+	r1 = is_idle ? 1 : 0;
+	set_response(&r1, 1);
 }
 
 static void set_response_r2(void)
 {
 	if (is_initialized) {
 		static const uint8_t r2[] = {0x00, 0x00};
-		response                  = r2;
-		response_length           = sizeof(r2);
+		set_response(r2, sizeof(r2));
 	} else {
 		static const uint8_t r2[] = {0x1F, 0xFF};
-		response                  = r2;
-		response_length           = sizeof(r2);
+		set_response(r2, sizeof(r2));
 	}
 }
 
 static void set_response_r3(void)
 {
 	static const uint8_t r3[] = {0xC0, 0xFF, 0x80, 0x00};
-	response                  = r3;
-	response_length           = sizeof(r3);
+	set_response(r3, sizeof(r3));
+}
+
+static void set_response_data_accepted(void)
+{
+	static const uint8_t data_response[] = { 0x05 };
+	set_response(data_response, sizeof(data_response));
 }
 
 static void set_response_r7(void)
 {
 	static const uint8_t r7[] = {1, 0x00, 0x00, 0x01, 0xAA};
-	response                  = r7;
-	response_length           = sizeof(r7);
+	set_response(r7, sizeof(r7));
+}
+
+// What's left of a response when a machine state was restored. The response parts
+// point into the image or into constant data, so they're saved as plain bytes.
+static uint8_t restored_response[2 + 512 + 2];
+
+void sdcard_save_restore(state_stream &state)
+{
+	state.field(rxbuf);
+	state.field(rxbuf_idx);
+	state.field(lba);
+	state.field(last_cmd);
+	state.field(is_acmd);
+	state.field(is_idle);
+	state.field(is_initialized);
+	state.field(selected);
+	state.field(multi_read);
+	state.field(multi_write);
+	state.field(multi_lba);
+
+	uint32_t pending = 0;
+	if (state.saving()) {
+		if (response != NULL) {
+			const int n = response_length - response_counter;
+			memcpy(restored_response, response + response_counter, n);
+			pending = n;
+			for (int i = response_part_index + 1; i < response_part_count; ++i) {
+				memcpy(restored_response + pending, response_parts[i].data, response_parts[i].length);
+				pending += response_parts[i].length;
+			}
+		}
+		state.field(pending);
+		state.bytes(restored_response, pending);
+	} else {
+		state.field(pending);
+		if (pending > sizeof(restored_response)) {
+			pending = sizeof(restored_response);
+		}
+		state.bytes(restored_response, pending);
+
+		response = NULL;
+		if (pending > 0) {
+			set_response(restored_response, pending);
+		}
+		prefetched_to   = multi_lba;
+		readahead_count = 0;
+	}
+}
+
+int sdcard_read_bulk(uint8_t *dst, int max_bytes)
+{
+	if (!selected || !sdcard_is_attached() || rxbuf_idx != 0 || response == NULL) {
+		return 0;
+	}
+
+	int n = response_length - response_counter;
+	if (n > max_bytes) {
+		n = max_bytes;
+	}
+	memcpy(dst, response + response_counter, n);
+	advance_response(n);
+	return n;
 }
 
 uint8_t sdcard_handle(uint8_t inbyte)
 {
-	if (!selected || sdcard_file == NULL) {
+	if (!selected || !sdcard_is_open()) {
 		return 0xFF;
 	}
 	// printf("sdcard_handle: %02X\n", inbyte);
@@ -141,16 +577,18 @@ uint8_t sdcard_handle(uint8_t inbyte)
 	if (rxbuf_idx == 0 && inbyte == 0xFF) {
 		// send response data
 		if (response) {
-			outbyte = response[response_counter++];
-			if (response_counter == response_length) {
-				response = NULL;
-			}
+			outbyte = next_response_byte();
 		}
 
 	} else {
 		rxbuf[rxbuf_idx++] = inbyte;
 
-		if ((rxbuf[0] & 0xC0) == 0x40 && rxbuf_idx == 6) {
+		if (multi_write && rxbuf_idx == 1 && rxbuf[0] == 0xFD) {
+			// Stop Tran token ends a multi-block write
+			rxbuf_idx   = 0;
+			multi_write = false;
+			response    = NULL;
+		} else if ((rxbuf[0] & 0xC0) == 0x40 && rxbuf_idx == 6) {
 			rxbuf_idx = 0;
 
 			// Check for start-bit + transmission bit
@@ -168,6 +606,9 @@ uint8_t sdcard_handle(uint8_t inbyte)
 
 			last_cmd = rxbuf[0];
 
+			// Any command ends a multi-block read that's still streaming
+			multi_read = false;
+
 #if defined(VERBOSE) && VERBOSE >= 2
 			printf("*** SD %sCMD%d -> Response:", (rxbuf[0] & 0x80) ? "A" : "", rxbuf[0] & 0x3F);
 #endif
@@ -205,21 +646,32 @@ uint8_t sdcard_handle(uint8_t inbyte)
 				}
 				case CMD17: {
 					// READ_SINGLE_BLOCK
-					uint32_t       lba = (rxbuf[1] << 24) | (rxbuf[2] << 16) | (rxbuf[3] << 8) | rxbuf[4];
-					static uint8_t read_block_response[2 + 512 + 2];
-					read_block_response[0] = 0;
-					read_block_response[1] = 0xFE;
+					uint32_t             lba           = (rxbuf[1] << 24) | (rxbuf[2] << 16) | (rxbuf[3] << 8) | rxbuf[4];
+					static const uint8_t block_start[] = { 0x00, 0xFE };
 #ifdef VERBOSE
 					printf("*** SD Reading LBA %d\n", lba);
 #endif
-					SDL_RWseek(sdcard_file, lba * 512, SEEK_SET);
-					int bytes_read = (int)SDL_RWread(sdcard_file, &read_block_response[2], 1, 512);
-					if (bytes_read != 512) {
-						printf("Warning: short read!\n");
-					}
-
-					response        = read_block_response;
-					response_length = 2 + 512 + 2;
+					set_response(block_start, sizeof(block_start));
+					add_response(read_block(lba, block_buf), 512);
+					add_response(block_crc, sizeof(block_crc));
+					break;
+				}
+
+				case CMD18: {
+					// READ_MULTIPLE_BLOCK: blocks follow each other until CMD12
+					multi_lba     = (rxbuf[1] << 24) | (rxbuf[2] << 16) | (rxbuf[3] << 8) | rxbuf[4];
+					prefetched_to = multi_lba;
+#ifdef VERBOSE
+					printf("*** SD Reading from LBA %d\n", multi_lba);
+#endif
+					set_response_r1();
+					multi_read = true;
+					break;
+				}
+
+				case CMD12: {
+					// STOP_TRANSMISSION
+					set_response_r1();
 					break;
 				}
 
@@ -230,6 +682,14 @@ uint8_t sdcard_handle(uint8_t inbyte)
 					break;
 				}
 
+				case CMD25: {
+					// WRITE_MULTIPLE_BLOCK: blocks follow each other until the Stop Tran token
+					lba         = (rxbuf[1] << 24) | (rxbuf[2] << 16) | (rxbuf[3] << 8) | rxbuf[4];
+					multi_write = true;
+					set_response_r1();
+					break;
+				}
+
 				case CMD55: {
 					// APP_CMD: Next command is an application specific command
 					is_acmd = true;
@@ -264,11 +724,14 @@ uint8_t sdcard_handle(uint8_t inbyte)
 #ifdef VERBOSE
 				printf("*** SD Writing LBA %d\n", lba);
 #endif
-				SDL_RWseek(sdcard_file, lba * 512, SEEK_SET);
-				int bytes_written = (int)SDL_RWwrite(sdcard_file, rxbuf + 1, 1, 512);
-				if (bytes_written != 512) {
-					printf("Warning: short write!\n");
-				}
+				write_block(lba, rxbuf + 1);
+				set_response_data_accepted();
+			} else if (multi_write && rxbuf[0] == 0xFC) {
+#ifdef VERBOSE
+				printf("*** SD Writing LBA %d\n", lba);
+#endif
+				write_block(lba++, rxbuf + 1);
+				set_response_data_accepted();
 			}
 		}
 	}
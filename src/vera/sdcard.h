@@ -4,12 +4,33 @@
 #ifndef SD_CARD_H
 #define SD_CARD_H
 
+class state_stream;
+
+// With an overlay, images are opened read-only and writes go to the overlay instead:
+// "mem" keeps them in memory, anything else is the path of a sparse overlay file.
+// On close, the changes are written to the image if commit is set, otherwise discarded.
+// Takes effect the next time an image is set.
+void sdcard_set_overlay(char const *path, bool commit);
 void sdcard_set_file(char const *path);
 void sdcard_attach();
 void sdcard_detach();
 bool sdcard_is_attached();
+void sdcard_shutdown();
+
+// Write any changes still pending in the image's mapping back to disk.
+void sdcard_flush();
+
+// While set, blocks written to the card are thrown away, for frames that get rolled back.
+void sdcard_set_discard_writes(bool discard);
 
 void    sdcard_select(bool select);
 uint8_t sdcard_handle(uint8_t inbyte);
 
+// Same as up to max_bytes calls to sdcard_handle(0xFF), but stops at the end of
+// the current response part (e.g. a data block) and returns how many bytes it got.
+int sdcard_read_bulk(uint8_t *dst, int max_bytes);
+
+// Saves the controller's state. What's on the card isn't part of it.
+void sdcard_save_restore(state_stream &state);
+
 #endif
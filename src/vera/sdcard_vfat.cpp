@@ -0,0 +1,973 @@
+#include "sdcard_vfat.h"
+
+#include <algorithm>
+#include <array>
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#if defined(_WIN32)
+#	include <direct.h>
+#	define make_dir(path) _mkdir(path)
+#	define remove_dir(path) _rmdir(path)
+#else
+#	define make_dir(path) mkdir(path, 0755)
+#	define remove_dir(path) rmdir(path)
+#endif
+
+// Card layout: an MBR with one FAT32 partition starting at 1 MiB. All sector numbers
+// below are relative to the start of the partition unless they're called lba.
+static constexpr uint32_t Partition_start     = 2048;
+static constexpr uint32_t Reserved_sectors    = 32;
+static constexpr uint32_t Num_fats            = 2;
+static constexpr uint32_t Sectors_per_cluster = 8;
+static constexpr uint32_t Cluster_bytes       = Sectors_per_cluster * 512;
+static constexpr uint32_t Fsinfo_sector       = 1;
+static constexpr uint32_t Backup_boot_sector  = 6;
+static constexpr uint32_t Min_clusters        = 262144; // 1 GiB, so there's room to write
+static constexpr uint32_t Max_clusters        = 0x0FFFFFF5 - 2;
+static constexpr uint32_t Fat_end_of_chain    = 0x0FFFFFFF;
+
+struct vfat_node {
+	std::string      host_path;
+	std::string      name;
+	bool             is_dir;
+	uint32_t         size; // files only
+	time_t           mtime;
+	int              parent;
+	std::vector<int> children;
+
+	// Short name and the number of long name entries in front of it.
+	uint8_t short_name[11];
+	uint8_t case_flags;
+	int     lfn_entries;
+
+	uint32_t first_cluster; // 0 for an empty file
+	uint32_t num_clusters;
+
+	std::vector<uint8_t> dir_data;          // generated on first read
+	bool                 host_backed = true; // file data still comes from host_path
+};
+
+static bool                   Vfat_open = false;
+static std::string            Root_path;
+static std::vector<vfat_node> Nodes;
+static std::vector<int>       Nodes_by_cluster; // nodes with clusters, in cluster order
+static std::vector<uint32_t>  Initial_fat;
+static uint32_t               Total_clusters;
+static uint32_t               Used_clusters;
+static uint32_t               Fat_sectors;
+static uint32_t               Data_start;
+static uint32_t               Partition_sectors;
+
+static FILE *Data_file      = nullptr;
+static int   Data_file_node = -1;
+
+// Sectors written by the X16, and which of them changed since the last sync.
+static std::unordered_map<uint32_t, std::array<uint8_t, 512>> Written;
+static std::unordered_set<uint32_t>                            Written_since_sync;
+
+// What the host directory holds as of the last sync, by host path.
+struct synced_entry {
+	bool     is_dir;
+	uint32_t first_cluster;
+	uint32_t size;
+};
+static std::unordered_map<std::string, synced_entry> Synced;
+static std::unordered_map<std::string, int>          Nodes_by_path;
+
+static void put16(uint8_t *p, uint16_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+	put16(p, (uint16_t)v);
+	put16(p + 2, (uint16_t)(v >> 16));
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+	return get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+//
+// Names
+//
+
+// Long names are UCS-2 as far as most FAT drivers are concerned, so this fails for
+// anything outside the BMP, as well as for invalid UTF-8: such a name wouldn't read
+// back from the card as the host name it came from.
+static bool utf8_to_utf16(const std::string &s, std::vector<uint16_t> &out)
+{
+	out.clear();
+	for (size_t i = 0; i < s.size();) {
+		const uint8_t c = (uint8_t)s[i];
+		uint32_t      cp;
+		int           len;
+		if (c < 0x80) {
+			cp  = c;
+			len = 1;
+		} else if ((c & 0xE0) == 0xC0) {
+			cp  = c & 0x1F;
+			len = 2;
+		} else if ((c & 0xF0) == 0xE0) {
+			cp  = c & 0x0F;
+			len = 3;
+		} else {
+			return false;
+		}
+		if (i + len > s.size()) {
+			return false;
+		}
+		for (int j = 1; j < len; ++j) {
+			if (((uint8_t)s[i + j] & 0xC0) != 0x80) {
+				return false;
+			}
+			cp = (cp << 6) | ((uint8_t)s[i + j] & 0x3F);
+		}
+		// Overlong encodings, surrogates, and the padding that ends a long name.
+		if ((len == 2 && cp < 0x80) || (len == 3 && cp < 0x800) || (cp >= 0xD800 && cp < 0xE000) || cp == 0xFFFF) {
+			return false;
+		}
+		i += len;
+		out.push_back((uint16_t)cp);
+	}
+	return true;
+}
+
+static void append_utf8(std::string &s, uint16_t c)
+{
+	if (c < 0x80) {
+		s += (char)c;
+	} else if (c < 0x800) {
+		s += (char)(0xC0 | (c >> 6));
+		s += (char)(0x80 | (c & 0x3F));
+	} else {
+		s += (char)(0xE0 | (c >> 12));
+		s += (char)(0x80 | ((c >> 6) & 0x3F));
+		s += (char)(0x80 | (c & 0x3F));
+	}
+}
+
+static bool is_short_name_char(char c)
+{
+	if (c >= 'A' && c <= 'Z') {
+		return true;
+	}
+	if (c >= '0' && c <= '9') {
+		return true;
+	}
+	return c != '\0' && strchr("!#$%&'()-@^_`{}~", c) != nullptr;
+}
+
+static char to_upper(char c)
+{
+	return (c >= 'a' && c <= 'z') ? (char)(c - 'a' + 'A') : c;
+}
+
+// Check whether a part of a name fits in a short name as-is, maybe with all of its letters in lower case.
+static bool fits_short_name(const std::string &part, size_t max_len, bool &lower)
+{
+	if (part.size() > max_len) {
+		return false;
+	}
+
+	bool has_lower = false;
+	bool has_upper = false;
+	for (char c : part) {
+		has_lower |= (c >= 'a' && c <= 'z');
+		has_upper |= (c >= 'A' && c <= 'Z');
+		if (!is_short_name_char(to_upper(c))) {
+			return false;
+		}
+	}
+	lower = has_lower;
+	return !(has_lower && has_upper);
+}
+
+static uint8_t short_name_checksum(const uint8_t *name)
+{
+	uint8_t sum = 0;
+	for (int i = 0; i < 11; ++i) {
+		sum = (uint8_t)(((sum & 1) << 7) + (sum >> 1) + name[i]);
+	}
+	return sum;
+}
+
+// Pick the short name for a node, and whether it needs long name entries besides.
+static void make_short_name(vfat_node &node, std::unordered_set<std::string> &used)
+{
+	const std::string &name = node.name;
+	const size_t       dot  = name.rfind('.');
+	const std::string  base = (dot == std::string::npos || dot == 0) ? name : name.substr(0, dot);
+	const std::string  ext  = (dot == std::string::npos || dot == 0) ? "" : name.substr(dot + 1);
+
+	memset(node.short_name, ' ', 11);
+	node.case_flags = 0;
+
+	bool base_lower = false;
+	bool ext_lower  = false;
+	// "NAME." would read back without its dot.
+	const bool whole = (ext.empty() ? base : base + "." + ext) == name;
+	if (whole && !base.empty() && fits_short_name(base, 8, base_lower) && fits_short_name(ext, 3, ext_lower)) {
+		for (size_t i = 0; i < base.size(); ++i) {
+			node.short_name[i] = (uint8_t)to_upper(base[i]);
+		}
+		for (size_t i = 0; i < ext.size(); ++i) {
+			node.short_name[8 + i] = (uint8_t)to_upper(ext[i]);
+		}
+
+		// Names differing only in case are distinct on most hosts, but not on FAT.
+		if (used.insert(std::string((char *)node.short_name, 11)).second) {
+			node.case_flags  = (base_lower ? 0x08 : 0) | (ext_lower ? 0x10 : 0);
+			node.lfn_entries = 0;
+			return;
+		}
+		memset(node.short_name, ' ', 11);
+	}
+
+	// Otherwise it's a numbered tail name like LONGNA~1.TXT, and the real name goes in long name entries.
+	std::string basis;
+	for (char c : base) {
+		if (c != ' ' && c != '.') {
+			c = to_upper(c);
+			basis += is_short_name_char(c) ? c : '_';
+		}
+	}
+	if (basis.empty()) {
+		basis = "_";
+	}
+	for (size_t i = 0; i < ext.size() && i < 3; ++i) {
+		const char c           = to_upper(ext[i]);
+		node.short_name[8 + i] = (uint8_t)(is_short_name_char(c) ? c : '_');
+	}
+
+	for (int n = 1; n < 1000000; ++n) {
+		const std::string tail   = "~" + std::to_string(n);
+		const std::string prefix = basis.substr(0, 8 - tail.size());
+		memset(node.short_name, ' ', 8);
+		memcpy(node.short_name, prefix.data(), prefix.size());
+		memcpy(node.short_name + prefix.size(), tail.data(), tail.size());
+		if (used.insert(std::string((char *)node.short_name, 11)).second) {
+			break;
+		}
+	}
+
+	std::vector<uint16_t> name16;
+	utf8_to_utf16(name, name16);
+	node.lfn_entries = (int)((name16.size() + 12) / 13);
+}
+
+static void fat_date_time(time_t t, uint16_t &date, uint16_t &time)
+{
+	const struct tm *tm = localtime(&t);
+	if (tm == nullptr || tm->tm_year < 80) {
+		date = (1 << 5) | 1; // 1980-01-01
+		time = 0;
+		return;
+	}
+	date = (uint16_t)(((tm->tm_year - 80) << 9) | ((tm->tm_mon + 1) << 5) | tm->tm_mday);
+	time = (uint16_t)((tm->tm_hour << 11) | (tm->tm_min << 5) | (tm->tm_sec / 2));
+}
+
+//
+// Building the volume
+//
+
+static void scan_dir(int index)
+{
+	DIR *dirp = opendir(Nodes[index].host_path.c_str());
+	if (dirp == nullptr) {
+		printf("Cannot read directory %s!\n", Nodes[index].host_path.c_str());
+		return;
+	}
+
+	std::vector<std::string> names;
+	while (struct dirent *dp = readdir(dirp)) {
+		if (strcmp(dp->d_name, ".") && strcmp(dp->d_name, "..")) {
+			names.push_back(dp->d_name);
+		}
+	}
+	closedir(dirp);
+
+	// Sorted, so the same directory gives the same volume every time.
+	std::sort(names.begin(), names.end());
+
+	std::unordered_set<std::string> used_short_names;
+	for (const std::string &name : names) {
+		const std::string path = Nodes[index].host_path + "/" + name;
+
+		// A name the card can't hold would come back as another name on the next sync,
+		// and the host file would be replaced by a renamed copy.
+		std::vector<uint16_t> name16;
+		if (!utf8_to_utf16(name, name16) || name16.size() > 255 || name.find('\\') != std::string::npos) {
+			printf("Skipping %s, its name can't be stored on a FAT32 volume.\n", path.c_str());
+			continue;
+		}
+
+		struct stat st;
+		if (stat(path.c_str(), &st) != 0) {
+			continue;
+		}
+		const bool is_dir = S_ISDIR(st.st_mode);
+		if (!is_dir && !S_ISREG(st.st_mode)) {
+			continue;
+		}
+		if (!is_dir && (uint64_t)st.st_size > 0xFFFFFFFF) {
+			printf("Skipping %s, it's too large for FAT32.\n", path.c_str());
+			continue;
+		}
+
+		vfat_node node;
+		node.host_path = path;
+		node.name      = name;
+		node.is_dir    = is_dir;
+		node.size      = is_dir ? 0 : (uint32_t)st.st_size;
+		node.mtime     = st.st_mtime;
+		node.parent    = index;
+		make_short_name(node, used_short_names);
+
+		Nodes.push_back(std::move(node));
+		Nodes[index].children.push_back((int)Nodes.size() - 1);
+	}
+
+	const std::vector<int> children = Nodes[index].children;
+	for (int child : children) {
+		if (Nodes[child].is_dir) {
+			scan_dir(child);
+		}
+	}
+}
+
+static uint32_t dir_entry_count(const vfat_node &dir)
+{
+	uint32_t count = dir.parent >= 0 ? 2 : 0; // . and ..
+	for (int child : dir.children) {
+		count += 1 + Nodes[child].lfn_entries;
+	}
+	return count;
+}
+
+static void layout_volume()
+{
+	// Each node gets a contiguous run of clusters, the root directory first.
+	uint32_t next_cluster = 2;
+	for (vfat_node &node : Nodes) {
+		const uint32_t bytes = node.is_dir ? std::max<uint32_t>(dir_entry_count(node) * 32, 1) : node.size;
+		node.num_clusters    = (uint32_t)(((uint64_t)bytes + Cluster_bytes - 1) / Cluster_bytes);
+		node.first_cluster   = node.num_clusters > 0 ? next_cluster : 0;
+		next_cluster += node.num_clusters;
+	}
+	Used_clusters = next_cluster - 2;
+
+	Total_clusters    = (uint32_t)std::min<uint64_t>(std::max<uint64_t>(Min_clusters, (uint64_t)Used_clusters * 2 + 65536), Max_clusters);
+	Fat_sectors       = (Total_clusters + 2 + 127) / 128;
+	Data_start        = Reserved_sectors + Num_fats * Fat_sectors;
+	Partition_sectors = Data_start + Total_clusters * Sectors_per_cluster;
+
+	Initial_fat.assign(Total_clusters + 2, 0);
+	Initial_fat[0] = 0x0FFFFFF8;
+	Initial_fat[1] = Fat_end_of_chain;
+	for (size_t i = 0; i < Nodes.size(); ++i) {
+		const vfat_node &node = Nodes[i];
+		if (node.num_clusters == 0) {
+			continue;
+		}
+		for (uint32_t c = 0; c < node.num_clusters; ++c) {
+			Initial_fat[node.first_cluster + c] = node.first_cluster + c + 1;
+		}
+		Initial_fat[node.first_cluster + node.num_clusters - 1] = Fat_end_of_chain;
+		Nodes_by_cluster.push_back((int)i);
+	}
+}
+
+static void build_dir_entry(uint8_t *e, const uint8_t *short_name, uint8_t attr, uint8_t case_flags, uint32_t cluster, uint32_t size, time_t mtime)
+{
+	uint16_t date, time;
+	fat_date_time(mtime, date, time);
+
+	memcpy(e, short_name, 11);
+	e[11] = attr;
+	e[12] = case_flags;
+	put16(e + 14, time);
+	put16(e + 16, date);
+	put16(e + 18, date);
+	put16(e + 20, (uint16_t)(cluster >> 16));
+	put16(e + 22, time);
+	put16(e + 24, date);
+	put16(e + 26, (uint16_t)cluster);
+	put32(e + 28, size);
+}
+
+static void build_dir_data(vfat_node &dir)
+{
+	dir.dir_data.assign((size_t)dir.num_clusters * Cluster_bytes, 0);
+	uint8_t *e = dir.dir_data.data();
+
+	if (dir.parent >= 0) {
+		static const uint8_t dot[11]    = { '.', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ' };
+		static const uint8_t dotdot[11] = { '.', '.', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ' };
+
+		// ".." in a directory below the root points to cluster 0, not to the root's actual cluster.
+		const vfat_node &parent = Nodes[dir.parent];
+		build_dir_entry(e, dot, 0x10, 0, dir.first_cluster, 0, dir.mtime);
+		build_dir_entry(e + 32, dotdot, 0x10, 0, parent.parent >= 0 ? parent.first_cluster : 0, 0, parent.mtime);
+		e += 64;
+	}
+
+	for (int child : dir.children) {
+		const vfat_node &node = Nodes[child];
+
+		if (node.lfn_entries > 0) {
+			std::vector<uint16_t> name;
+			utf8_to_utf16(node.name, name);
+			const uint8_t    checksum    = short_name_checksum(node.short_name);
+			static const int offsets[13] = { 1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30 };
+
+			// Long name entries come last part first, right before the short name entry.
+			for (int n = node.lfn_entries; n > 0; --n, e += 32) {
+				e[0]  = (uint8_t)(n | (n == node.lfn_entries ? 0x40 : 0));
+				e[11] = 0x0F;
+				e[13] = checksum;
+				for (int i = 0; i < 13; ++i) {
+					const size_t   pos = (size_t)(n - 1) * 13 + i;
+					const uint16_t c   = pos < name.size() ? name[pos] : (pos == name.size() ? 0x0000 : 0xFFFF);
+					put16(e + offsets[i], c);
+				}
+			}
+		}
+
+		build_dir_entry(e, node.short_name, node.is_dir ? 0x10 : 0x20, node.case_flags, node.first_cluster, node.size, node.mtime);
+		e += 32;
+	}
+}
+
+//
+// Synthesizing sectors
+//
+
+static void build_mbr(uint8_t *dst)
+{
+	uint8_t *p = dst + 0x1BE;
+	p[0]       = 0x00;
+	p[1]       = 0xFE;
+	p[2]       = 0xFF;
+	p[3]       = 0xFF;
+	p[4]       = 0x0C; // FAT32 (LBA)
+	p[5]       = 0xFE;
+	p[6]       = 0xFF;
+	p[7]       = 0xFF;
+	put32(p + 8, Partition_start);
+	put32(p + 12, Partition_sectors);
+
+	put32(dst + 0x1B8, 0x31584F42); // disk signature
+	dst[510] = 0x55;
+	dst[511] = 0xAA;
+}
+
+static void build_boot_sector(uint8_t *dst)
+{
+	static const uint8_t jump[3] = { 0xEB, 0x58, 0x90 };
+
+	memcpy(dst, jump, 3);
+	memcpy(dst + 3, "BOX16   ", 8);
+	put16(dst + 11, 512);
+	dst[13] = Sectors_per_cluster;
+	put16(dst + 14, Reserved_sectors);
+	dst[16] = Num_fats;
+	dst[21] = 0xF8; // fixed disk
+	put16(dst + 24, 63);
+	put16(dst + 26, 255);
+	put32(dst + 28, Partition_start);
+	put32(dst + 32, Partition_sectors);
+	put32(dst + 36, Fat_sectors);
+	put32(dst + 44, 2); // root directory cluster
+	put16(dst + 48, Fsinfo_sector);
+	put16(dst + 50, Backup_boot_sector);
+	dst[64] = 0x80;
+	dst[66] = 0x29;
+	put32(dst + 67, 0xB0C5B0C5); // volume id
+	memcpy(dst + 71, "BOX16      ", 11);
+	memcpy(dst + 82, "FAT32   ", 8);
+	dst[510] = 0x55;
+	dst[511] = 0xAA;
+}
+
+static void build_fsinfo(uint8_t *dst)
+{
+	put32(dst, 0x41615252);
+	put32(dst + 484, 0x61417272);
+	put32(dst + 488, Total_clusters - Used_clusters);
+	put32(dst + 492, Used_clusters + 2);
+	put32(dst + 508, 0xAA550000);
+}
+
+static int find_cluster_node(uint32_t cluster)
+{
+	auto it = std::upper_bound(Nodes_by_cluster.begin(), Nodes_by_cluster.end(), cluster, [](uint32_t c, int node) { return c < Nodes[node].first_cluster; });
+	if (it == Nodes_by_cluster.begin()) {
+		return -1;
+	}
+	const int node = *(it - 1);
+	return cluster - Nodes[node].first_cluster < Nodes[node].num_clusters ? node : -1;
+}
+
+static void read_file_sector(int index, uint64_t offset, uint8_t *dst)
+{
+	const vfat_node &node = Nodes[index];
+	if (offset >= node.size) {
+		return;
+	}
+
+	if (Data_file_node != index) {
+		if (Data_file != nullptr) {
+			fclose(Data_file);
+		}
+		Data_file      = fopen(node.host_path.c_str(), "rb");
+		Data_file_node = index;
+		if (Data_file == nullptr) {
+			printf("Cannot read %s!\n", node.host_path.c_str());
+		}
+	}
+	if (Data_file == nullptr) {
+		return;
+	}
+
+	fseek(Data_file, (long)offset, SEEK_SET);
+	fread(dst, 1, (size_t)std::min<uint64_t>(512, node.size - offset), Data_file);
+}
+
+static void synthesize_sector(uint32_t lba, uint8_t *dst)
+{
+	memset(dst, 0, 512);
+
+	if (lba < Partition_start) {
+		if (lba == 0) {
+			build_mbr(dst);
+		}
+		return;
+	}
+
+	const uint32_t sector = lba - Partition_start;
+	if (sector >= Partition_sectors) {
+		return;
+	}
+
+	if (sector < Reserved_sectors) {
+		if (sector == 0 || sector == Backup_boot_sector) {
+			build_boot_sector(dst);
+		} else if (sector == Fsinfo_sector || sector == Backup_boot_sector + Fsinfo_sector) {
+			build_fsinfo(dst);
+		}
+		return;
+	}
+
+	if (sector < Data_start) {
+		const uint32_t first = ((sector - Reserved_sectors) % Fat_sectors) * 128;
+		for (uint32_t i = 0; i < 128 && first + i < Initial_fat.size(); ++i) {
+			put32(dst + i * 4, Initial_fat[first + i]);
+		}
+		return;
+	}
+
+	const uint32_t cluster = (sector - Data_start) / Sectors_per_cluster + 2;
+	const int      index   = find_cluster_node(cluster);
+	if (index < 0) {
+		return;
+	}
+
+	vfat_node &    node   = Nodes[index];
+	const uint64_t offset = (uint64_t)(cluster - node.first_cluster) * Cluster_bytes + ((sector - Data_start) % Sectors_per_cluster) * 512;
+	if (node.is_dir) {
+		if (node.dir_data.empty()) {
+			build_dir_data(node);
+		}
+		memcpy(dst, node.dir_data.data() + offset, 512);
+	} else if (node.host_backed) {
+		read_file_sector(index, offset, dst);
+	}
+}
+
+//
+// Writing back to the host
+//
+
+static void read_sector(uint32_t lba, uint8_t *dst)
+{
+	auto sector = Written.find(lba);
+	if (sector != Written.end()) {
+		memcpy(dst, sector->second.data(), 512);
+	} else {
+		synthesize_sector(lba, dst);
+	}
+}
+
+static uint32_t cluster_lba(uint32_t cluster)
+{
+	return Partition_start + Data_start + (cluster - 2) * Sectors_per_cluster;
+}
+
+static std::vector<uint32_t> cluster_chain(uint32_t cluster)
+{
+	std::vector<uint32_t> chain;
+	uint8_t               buf[512];
+	uint32_t              buf_lba = 0;
+
+	while (cluster >= 2 && cluster < Total_clusters + 2 && chain.size() < Total_clusters) {
+		chain.push_back(cluster);
+
+		const uint32_t lba = Partition_start + Reserved_sectors + cluster / 128;
+		if (lba != buf_lba) {
+			read_sector(lba, buf);
+			buf_lba = lba;
+		}
+		cluster = get32(buf + (cluster % 128) * 4) & 0x0FFFFFFF;
+	}
+	return chain;
+}
+
+static bool chain_written_since_sync(const std::vector<uint32_t> &chain)
+{
+	for (uint32_t cluster : chain) {
+		for (uint32_t s = 0; s < Sectors_per_cluster; ++s) {
+			if (Written_since_sync.count(cluster_lba(cluster) + s)) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+struct found_entry {
+	std::string path;
+	bool        is_dir;
+	uint32_t    first_cluster;
+	uint32_t    size;
+};
+
+static void walk_dir(uint32_t cluster, const std::string &path, std::vector<found_entry> &found, std::unordered_set<uint32_t> &visited)
+{
+	if (!visited.insert(cluster).second) {
+		return;
+	}
+
+	std::vector<uint16_t> lfn;
+	int                   lfn_checksum = -1;
+
+	uint8_t sector[512];
+	for (uint32_t c : cluster_chain(cluster)) {
+		for (uint32_t s = 0; s < Sectors_per_cluster; ++s) {
+			read_sector(cluster_lba(c) + s, sector);
+
+			for (int i = 0; i < 512; i += 32) {
+				const uint8_t *e = sector + i;
+				if (e[0] == 0x00) {
+					return;
+				}
+				if (e[0] == 0xE5) {
+					lfn_checksum = -1;
+					continue;
+				}
+
+				if (e[11] == 0x0F) {
+					static const int offsets[13] = { 1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30 };
+
+					const int ord = e[0] & 0x1F;
+					if (e[0] & 0x40) {
+						lfn.assign((size_t)ord * 13, 0xFFFF);
+						lfn_checksum = e[13];
+					}
+					if (ord == 0 || (size_t)ord * 13 > lfn.size() || lfn_checksum != e[13]) {
+						lfn_checksum = -1;
+						continue;
+					}
+					for (int j = 0; j < 13; ++j) {
+						lfn[(size_t)(ord - 1) * 13 + j] = get16(e + offsets[j]);
+					}
+					continue;
+				}
+
+				if (e[11] & 0x08) {
+					lfn_checksum = -1;
+					continue;
+				}
+
+				std::string name;
+				if (lfn_checksum == short_name_checksum(e)) {
+					for (uint16_t ch : lfn) {
+						if (ch == 0x0000 || ch == 0xFFFF) {
+							break;
+						}
+						append_utf8(name, ch);
+					}
+				}
+				lfn_checksum = -1;
+
+				if (name.empty()) {
+					for (int j = 0; j < 8 && e[j] != ' '; ++j) {
+						const char ch = (char)(j == 0 && e[j] == 0x05 ? 0xE5 : e[j]);
+						name += (e[12] & 0x08) && ch >= 'A' && ch <= 'Z' ? (char)(ch - 'A' + 'a') : ch;
+					}
+					if (e[8] != ' ') {
+						name += '.';
+						for (int j = 8; j < 11 && e[j] != ' '; ++j) {
+							name += (e[12] & 0x10) && e[j] >= 'A' && e[j] <= 'Z' ? (char)(e[j] - 'A' + 'a') : (char)e[j];
+						}
+					}
+				}
+				if (name == "." || name == ".." || name.find('/') != std::string::npos || name.find('\\') != std::string::npos) {
+					continue;
+				}
+
+				const bool     is_dir        = (e[11] & 0x10) != 0;
+				const uint32_t first_cluster = ((uint32_t)get16(e + 20) << 16) | get16(e + 26);
+				const uint32_t size          = get32(e + 28);
+				found.push_back({ path + "/" + name, is_dir, first_cluster, size });
+				if (is_dir) {
+					walk_dir(first_cluster, path + "/" + name, found, visited);
+				}
+			}
+		}
+	}
+}
+
+// Stop reading a host file's data lazily: its clean sectors are copied in, so the host
+// file can be replaced or removed without the card changing underneath the X16.
+static void detach_host_file(const std::string &path)
+{
+	auto it = Nodes_by_path.find(path);
+	if (it == Nodes_by_path.end()) {
+		return;
+	}
+
+	vfat_node &node = Nodes[it->second];
+	if (node.is_dir || !node.host_backed) {
+		return;
+	}
+
+	for (uint32_t c = 0; c < node.num_clusters; ++c) {
+		for (uint32_t s = 0; s < Sectors_per_cluster; ++s) {
+			const uint32_t lba = cluster_lba(node.first_cluster + c) + s;
+			if (!Written.count(lba)) {
+				synthesize_sector(lba, Written[lba].data());
+			}
+		}
+	}
+
+	node.host_backed = false;
+	if (Data_file_node == it->second) {
+		fclose(Data_file);
+		Data_file      = nullptr;
+		Data_file_node = -1;
+	}
+}
+
+static bool write_host_file(const found_entry &entry)
+{
+	const std::string temp_path = entry.path + ".box16tmp";
+	FILE *            f         = fopen(temp_path.c_str(), "wb");
+	if (f == nullptr) {
+		printf("Cannot write %s!\n", temp_path.c_str());
+		return false;
+	}
+
+	uint8_t  sector[512];
+	uint32_t remaining = entry.size;
+	for (uint32_t c : cluster_chain(entry.first_cluster)) {
+		for (uint32_t s = 0; s < Sectors_per_cluster && remaining > 0; ++s) {
+			read_sector(cluster_lba(c) + s, sector);
+			const uint32_t n = std::min<uint32_t>(remaining, 512);
+			fwrite(sector, 1, n, f);
+			remaining -= n;
+		}
+	}
+	fclose(f);
+
+	// rename() won't replace an existing file on Windows.
+	remove(entry.path.c_str());
+	if (rename(temp_path.c_str(), entry.path.c_str()) != 0) {
+		printf("Cannot write %s!\n", entry.path.c_str());
+		return false;
+	}
+	return true;
+}
+
+void sdcard_vfat_sync()
+{
+	if (!Vfat_open || Written_since_sync.empty()) {
+		return;
+	}
+
+	std::vector<found_entry>     found;
+	std::unordered_set<uint32_t> visited;
+	walk_dir(2, Root_path, found, visited);
+
+	std::unordered_set<std::string>  found_paths;
+	std::vector<const found_entry *> dirs_to_create;
+	std::vector<const found_entry *> files_to_write;
+	for (const found_entry &entry : found) {
+		found_paths.insert(entry.path);
+
+		auto synced = Synced.find(entry.path);
+		if (entry.is_dir) {
+			if (synced == Synced.end() || !synced->second.is_dir) {
+				dirs_to_create.push_back(&entry);
+			}
+		} else if (synced == Synced.end() || synced->second.is_dir || synced->second.first_cluster != entry.first_cluster || synced->second.size != entry.size || chain_written_since_sync(cluster_chain(entry.first_cluster))) {
+			files_to_write.push_back(&entry);
+		}
+	}
+
+	std::vector<std::string> to_remove;
+	for (auto &synced : Synced) {
+		if (!found_paths.count(synced.first)) {
+			to_remove.push_back(synced.first);
+		}
+	}
+
+	// Files whose host copy is about to go away are still needed where the X16 didn't write over them.
+	for (const std::string &path : to_remove) {
+		detach_host_file(path);
+	}
+	for (const found_entry *entry : files_to_write) {
+		detach_host_file(entry->path);
+	}
+
+	// Deepest paths first, so directories are empty by the time they're removed.
+	std::sort(to_remove.begin(), to_remove.end(), [](const std::string &a, const std::string &b) { return a.size() > b.size(); });
+	int changes = 0;
+	for (const std::string &path : to_remove) {
+		if (Synced[path].is_dir ? remove_dir(path.c_str()) == 0 : remove(path.c_str()) == 0) {
+			++changes;
+		}
+	}
+	for (const found_entry *entry : dirs_to_create) {
+		if (make_dir(entry->path.c_str()) == 0) {
+			++changes;
+		}
+	}
+	for (const found_entry *entry : files_to_write) {
+		if (write_host_file(*entry)) {
+			++changes;
+		}
+	}
+
+	Synced.clear();
+	for (const found_entry &entry : found) {
+		Synced[entry.path] = { entry.is_dir, entry.first_cluster, entry.size };
+	}
+	Written_since_sync.clear();
+
+	if (changes > 0) {
+		printf("Wrote %d SD card changes back to %s.\n", changes, Root_path.c_str());
+	}
+}
+
+//
+// Interface
+//
+
+bool sdcard_vfat_is_directory(const char *path)
+{
+	struct stat st;
+	return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+bool sdcard_vfat_open(const char *dir)
+{
+	sdcard_vfat_close();
+
+	Root_path = dir;
+	while (Root_path.size() > 1 && (Root_path.back() == '/' || Root_path.back() == '\\')) {
+		Root_path.pop_back();
+	}
+
+	struct stat st;
+	if (stat(Root_path.c_str(), &st) != 0) {
+		printf("Cannot open directory %s!\n", dir);
+		return false;
+	}
+
+	vfat_node root;
+	root.host_path   = Root_path;
+	root.is_dir      = true;
+	root.size        = 0;
+	root.mtime       = st.st_mtime;
+	root.parent      = -1;
+	root.lfn_entries = 0;
+	Nodes.push_back(std::move(root));
+
+	scan_dir(0);
+	if (Nodes.size() > 1 && Nodes.size() * 2 > Max_clusters) {
+		printf("Directory %s has too many files for a FAT32 volume!\n", dir);
+		sdcard_vfat_close();
+		return false;
+	}
+	layout_volume();
+	if (Used_clusters > Max_clusters / 2) {
+		printf("Directory %s is too large for a FAT32 volume!\n", dir);
+		sdcard_vfat_close();
+		return false;
+	}
+
+	for (size_t i = 1; i < Nodes.size(); ++i) {
+		const vfat_node &node         = Nodes[i];
+		Synced[node.host_path]        = { node.is_dir, node.first_cluster, node.size };
+		Nodes_by_path[node.host_path] = (int)i;
+	}
+
+	Vfat_open = true;
+	printf("Presenting %s as a %u MiB FAT32 SD card.\n", Root_path.c_str(), (unsigned)(((uint64_t)Partition_start + Partition_sectors) / 2048));
+	return true;
+}
+
+void sdcard_vfat_close()
+{
+	sdcard_vfat_sync();
+
+	if (Data_file != nullptr) {
+		fclose(Data_file);
+	}
+	Data_file      = nullptr;
+	Data_file_node = -1;
+
+	Nodes.clear();
+	Nodes_by_cluster.clear();
+	Nodes_by_path.clear();
+	Initial_fat.clear();
+	Written.clear();
+	Written_since_sync.clear();
+	Synced.clear();
+	Vfat_open = false;
+}
+
+bool sdcard_vfat_is_open()
+{
+	return Vfat_open;
+}
+
+void sdcard_vfat_read(uint32_t lba, uint8_t *dst)
+{
+	read_sector(lba, dst);
+}
+
+void sdcard_vfat_write(uint32_t lba, const uint8_t *src)
+{
+	memcpy(Written[lba].data(), src, 512);
+	Written_since_sync.insert(lba);
+}
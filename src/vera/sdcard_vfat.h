@@ -0,0 +1,24 @@
+#pragma once
+#if !defined(SDCARD_VFAT_H)
+#	define SDCARD_VFAT_H
+
+#	include <stdint.h>
+
+// Presents a host directory as an SD card holding a single FAT32 partition.
+// The boot sector, FATs and directories are generated when read, file data is
+// read from the host files when needed. Sectors written by the X16 are kept in
+// memory, and sdcard_vfat_sync() writes the resulting files back to the directory.
+
+bool sdcard_vfat_is_directory(const char *path);
+
+bool sdcard_vfat_open(const char *dir);
+void sdcard_vfat_close();
+bool sdcard_vfat_is_open();
+
+void sdcard_vfat_read(uint32_t lba, uint8_t *dst);
+void sdcard_vfat_write(uint32_t lba, const uint8_t *src);
+
+// Write files created, changed or deleted on the card back to the host directory.
+void sdcard_vfat_sync();
+
+#endif
\ No newline at end of file
@@ -4,8 +4,15 @@
 
 #include "vera_pcm.h"
 #include <stdio.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	include <emmintrin.h>
+#	define PCM_RENDER_SSE2
+#endif
 
 #include "audio.h"
+#include "state.h"
 
 static uint8_t  fifo[4096 - 1]; // Actual hardware FIFO is 4kB, but you can only use 4095 bytes.
 static unsigned fifo_wridx;
@@ -42,6 +49,19 @@ void pcm_reset(void)
 	phase = 0;
 }
 
+void pcm_save_restore(state_stream &state)
+{
+	state.field(fifo);
+	state.field(fifo_wridx);
+	state.field(fifo_rdidx);
+	state.field(fifo_cnt);
+	state.field(ctrl);
+	state.field(rate);
+	state.field(cur_l);
+	state.field(cur_r);
+	state.field(phase);
+}
+
 void pcm_write_ctrl(uint8_t val)
 {
 	if (val & 0x80) {
@@ -84,62 +104,142 @@ void pcm_write_fifo(uint8_t val)
 	}
 }
 
-static uint8_t read_fifo(void)
+bool pcm_is_fifo_almost_empty(void)
 {
-	if (fifo_cnt == 0) {
-		return 0;
-	}
-	uint8_t result = fifo[fifo_rdidx++];
-	if (fifo_rdidx == sizeof(fifo)) {
-		fifo_rdidx = 0;
+	return fifo_cnt < 1024;
+}
+
+// Output samples rendered per block; bounds the staging buffers below.
+static constexpr unsigned Block_samples = 256;
+
+// Move the next `bytes` bytes out of the FIFO into dst, in at most two contiguous
+// spans. Like reading the hardware FIFO, running dry yields zeroes.
+static void read_fifo_span(uint8_t *dst, unsigned bytes)
+{
+	const unsigned avail = bytes < fifo_cnt ? bytes : fifo_cnt;
+	const unsigned tail  = sizeof(fifo) - fifo_rdidx;
+	const unsigned first = avail < tail ? avail : tail;
+
+	memcpy(dst, fifo + fifo_rdidx, first);
+	memcpy(dst + first, fifo, avail - first);
+	memset(dst + avail, 0, bytes - avail);
+
+	fifo_rdidx += avail;
+	if (fifo_rdidx >= sizeof(fifo)) {
+		fifo_rdidx -= sizeof(fifo);
 	}
-	fifo_cnt--;
+	fifo_cnt -= avail;
 	if (fifo_cnt < dbg_minsiz) {
 		dbg_minsiz = fifo_cnt;
 	}
-	return result;
 }
 
-bool pcm_is_fifo_almost_empty(void)
+// MODE is AUDIO_CTRL bits 4-5: bit 0 = stereo, bit 1 = 16-bit
+template <int MODE>
+static constexpr unsigned frame_size()
 {
-	return fifo_cnt < 1024;
+	return ((MODE & 1) ? 2 : 1) * ((MODE & 2) ? 2 : 1);
 }
 
-void pcm_render(int16_t *buf, unsigned num_samples)
+template <int MODE>
+static inline void decode_frame(const uint8_t *src)
+{
+	if constexpr (MODE == 0) { // mono 8-bit
+		cur_l = (int16_t)(src[0] << 8);
+		cur_r = cur_l;
+	} else if constexpr (MODE == 1) { // stereo 8-bit
+		cur_l = (int16_t)(src[0] << 8);
+		cur_r = (int16_t)(src[1] << 8);
+	} else if constexpr (MODE == 2) { // mono 16-bit
+		cur_l = (int16_t)(src[0] | (src[1] << 8));
+		cur_r = cur_l;
+	} else { // stereo 16-bit
+		cur_l = (int16_t)(src[0] | (src[1] << 8));
+		cur_r = (int16_t)(src[2] | (src[3] << 8));
+	}
+}
+
+template <int MODE>
+static void render_block(int16_t *buf, unsigned num_samples)
 {
-	while (num_samples--) {
-		uint8_t old_phase = phase;
+	constexpr unsigned size = frame_size<MODE>();
+
+	uint8_t staging[Block_samples * 4];
+
+	if (rate == 128) {
+		// 1:1, every output sample consumes a frame.
+		read_fifo_span(staging, num_samples * size);
+		for (unsigned i = 0; i < num_samples; ++i) {
+			decode_frame<MODE>(staging + i * size);
+			buf[i * 2]     = cur_l;
+			buf[i * 2 + 1] = cur_r;
+		}
+		phase += (uint8_t)(rate * num_samples);
+		return;
+	}
+
+	// A new frame is due whenever bit 7 of the phase accumulator flips. Work out
+	// which samples those are first, so the FIFO can be drained in one go.
+	bool     fetch[Block_samples];
+	unsigned num_fetches = 0;
+	for (unsigned i = 0; i < num_samples; ++i) {
+		const uint8_t old_phase = phase;
 		phase += rate;
-		if ((old_phase & 0x80) != (phase & 0x80)) {
-			switch ((ctrl >> 4) & 3) {
-				case 0: { // mono 8-bit
-					cur_l = (int16_t)read_fifo() << 8;
-					cur_r = cur_l;
-					break;
-				}
-				case 1: { // stereo 8-bit
-					cur_l = read_fifo() << 8;
-					cur_r = read_fifo() << 8;
-					break;
-				}
-				case 2: { // mono 16-bit
-					cur_l = read_fifo();
-					cur_l |= read_fifo() << 8;
-					cur_r = cur_l;
-					break;
-				}
-				case 3: { // stereo 16-bit
-					cur_l = read_fifo();
-					cur_l |= read_fifo() << 8;
-					cur_r = read_fifo();
-					cur_r |= read_fifo() << 8;
-					break;
-				}
-			}
+		fetch[i] = ((old_phase ^ phase) & 0x80) != 0;
+		num_fetches += fetch[i];
+	}
+
+	read_fifo_span(staging, num_fetches * size);
+
+	const uint8_t *src = staging;
+	for (unsigned i = 0; i < num_samples; ++i) {
+		if (fetch[i]) {
+			decode_frame<MODE>(src);
+			src += size;
+		}
+		buf[i * 2]     = cur_l;
+		buf[i * 2 + 1] = cur_r;
+	}
+}
+
+static void apply_volume(int16_t *buf, unsigned count, int volume)
+{
+	if (volume == 64) {
+		return;
+	}
+
+	unsigned i = 0;
+#if defined(PCM_RENDER_SSE2)
+	// Widen to 32 bits with madd against (volume, 0) pairs, shift, and pack back down.
+	const __m128i v    = _mm_set1_epi32(volume);
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 8 <= count; i += 8) {
+		const __m128i x  = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + i));
+		const __m128i lo = _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(x, zero), v), 6);
+		const __m128i hi = _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(x, zero), v), 6);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(buf + i), _mm_packs_epi32(lo, hi));
+	}
+#endif
+	for (; i < count; ++i) {
+		buf[i] = (int16_t)(((int)buf[i] * volume) >> 6);
+	}
+}
+
+void pcm_render(int16_t *buf, unsigned num_samples)
+{
+	while (num_samples > 0) {
+		const unsigned n = num_samples < Block_samples ? num_samples : Block_samples;
+
+		switch ((ctrl >> 4) & 3) {
+			case 0: render_block<0>(buf, n); break;
+			case 1: render_block<1>(buf, n); break;
+			case 2: render_block<2>(buf, n); break;
+			case 3: render_block<3>(buf, n); break;
 		}
+		apply_volume(buf, n * 2, volume_lut[ctrl & 0xF]);
 
-		*(buf++) = ((int)cur_l * (int)volume_lut[ctrl & 0xF]) >> 6;
-		*(buf++) = ((int)cur_r * (int)volume_lut[ctrl & 0xF]) >> 6;
+		buf += n * 2;
+		num_samples -= n;
 	}
 }
 
@@ -7,6 +7,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+class state_stream;
+
 struct pcm_debug_info {
 	uint8_t *fifo;
 	unsigned curidx;
@@ -16,6 +18,7 @@ struct pcm_debug_info {
 };
 
 void           pcm_reset(void);
+void           pcm_save_restore(state_stream &state);
 void           pcm_write_ctrl(uint8_t val);
 uint8_t        pcm_read_ctrl(void);
 void           pcm_write_rate(uint8_t val);
@@ -5,10 +5,10 @@
 #include "vera_psg.h"
 
 #include <stdbool.h>
-#include <stdlib.h>
 #include <string.h>
 
 #include "audio.h"
+#include "state.h"
 
 static psg_channel Channels[PSG_NUM_CHANNELS];
 
@@ -18,6 +18,14 @@ void psg_reset(void)
 {
 	audio_lock_scope lock;
 	memset(Channels, 0, sizeof(Channels));
+	for (int i = 0; i < PSG_NUM_CHANNELS; ++i) {
+		Channels[i].noise_lfsr = (uint16_t)(i + 1);
+	}
+}
+
+void psg_save_restore(state_stream &state)
+{
+	state.field(Channels);
 }
 
 void psg_writereg(uint8_t reg, uint8_t val)
@@ -45,6 +53,19 @@ void psg_writereg(uint8_t reg, uint8_t val)
 	}
 }
 
+// The noise is rendered ahead of the machine's clock, in blocks, so it can't come from
+// noise_byte(). Each channel has its own 16-bit LFSR instead, kept in the machine state.
+static uint8_t next_noise(psg_channel *ch)
+{
+	if (ch->noise_lfsr == 0) {
+		ch->noise_lfsr = 1;
+	}
+	for (int i = 0; i < 6; ++i) {
+		ch->noise_lfsr = (ch->noise_lfsr >> 1) ^ ((ch->noise_lfsr & 1) ? 0xb400 : 0);
+	}
+	return ch->noise_lfsr & 63;
+}
+
 static void render(int16_t *left, int16_t *right)
 {
 	int l = 0;
@@ -55,7 +76,7 @@ static void render(int16_t *left, int16_t *right)
 
 		unsigned new_phase = (ch->phase + ch->freq) & 0x1FFFF;
 		if ((ch->phase & 0x10000) != (new_phase & 0x10000)) {
-			ch->noiseval = rand() & 63;
+			ch->noiseval = next_noise(ch);
 		}
 		ch->phase = new_phase;
 
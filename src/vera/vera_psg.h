@@ -8,6 +8,8 @@
 
 #define PSG_NUM_CHANNELS (16)
 
+class state_stream;
+
 enum waveform {
 	WF_PULSE = 0,
 	WF_SAWTOOTH,
@@ -24,9 +26,11 @@ struct psg_channel {
 
 	unsigned phase;
 	uint8_t  noiseval;
+	uint16_t noise_lfsr; // never 0
 };
 
 void psg_reset(void);
+void psg_save_restore(state_stream &state);
 void psg_writereg(uint8_t reg, uint8_t val);
 void psg_render(int16_t *buf, unsigned int num_samples);
 
@@ -9,6 +9,8 @@
 #include <stdio.h>
 
 #include "cpu/fake6502.h"
+#include "options.h"
+#include "state.h"
 
 bool    ss;
 bool    busy;
@@ -16,19 +18,52 @@ bool    autotx;
 uint8_t sending_byte, received_byte;
 int     outcounter;
 
+// Fast SPI: bytes clocked out with $FF are taken from the SD card a whole response
+// part at a time (one memcpy per data block) and handed out from here. The 6502 still
+// sees each byte take 8 clocks.
+static uint8_t bulk_buf[512];
+static int     bulk_pos = 0;
+static int     bulk_len = 0;
+
+static uint64_t last_clocks = 0;
+
 void vera_spi_init()
 {
 	ss            = false;
 	busy          = false;
 	autotx        = false;
 	received_byte = 0xff;
+	bulk_pos      = 0;
+	bulk_len      = 0;
+}
+
+static uint8_t vera_spi_transfer(uint8_t value)
+{
+	if (!sdcard_is_attached()) {
+		bulk_pos = bulk_len = 0;
+		return 0xff;
+	}
+
+	if (value == 0xff && !Options.no_fast_spi) {
+		if (bulk_pos == bulk_len) {
+			bulk_pos = 0;
+			bulk_len = sdcard_read_bulk(bulk_buf, sizeof(bulk_buf));
+		}
+		if (bulk_pos < bulk_len) {
+			return bulk_buf[bulk_pos++];
+		}
+		return sdcard_handle(value);
+	}
+
+	// Anything else starts a command or data, which drops whatever is left of the response.
+	bulk_pos = bulk_len = 0;
+	return sdcard_handle(value);
 }
 
 void vera_spi_autostep()
 {
-	static uint64_t clocks = 0;
-	vera_spi_step((int)(clockticks6502 - clocks));
-	clocks = clockticks6502;
+	vera_spi_step((int)(clockticks6502 - last_clocks));
+	last_clocks = clockticks6502;
 }
 
 void vera_spi_step(int clocks)
@@ -36,16 +71,26 @@ void vera_spi_step(int clocks)
 	if (busy) {
 		outcounter += clocks;
 		if (outcounter >= 8) {
-			busy = false;
-			if (sdcard_is_attached()) {
-				received_byte = sdcard_handle(sending_byte);
-			} else {
-				received_byte = 0xff;
-			}
+			busy          = false;
+			received_byte = vera_spi_transfer(sending_byte);
 		}
 	}
 }
 
+void vera_spi_save_restore(state_stream &state)
+{
+	state.field(ss);
+	state.field(busy);
+	state.field(autotx);
+	state.field(sending_byte);
+	state.field(received_byte);
+	state.field(outcounter);
+	state.field(bulk_buf);
+	state.field(bulk_pos);
+	state.field(bulk_len);
+	state.field(last_clocks);
+}
+
 uint8_t debug_vera_spi_read(uint8_t reg)
 {
 	switch (reg) {
@@ -86,7 +131,8 @@ void vera_spi_write(uint8_t reg, uint8_t value)
 			break;
 		case 1:
 			if (ss != (value & 1)) {
-				ss = value & 1;
+				ss       = value & 1;
+				bulk_pos = bulk_len = 0;
 				if (ss) {
 					sdcard_select(ss);
 				}
@@ -4,8 +4,11 @@
 
 #include <inttypes.h>
 
+class state_stream;
+
 void    vera_spi_init();
 void    vera_spi_step(int clocks);
+void    vera_spi_save_restore(state_stream &state);
 uint8_t debug_vera_spi_read(uint8_t reg);
 uint8_t vera_spi_read(uint8_t address);
 void    vera_spi_write(uint8_t address, uint8_t value);
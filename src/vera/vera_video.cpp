@@ -9,6 +9,12 @@
 #include "vera_psg.h"
 #include "vera_spi.h"
 
+#include "debugger.h"
+#include "noise.h"
+#include "sound_recorder.h"
+#include "state.h"
+
+#include <algorithm>
 #include <limits.h>
 
 #ifdef __EMSCRIPTEN__
@@ -71,7 +77,9 @@
 
 static bool is_fullscreen = false;
 
-static uint8_t video_ram[0x20000];
+static uint8_t video_ram[VRAM_SIZE];
+static uint8_t video_ram_dirty[sizeof(video_ram) >> 8];
+static uint8_t video_ram_watch[sizeof(video_ram) >> 8];
 static uint8_t palette[256 * 2];
 static uint8_t sprite_data[128][8];
 
@@ -100,6 +108,7 @@ static bool    sprite_line_enable;
 
 static float    scan_pos_x;
 static uint16_t scan_pos_y;
+static uint32_t data_write_count = 0;
 
 static int frame_count = 0;
 static int cheat_mask  = 0;
@@ -153,8 +162,9 @@ void vera_video_reset()
 
 	// fill video RAM with random data
 	for (int i = 0; i < 128 * 1024; i++) {
-		video_ram[i] = rand();
+		video_ram[i] = noise_byte();
 	}
+	memset(video_ram_dirty, 1, sizeof(video_ram_dirty));
 
 	sprite_line_collisions = 0;
 
@@ -939,6 +949,50 @@ void vera_video_save(SDL_RWops *f)
 	SDL_RWwrite(f, &sprite_data[0], sizeof(uint8_t), sizeof(sprite_data));
 }
 
+void vera_video_save_restore(state_stream &state)
+{
+	state.memory(video_ram, sizeof(video_ram));
+	state.field(palette);
+	state.field(sprite_data);
+
+	state.field(io_addr);
+	state.field(io_rddata);
+	state.field(io_inc);
+	state.field(io_addrsel);
+	state.field(io_dcsel);
+	state.field(ien);
+	state.field(isr);
+	state.field(irq_line);
+	state.field(reg_layer);
+	state.field(reg_composer);
+
+	state.field(sprite_line_collisions);
+	state.field(scan_pos_x);
+	state.field(scan_pos_y);
+	state.field(frame_count);
+	state.memory(framebuffer, sizeof(framebuffer));
+
+	if (!state.saving()) {
+		// Everything else is derived from the registers. Line buffers are only cleared
+		// when their layer gets disabled, so start over as if all were disabled.
+		for (uint8_t layer = 0; layer < 2; ++layer) {
+			refresh_layer_properties(layer);
+		}
+		for (uint16_t sprite = 0; sprite < NUM_SPRITES; ++sprite) {
+			refresh_sprite_properties(sprite);
+		}
+		refresh_palette();
+
+		memset(layer_line, 0, sizeof(layer_line));
+		memset(sprite_line_col, 0, sizeof(sprite_line_col));
+		memset(sprite_line_z, 0, sizeof(sprite_line_z));
+		memset(sprite_line_mask, 0, sizeof(sprite_line_mask));
+		layer_line_enable[0] = false;
+		layer_line_enable[1] = false;
+		sprite_line_enable   = false;
+	}
+}
+
 static const int increments[32] = {
 	0,
 	0,
@@ -1005,10 +1059,16 @@ void vera_video_space_read_range(uint8_t *dest, uint32_t address, uint32_t size)
 
 void vera_video_space_write(uint32_t address, uint8_t value)
 {
-	video_ram[address & 0x1FFFF] = value;
+	if (video_ram_watch[(address & 0x1FFFF) >> 8] & (WATCH_WRITE | WATCH_CHANGE)) {
+		debugger_watch_vram(address & 0x1FFFF, WATCH_WRITE, video_ram[address & 0x1FFFF], value);
+	}
+
+	video_ram[address & 0x1FFFF]             = value;
+	video_ram_dirty[(address & 0x1FFFF) >> 8] = 1;
 
 	if (address >= ADDR_PSG_START && address < ADDR_PSG_END) {
 		psg_writereg(address & 0x3f, value);
+		sound_recorder_psg_write(address & 0x3f, value);
 	} else if (address >= ADDR_PALETTE_START && address < ADDR_PALETTE_END) {
 		palette[address & 0x1ff] = value;
 		video_palette.dirty      = true;
@@ -1018,6 +1078,52 @@ void vera_video_space_write(uint32_t address, uint8_t value)
 	}
 }
 
+// How many of the bytes from the address on come before a page watched for writes.
+static uint32_t unwatched_bytes(uint32_t address, uint32_t size)
+{
+	uint32_t n = 0;
+	while (n < size && !(video_ram_watch[(address + n) >> 8] & (WATCH_WRITE | WATCH_CHANGE))) {
+		n += 0x100 - ((address + n) & 0xff);
+	}
+	return std::min(n, size);
+}
+
+void vera_video_space_write_range(uint32_t address, const uint8_t *src, uint32_t size)
+{
+	while (size > 0) {
+		address &= 0x1FFFF;
+
+		uint32_t n;
+		if (video_ram_watch[address >> 8] & (WATCH_WRITE | WATCH_CHANGE)) {
+			// Watched pages go through the watchpoints a byte at a time.
+			vera_video_space_write(address, *src);
+			n = 1;
+		} else if (address < ADDR_PSG_START) {
+			n = unwatched_bytes(address, std::min(size, ADDR_PSG_START - address));
+		} else if (address < ADDR_PSG_END) {
+			// Every PSG register write has to reach the PSG (and the sound log).
+			vera_video_space_write(address, *src);
+			n = 1;
+		} else if (address < ADDR_PALETTE_END) {
+			n = unwatched_bytes(address, std::min(size, ADDR_PALETTE_END - address));
+			memcpy(&palette[address & 0x1ff], src, n);
+			video_palette.dirty = true;
+		} else {
+			n = unwatched_bytes(address, std::min(size, ADDR_SPRDATA_END - address));
+			memcpy(&sprite_data[0][0] + (address & 0x3ff), src, n);
+			for (uint32_t sprite = (address >> 3) & 0x7f; sprite <= ((address + n - 1) >> 3 & 0x7f); ++sprite) {
+				refresh_sprite_properties(sprite);
+			}
+		}
+
+		memcpy(&video_ram[address], src, n);
+		memset(&video_ram_dirty[address >> 8], 1, ((address + n - 1) >> 8) - (address >> 8) + 1);
+		address += n;
+		src += n;
+		size -= n;
+	}
+}
+
 //
 // Vera: 6502 I/O Interface
 //
@@ -1083,6 +1189,10 @@ uint8_t vera_video_read(uint8_t reg)
 			uint8_t value      = io_rddata[reg - 3];
 			io_rddata[reg - 3] = vera_video_space_read(io_addr[reg - 3]);
 
+			if (video_ram_watch[(address & 0x1FFFF) >> 8] & WATCH_READ) {
+				debugger_watch_vram(address & 0x1FFFF, WATCH_READ, value, value);
+			}
+
 			if (log_video) {
 				printf("READ  video_space[$%X] = $%02X\n", address, value);
 			}
@@ -1151,6 +1261,7 @@ void vera_video_write(uint8_t reg, uint8_t value)
 				printf("WRITE video_space[$%X] = $%02X\n", address, value);
 			}
 			vera_video_space_write(address, value);
+			++data_write_count;
 
 			io_rddata[reg - 3] = vera_video_space_read(io_addr[reg - 3]);
 			break;
@@ -1210,9 +1321,18 @@ void vera_video_write(uint8_t reg, uint8_t value)
 			refresh_layer_properties(1);
 			break;
 
-		case 0x1B: pcm_write_ctrl(value); break;
-		case 0x1C: pcm_write_rate(value); break;
-		case 0x1D: pcm_write_fifo(value); break;
+		case 0x1B:
+			pcm_write_ctrl(value);
+			sound_recorder_pcm_write(reg, value);
+			break;
+		case 0x1C:
+			pcm_write_rate(value);
+			sound_recorder_pcm_write(reg, value);
+			break;
+		case 0x1D:
+			pcm_write_fifo(value);
+			sound_recorder_pcm_write(reg, value);
+			break;
 
 		case 0x1E:
 		case 0x1F:
@@ -1264,6 +1384,21 @@ const uint8_t *vera_video_get_framebuffer()
 	return framebuffer;
 }
 
+uint8_t *vera_video_get_vram()
+{
+	return video_ram;
+}
+
+uint8_t *vera_video_get_dirty_pages()
+{
+	return video_ram_dirty;
+}
+
+uint8_t *vera_video_get_watch_pages()
+{
+	return video_ram_watch;
+}
+
 void vera_video_get_increment_values(const int **in, int *length)
 {
 	if (in != nullptr && length != nullptr) {
@@ -1504,6 +1639,11 @@ uint16_t vera_video_get_scan_pos_y()
 	return scan_pos_y;
 }
 
+uint32_t vera_video_get_data_write_count()
+{
+	return data_write_count;
+}
+
 vera_video_rect vera_video_get_scan_visible()
 {
 	const uint8_t out_mode = reg_composer[0] & 3;
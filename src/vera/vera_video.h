@@ -18,6 +18,10 @@
 #define SCREEN_WIDTH 640
 #define SCREEN_HEIGHT 480
 
+#define VRAM_SIZE 0x20000
+
+class state_stream;
+
 struct vera_video_layer_properties {
 	uint8_t  color_depth;
 	uint32_t map_base;
@@ -85,6 +89,16 @@ bool vera_video_step(float mhz, float cycles);
 void vera_video_force_redraw_screen();
 bool vera_video_get_irq_out(void);
 void vera_video_save(SDL_RWops *f);
+void vera_video_save_restore(state_stream &state);
+
+// VRAM and one flag per 256-byte page of it, set whenever the page is written to.
+// Whoever looks at the flags clears them.
+uint8_t *vera_video_get_vram();
+uint8_t *vera_video_get_dirty_pages();
+
+// One set of watch_flags (see debugger.h) per 256-byte page of VRAM, checked by
+// vera_video_space_write() and data port reads.
+uint8_t *vera_video_get_watch_pages();
 
 uint8_t vera_debug_video_read(uint8_t reg);
 uint8_t vera_video_read(uint8_t reg);
@@ -98,6 +112,9 @@ uint8_t vera_video_space_read(uint32_t address);
 void    vera_video_space_read_range(uint8_t *dest, uint32_t address, uint32_t size);
 void    vera_video_space_write(uint32_t address, uint8_t value);
 
+// Same as vera_video_space_write for each byte, only much faster for plain VRAM.
+void vera_video_space_write_range(uint32_t address, const uint8_t *src, uint32_t size);
+
 bool vera_video_is_tilemap_address(uint32_t addr);
 bool vera_video_is_tiledata_address(uint32_t addr);
 bool vera_video_is_special_address(uint32_t addr);
@@ -158,6 +175,9 @@ bool vera_video_safety_frame_is_enabled();
 float    vera_video_get_scan_pos_x();
 uint16_t vera_video_get_scan_pos_y();
 
+// Writes made through the data ports since power-on. Wraps around.
+uint32_t vera_video_get_data_write_count();
+
 vera_video_rect vera_video_get_scan_visible();
 
 #endif
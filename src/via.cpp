@@ -7,13 +7,14 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <time.h>
 
 #include "glue.h"
 #include "i2c.h"
 #include "joystick.h"
 #include "memory.h"
+#include "noise.h"
 #include "ps2.h"
+#include "state.h"
 
 //
 // VIA#1
@@ -47,7 +48,6 @@ static uint8_t via1registers[16];
 
 void via1_init()
 {
-	srand((uint32_t)time(NULL));
 	i2c_port.clk_in = 1;
 }
 
@@ -71,7 +71,7 @@ uint8_t via1_read(uint8_t reg)
 		case 9: // timer
 			// timer A and B: return random numbers for RND(0)
 			// XXX TODO: these should be real timers :)
-			return rand() & 0xff;
+			return noise_byte();
 
 		default:
 			return via1registers[reg];
@@ -128,3 +128,9 @@ void via2_write(uint8_t reg, uint8_t value)
 {
 	via2registers[reg] = value;
 }
+
+void via_save_restore(state_stream &state)
+{
+	state.field(via1registers);
+	state.field(via2registers);
+}
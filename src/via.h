@@ -7,6 +7,8 @@
 
 #include <stdint.h>
 
+class state_stream;
+
 void    via1_init();
 uint8_t via1_read(uint8_t reg);
 void    via1_write(uint8_t reg, uint8_t value);
@@ -15,4 +17,6 @@ void    via2_init();
 uint8_t via2_read(uint8_t reg);
 void    via2_write(uint8_t reg, uint8_t value);
 
+void via_save_restore(state_stream &state);
+
 #endif
@@ -0,0 +1,408 @@
+#include "video_recorder.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "audio.h"
+#include "lodepng.h"
+#include "vera/vera_video.h"
+#include "wav_recorder.h"
+
+#if defined(_MSC_VER)
+#	define popen _popen
+#	define pclose _pclose
+#endif
+
+// Video recorder states
+enum video_recorder_state_t {
+	RECORD_VIDEO_DISABLED = 0,
+	RECORD_VIDEO_PAUSED,
+	RECORD_VIDEO_RECORDING
+};
+
+enum video_format_t {
+	VIDEO_FORMAT_RAW = 0,
+	VIDEO_FORMAT_Y4M,
+	VIDEO_FORMAT_PNG
+};
+
+// VERA outputs one frame per SCAN_WIDTH * SCAN_HEIGHT pixel clocks.
+static constexpr uint64_t Pixel_clock      = 25000000;
+static constexpr uint64_t Clocks_per_frame = SCAN_WIDTH * SCAN_HEIGHT;
+
+static video_recorder_state_t Video_record_state = RECORD_VIDEO_DISABLED;
+static char *                 Video_path         = nullptr;
+static video_format_t         Video_format       = VIDEO_FORMAT_RAW;
+static bool                   Video_pipe         = false;
+static FILE *                 Video_file         = nullptr;
+static std::string            Video_png_stem;
+
+// Audio/video alignment, all on the emulation thread.
+static bool     Video_audio         = false;
+static bool     Video_audio_started = false;
+static uint64_t Audio_base          = 0;
+static uint32_t Frames_out          = 0;
+static uint32_t Frames_dropped      = 0;
+
+//
+// Frames are copied into a fixed set of slots and handed to the worker threads.
+// Streams use a single worker so frames come out in order; PNG sequences use
+// several, since each frame goes to its own file. If every slot is busy the frame
+// is dropped and a neighbouring image is repeated in its place, so the timing holds.
+//
+
+struct video_frame {
+	uint32_t number; // first output frame covered by this image
+	uint32_t repeat; // number of output frames covered by this image
+	uint32_t pixels[SCREEN_WIDTH * SCREEN_HEIGHT];
+};
+
+static constexpr int Video_slot_count = 16;
+
+static video_frame              Video_slots[Video_slot_count];
+static std::mutex               Video_mutex;
+static std::condition_variable  Video_work;
+static std::deque<int>          Video_free;
+static std::deque<int>          Video_jobs;
+static std::vector<std::thread> Video_workers;
+static bool                     Video_stopping = false;
+
+static uint64_t samples_for_frames(uint64_t frames)
+{
+	return frames * Clocks_per_frame * audio_get_sample_rate() / Pixel_clock;
+}
+
+static void write_rgb(const video_frame &frame, std::vector<uint8_t> &rgb)
+{
+	rgb.resize(SCREEN_WIDTH * SCREEN_HEIGHT * 3);
+
+	uint8_t *out = rgb.data();
+	for (uint32_t p : frame.pixels) {
+		*out++ = (p >> 16) & 0xff;
+		*out++ = (p >> 8) & 0xff;
+		*out++ = p & 0xff;
+	}
+}
+
+static void write_yuv(const video_frame &frame, std::vector<uint8_t> &yuv)
+{
+	constexpr int plane = SCREEN_WIDTH * SCREEN_HEIGHT;
+	yuv.resize(plane * 3);
+
+	// BT.601, limited range, no chroma subsampling so single pixels keep their color.
+	uint8_t *y = yuv.data();
+	uint8_t *u = y + plane;
+	uint8_t *v = u + plane;
+	for (uint32_t p : frame.pixels) {
+		const int r = (p >> 16) & 0xff;
+		const int g = (p >> 8) & 0xff;
+		const int b = p & 0xff;
+
+		*y++ = static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+		*u++ = static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+		*v++ = static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+	}
+}
+
+static void write_frame(const video_frame &frame, std::vector<uint8_t> &scratch, std::vector<uint8_t> &png)
+{
+	switch (Video_format) {
+		case VIDEO_FORMAT_RAW:
+			write_rgb(frame, scratch);
+			for (uint32_t i = 0; i < frame.repeat; ++i) {
+				fwrite(scratch.data(), 1, scratch.size(), Video_file);
+			}
+			break;
+
+		case VIDEO_FORMAT_Y4M:
+			write_yuv(frame, scratch);
+			for (uint32_t i = 0; i < frame.repeat; ++i) {
+				fputs("FRAME\n", Video_file);
+				fwrite(scratch.data(), 1, scratch.size(), Video_file);
+			}
+			break;
+
+		case VIDEO_FORMAT_PNG:
+			write_rgb(frame, scratch);
+			png.clear();
+			if (lodepng::encode(png, scratch.data(), SCREEN_WIDTH, SCREEN_HEIGHT, LCT_RGB) != 0) {
+				printf("Failed to encode video frame %u\n", frame.number);
+				break;
+			}
+			for (uint32_t i = 0; i < frame.repeat; ++i) {
+				char name[PATH_MAX];
+				snprintf(name, PATH_MAX, "%s-%06u.png", Video_png_stem.c_str(), frame.number + i);
+				if (lodepng::save_file(png, name) != 0) {
+					printf("Failed to write %s\n", name);
+				}
+			}
+			break;
+	}
+}
+
+static void worker_main()
+{
+	std::vector<uint8_t> scratch;
+	std::vector<uint8_t> png;
+
+	for (;;) {
+		int slot;
+		{
+			std::unique_lock<std::mutex> lock(Video_mutex);
+			Video_work.wait(lock, []() { return !Video_jobs.empty() || Video_stopping; });
+			if (Video_jobs.empty()) {
+				return;
+			}
+			slot = Video_jobs.front();
+			Video_jobs.pop_front();
+		}
+
+		write_frame(Video_slots[slot], scratch, png);
+
+		{
+			std::lock_guard<std::mutex> lock(Video_mutex);
+			Video_free.push_back(slot);
+		}
+	}
+}
+
+static bool open_output()
+{
+	const char *ext = strrchr(Video_path, '.');
+
+	Video_pipe = Video_path[0] == '|';
+	if (Video_pipe) {
+		Video_format = VIDEO_FORMAT_Y4M;
+	} else if (ext != nullptr && !strcmp(ext, ".y4m")) {
+		Video_format = VIDEO_FORMAT_Y4M;
+	} else if (ext != nullptr && !strcmp(ext, ".png")) {
+		Video_format = VIDEO_FORMAT_PNG;
+	} else {
+		Video_format = VIDEO_FORMAT_RAW;
+	}
+
+	if (Video_format == VIDEO_FORMAT_PNG) {
+		Video_png_stem.assign(Video_path, ext - Video_path);
+		return true;
+	}
+
+#if defined(_MSC_VER)
+	Video_file = Video_pipe ? popen(Video_path + 1, "wb") : fopen(Video_path, "wb");
+#else
+	Video_file = Video_pipe ? popen(Video_path + 1, "w") : fopen(Video_path, "wb");
+#endif
+	if (Video_file == nullptr) {
+		printf("Cannot open %s for video recording\n", Video_path);
+		return false;
+	}
+	setvbuf(Video_file, nullptr, _IOFBF, 1024 * 1024);
+
+	if (Video_format == VIDEO_FORMAT_Y4M) {
+		fprintf(Video_file, "YUV4MPEG2 W%d H%d F%u:%u Ip A1:1 C444\n", SCREEN_WIDTH, SCREEN_HEIGHT, (unsigned)Pixel_clock, (unsigned)Clocks_per_frame);
+	} else {
+		printf("Recording raw RGB24 video, %dx%d at %u/%u fps\n", SCREEN_WIDTH, SCREEN_HEIGHT, (unsigned)Pixel_clock, (unsigned)Clocks_per_frame);
+	}
+	return true;
+}
+
+// Audio goes through the WAV recorder. If no WAV path was given, record next to the video.
+static void open_audio()
+{
+	Video_audio = false;
+	if (audio_get_sample_rate() == 0) {
+		return;
+	}
+
+	if (wav_recorder_get_state() == 0) { // no WAV path set
+		if (Video_pipe) {
+			printf("Use -wav to record audio alongside piped video\n");
+			return;
+		}
+
+		const char *ext  = strrchr(Video_path, '.');
+		const int   stem = ext ? static_cast<int>(ext - Video_path) : static_cast<int>(strlen(Video_path));
+
+		char wav_path[PATH_MAX];
+		snprintf(wav_path, PATH_MAX, "%.*s.wav,wait", stem, Video_path);
+		wav_recorder_set_path(wav_path);
+	}
+
+	Video_audio = true;
+}
+
+void video_recorder_set_path(const char *path)
+{
+	Video_path = new char[strlen(path) + 1];
+	strcpy(Video_path, path);
+
+	Video_record_state = RECORD_VIDEO_PAUSED;
+}
+
+void video_recorder_init()
+{
+	if (Video_record_state == RECORD_VIDEO_DISABLED) {
+		return;
+	}
+
+	const size_t len       = strlen(Video_path);
+	const bool   start_now = !(len >= 5 && !strcmp(Video_path + len - 5, ",wait"));
+	if (!start_now) {
+		Video_path[len - 5] = 0;
+	}
+
+	if (!open_output()) {
+		Video_record_state = RECORD_VIDEO_DISABLED;
+		return;
+	}
+	open_audio();
+
+	Video_free.clear();
+	Video_jobs.clear();
+	for (int i = 0; i < Video_slot_count; ++i) {
+		Video_free.push_back(i);
+	}
+
+	int num_workers = 1;
+	if (Video_format == VIDEO_FORMAT_PNG) {
+		const int cores = static_cast<int>(std::thread::hardware_concurrency());
+		num_workers     = cores > 2 ? (cores - 1 < 8 ? cores - 1 : 8) : 1;
+	}
+
+	Video_stopping = false;
+	for (int i = 0; i < num_workers; ++i) {
+		Video_workers.emplace_back(worker_main);
+	}
+
+	// Joinable workers would abort an exit() that comes mid-capture.
+	atexit(video_recorder_shutdown);
+
+	Video_record_state = RECORD_VIDEO_PAUSED;
+	if (start_now) {
+		video_recorder_set(RECORD_VIDEO_RECORD);
+	}
+}
+
+void video_recorder_shutdown()
+{
+	if (Video_record_state == RECORD_VIDEO_DISABLED) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(Video_mutex);
+		Video_stopping = true;
+	}
+	Video_work.notify_all();
+	for (auto &worker : Video_workers) {
+		worker.join();
+	}
+	Video_workers.clear();
+
+	if (Video_file != nullptr) {
+		if (Video_pipe) {
+			pclose(Video_file);
+		} else {
+			fclose(Video_file);
+		}
+		Video_file = nullptr;
+	}
+
+	Video_record_state = RECORD_VIDEO_DISABLED;
+}
+
+void video_recorder_update(const uint8_t *framebuffer_bytes)
+{
+	if (Video_record_state != RECORD_VIDEO_RECORDING) {
+		return;
+	}
+
+	uint32_t repeat = 1 + Frames_dropped;
+
+	// Keep the video in step with the audio: audio rendered ahead of emulation (to keep
+	// the device fed) is matched by holding this frame longer, and a missing stretch of
+	// audio is filled with silence.
+	if (Video_audio) {
+		const uint64_t audio     = wav_recorder_get_samples_recorded() - Audio_base;
+		const uint64_t video     = samples_for_frames(Frames_out + repeat);
+		const uint64_t per_frame = samples_for_frames(1);
+		if (per_frame > 0 && audio > video + per_frame) {
+			repeat += static_cast<uint32_t>((audio - video) / per_frame);
+		} else if (audio + per_frame + SAMPLES_PER_BUFFER < video) {
+			wav_recorder_add_silence(static_cast<int>(video - audio));
+		}
+	}
+
+	int slot = -1;
+	{
+		std::lock_guard<std::mutex> lock(Video_mutex);
+		if (!Video_free.empty()) {
+			slot = Video_free.front();
+			Video_free.pop_front();
+		} else if (!Video_jobs.empty()) {
+			// No worker has picked up the newest frame yet, so it can simply be held longer.
+			Video_slots[Video_jobs.back()].repeat += repeat;
+			Frames_out += repeat;
+			Frames_dropped = 0;
+			return;
+		}
+	}
+
+	if (slot < 0) {
+		Frames_dropped = repeat;
+		return;
+	}
+	Frames_dropped = 0;
+
+	video_frame &frame = Video_slots[slot];
+	frame.number       = Frames_out;
+	frame.repeat       = repeat;
+	memcpy(frame.pixels, framebuffer_bytes, sizeof(frame.pixels));
+	Frames_out += repeat;
+
+	{
+		std::lock_guard<std::mutex> lock(Video_mutex);
+		Video_jobs.push_back(slot);
+	}
+	Video_work.notify_one();
+}
+
+// Control the video recorder
+void video_recorder_set(video_recorder_command_t command)
+{
+	if (Video_record_state == RECORD_VIDEO_DISABLED) {
+		return;
+	}
+
+	switch (command) {
+		case RECORD_VIDEO_PAUSE:
+			Video_record_state = RECORD_VIDEO_PAUSED;
+			if (Video_audio) {
+				wav_recorder_set(RECORD_WAV_PAUSE);
+			}
+			break;
+		case RECORD_VIDEO_RECORD:
+			Video_record_state = RECORD_VIDEO_RECORDING;
+			if (Video_audio) {
+				wav_recorder_set(RECORD_WAV_RECORD);
+				if (!Video_audio_started) {
+					// A WAV recording that was already running keeps its lead-in; align from here.
+					Audio_base          = wav_recorder_get_samples_recorded();
+					Video_audio_started = true;
+				}
+			}
+			break;
+		default:
+			printf("Unknown command %d passed to video_recorder_set.\n", (int)command);
+			break;
+	}
+}
+
+uint8_t video_recorder_get_state()
+{
+	return static_cast<uint8_t>(Video_record_state);
+}
\ No newline at end of file
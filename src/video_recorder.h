@@ -0,0 +1,25 @@
+#pragma once
+#if !defined(VIDEO_RECORDER_H)
+#	define VIDEO_RECORDER_H
+
+// Video recorder commands
+enum video_recorder_command_t {
+	RECORD_VIDEO_PAUSE = 0,
+	RECORD_VIDEO_RECORD
+};
+
+// The output format is picked from the path:
+//   foo.y4m       YUV4MPEG2 (4:4:4) stream
+//   foo.png       PNG sequence foo-000000.png, foo-000001.png, ...
+//   |command      Y4M piped to a program's stdin, e.g. "|ffmpeg -i - out.mp4"
+//   anything else raw RGB24 frames
+// A ",wait" suffix starts paused. Audio is recorded alongside by the WAV recorder.
+void video_recorder_set_path(const char *path);
+void video_recorder_init();
+void video_recorder_shutdown();
+void video_recorder_update(const uint8_t *framebuffer_bytes);
+
+void    video_recorder_set(video_recorder_command_t command);
+uint8_t video_recorder_get_state();
+
+#endif
\ No newline at end of file
@@ -1,7 +1,12 @@
 #include "wav_recorder.h"
 
+#include <chrono>
+#include <thread>
+#include <vector>
+
 #include "SDL.h"
 #include "audio.h"
+#include "ring_buffer.h"
 
 // WAV recorder states
 enum wav_recorder_state_t {
@@ -13,13 +18,31 @@ enum wav_recorder_state_t {
 
 static wav_recorder_state_t Wav_record_state = RECORD_WAV_DISABLED;
 static char *               Wav_path         = nullptr;
+static bool                 Wav_float        = false;
+static bool                 Wav_multitrack   = false;
 
-class wav_recorder
+// Track 0 is the final mix, the others are the unmixed sound chips.
+enum wav_track_t {
+	WAV_TRACK_MIX = 0,
+	WAV_TRACK_YM,
+	WAV_TRACK_PSG,
+	WAV_TRACK_PCM,
+	WAV_TRACK_COUNT
+};
+
+static constexpr const char *Wav_track_suffix[WAV_TRACK_COUNT] = { "", "-ym", "-psg", "-pcm" };
+
+//
+// wav_file: a single output file, only ever touched by the writer thread once opened.
+//
+
+class wav_file
 {
 public:
-	void begin(const char *path, int32_t sample_rate);
-	void end();
+	bool open(const char *path, int32_t sample_rate, bool use_float);
+	void close();
 	void add(const int16_t *samples, const int num_samples);
+	void flush();
 
 private:
 #pragma pack(push, 1)
@@ -31,13 +54,21 @@ private:
 
 	struct fmt_chunk {
 		char     chunk_id[4]     = { 'f', 'm', 't', ' ' };
-		uint32_t size            = 16;
+		uint32_t size            = 18;
 		uint16_t format_tag      = 0x0001; // WAVE_FORMAT_PCM
 		uint16_t channels        = 2;
 		uint32_t samples_per_sec = 0;
 		uint32_t bytes_per_sec   = 0;
 		uint16_t block_align     = 0;
 		uint16_t bits_per_sample = 16 * 2;
+		uint16_t extra_size      = 0;
+	};
+
+	// Required for non-PCM formats, such as WAVE_FORMAT_IEEE_FLOAT.
+	struct fact_chunk {
+		char     chunk_id[4]   = { 'f', 'a', 'c', 't' };
+		uint32_t size          = 4;
+		uint32_t sample_length = 0;
 	};
 
 	struct data_chunk {
@@ -48,61 +79,289 @@ private:
 	struct file_header {
 		riff_chunk riff;
 		fmt_chunk  fmt;
+		fact_chunk fact;
 		data_chunk data;
 	};
 #pragma pack(pop)
 
-	file_header header;
-	uint32_t    samples_written = 0;
+	static constexpr size_t Batch_size = 1024 * 1024;
+
+	file_header          header;
+	uint32_t             samples_written = 0;
+	bool                 is_float        = false;
+	std::vector<uint8_t> batch;
+
+	SDL_RWops *file = nullptr;
+
+	// Plain PCM files keep the classic 44-byte header: a 16-byte fmt chunk and no fact chunk.
+	size_t fmt_size() const
+	{
+		return is_float ? sizeof(fmt_chunk) : sizeof(fmt_chunk) - sizeof(uint16_t);
+	}
+
+	size_t header_size() const
+	{
+		return sizeof(riff_chunk) + fmt_size() + (is_float ? sizeof(fact_chunk) : 0) + sizeof(data_chunk);
+	}
 
-	SDL_RWops *wav_file = nullptr;
+	void write_header()
+	{
+		SDL_RWwrite(file, &header.riff, sizeof(riff_chunk), 1);
+		SDL_RWwrite(file, &header.fmt, fmt_size(), 1);
+		if (is_float) {
+			SDL_RWwrite(file, &header.fact, sizeof(fact_chunk), 1);
+		}
+		SDL_RWwrite(file, &header.data, sizeof(data_chunk), 1);
+	}
 
 	void update_sizes()
 	{
-		header.data.size = sizeof(int16_t) * header.fmt.channels * samples_written;
-		header.riff.size = 4 + sizeof(fmt_chunk) + sizeof(data_chunk) + (header.data.size);
+		header.data.size          = header.fmt.block_align * samples_written;
+		header.fact.sample_length = samples_written;
+		header.riff.size          = static_cast<uint32_t>(4 + header_size() - sizeof(riff_chunk) + header.data.size);
 	}
 };
 
+bool wav_file::open(const char *path, int32_t sample_rate, bool use_float)
+{
+	file = SDL_RWFromFile(path, "wb");
+	if (file == nullptr) {
+		printf("Cannot write to %s!\n", path);
+		return false;
+	}
+
+	is_float        = use_float;
+	samples_written = 0;
+	header          = file_header();
+
+	const uint16_t sample_size = is_float ? sizeof(float) : sizeof(int16_t);
+
+	header.fmt.size            = static_cast<uint32_t>(fmt_size() - 8);
+	header.fmt.format_tag      = is_float ? 0x0003 : 0x0001; // WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM
+	header.fmt.samples_per_sec = sample_rate;
+	header.fmt.bytes_per_sec   = sample_rate * sample_size * header.fmt.channels;
+	header.fmt.block_align     = sample_size * header.fmt.channels;
+	header.fmt.bits_per_sample = sample_size << 3;
+
+	// Sizes are fixed up in close(); this just reserves the space.
+	update_sizes();
+	write_header();
+
+	batch.clear();
+	batch.reserve(Batch_size);
+	return true;
+}
+
+void wav_file::close()
+{
+	if (file != nullptr) {
+		flush();
+		if (file != nullptr) {
+			update_sizes();
+			SDL_RWseek(file, 0, RW_SEEK_SET);
+			write_header();
+			SDL_RWclose(file);
+			file = nullptr;
+		}
+	}
+	batch.clear();
+	batch.shrink_to_fit();
+}
+
+void wav_file::add(const int16_t *samples, const int num_samples)
+{
+	if (file == nullptr) {
+		return;
+	}
+
+	const size_t values = 2 * num_samples;
+	const size_t offset = batch.size();
+	if (is_float) {
+		batch.resize(offset + values * sizeof(float));
+		float *out = reinterpret_cast<float *>(batch.data() + offset);
+		for (size_t i = 0; i < values; ++i) {
+			out[i] = samples[i] * (1.0f / 32768.0f);
+		}
+	} else {
+		batch.resize(offset + values * sizeof(int16_t));
+		memcpy(batch.data() + offset, samples, values * sizeof(int16_t));
+	}
+	samples_written += num_samples;
+
+	if (batch.size() >= Batch_size) {
+		flush();
+	}
+}
+
+void wav_file::flush()
+{
+	if (file != nullptr && !batch.empty()) {
+		if (SDL_RWwrite(file, batch.data(), batch.size(), 1) == 0) {
+			printf("Error writing wav file, recording stopped.\n");
+			SDL_RWclose(file);
+			file = nullptr;
+		}
+	}
+	batch.clear();
+}
+
+//
+// wav_recorder: hands blocks from the emulation thread to a background writer.
+//
+
+class wav_recorder
+{
+public:
+	// exit() (the guest powering off, say) can come while recording. A joinable thread
+	// would abort the process then, before the headers were fixed up.
+	~wav_recorder() { end(); }
+
+	void begin(const char *path, int32_t sample_rate);
+	void end();
+	void add(const int16_t *samples, const int num_samples);
+	void add_silence(int num_samples);
+
+	uint64_t samples_recorded() const { return recorded; }
+
+private:
+	struct block {
+		int     num_samples;
+		int16_t tracks[WAV_TRACK_COUNT][2 * SAMPLES_PER_BUFFER];
+	};
+
+	block *acquire_block();
+	void   writer_main();
+
+	spsc_queue<block, 256> queue;
+	wav_file               files[WAV_TRACK_COUNT];
+	int                    num_tracks = 0;
+
+	std::thread       writer;
+	std::atomic<bool> stopping{ false };
+	bool              running  = false;
+	uint64_t          recorded = 0;
+};
+
 void wav_recorder::begin(const char *path, int32_t sample_rate)
 {
-	wav_file = SDL_RWFromFile(path, "wb");
-	if (wav_file) {
-		header.fmt.samples_per_sec = sample_rate;
-		header.fmt.bytes_per_sec   = sample_rate * sizeof(int16_t) * header.fmt.channels;
-		header.fmt.block_align     = sizeof(int16_t) * header.fmt.channels;
-		header.fmt.bits_per_sample = (sizeof(int16_t)) << 3;
-
-		const size_t written = SDL_RWwrite(wav_file, &header, sizeof(file_header), 1);
-		if (written == 0) {
-			SDL_RWclose(wav_file);
-			wav_file = nullptr;
+	if (running) {
+		// Resuming after a pause keeps appending to the same files.
+		return;
+	}
+
+	num_tracks = Wav_multitrack ? WAV_TRACK_COUNT : 1;
+	for (int t = 0; t < num_tracks; ++t) {
+		char track_path[PATH_MAX];
+		if (t == WAV_TRACK_MIX) {
+			snprintf(track_path, PATH_MAX, "%s", path);
+		} else {
+			// foo.wav -> foo-ym.wav
+			const char *ext     = strrchr(path, '.');
+			const int   stem    = ext ? static_cast<int>(ext - path) : static_cast<int>(strlen(path));
+			const char *ext_str = ext ? ext : "";
+			snprintf(track_path, PATH_MAX, "%.*s%s%s", stem, path, Wav_track_suffix[t], ext_str);
+		}
+
+		if (!files[t].open(track_path, sample_rate, Wav_float)) {
+			for (int c = 0; c < t; ++c) {
+				files[c].close();
+			}
+			num_tracks = 0;
+			return;
 		}
 	}
+
+	stopping = false;
+	running  = true;
+	recorded = 0;
+	writer   = std::thread([this]() { writer_main(); });
 }
 
 void wav_recorder::end()
 {
-	if (wav_file != nullptr) {
-		update_sizes();
-		SDL_RWseek(wav_file, 0, RW_SEEK_SET);
-		SDL_RWwrite(wav_file, &header, sizeof(file_header), 1);
-		SDL_RWclose(wav_file);
-		wav_file = nullptr;
+	if (!running) {
+		return;
 	}
+
+	stopping = true;
+	writer.join();
+	running = false;
+
+	for (int t = 0; t < num_tracks; ++t) {
+		files[t].close();
+	}
+	num_tracks = 0;
+}
+
+wav_recorder::block *wav_recorder::acquire_block()
+{
+	if (!running) {
+		return nullptr;
+	}
+
+	// The queue holds seconds of audio, so it only fills if the disk can't keep up at all.
+	block *b;
+	while ((b = queue.begin_write()) == nullptr) {
+		std::this_thread::yield();
+	}
+	return b;
 }
 
 void wav_recorder::add(const int16_t *samples, const int num_samples)
 {
-	if (wav_file) {
-		const size_t bytes   = sizeof(int16_t) * 2 * num_samples;
-		const size_t written = SDL_RWwrite(wav_file, samples, bytes, 1);
-		if (written == 0) {
-			SDL_RWclose(wav_file);
-			wav_file = nullptr;
-		} else {
-			samples_written += num_samples;
+	block *b = acquire_block();
+	if (b == nullptr) {
+		return;
+	}
+
+	b->num_samples = num_samples;
+	memcpy(b->tracks[WAV_TRACK_MIX], samples, sizeof(int16_t) * 2 * num_samples);
+	if (num_tracks > 1) {
+		audio_get_ym_buffer(b->tracks[WAV_TRACK_YM]);
+		audio_get_psg_buffer(b->tracks[WAV_TRACK_PSG]);
+		audio_get_pcm_buffer(b->tracks[WAV_TRACK_PCM]);
+	}
+	queue.end_write();
+
+	recorded += num_samples;
+}
+
+void wav_recorder::add_silence(int num_samples)
+{
+	while (num_samples > 0) {
+		block *b = acquire_block();
+		if (b == nullptr) {
+			return;
 		}
+
+		b->num_samples = num_samples < SAMPLES_PER_BUFFER ? num_samples : SAMPLES_PER_BUFFER;
+		memset(b->tracks, 0, sizeof(b->tracks));
+		const int n = b->num_samples;
+		queue.end_write();
+
+		recorded += n;
+		num_samples -= n;
+	}
+}
+
+void wav_recorder::writer_main()
+{
+	for (;;) {
+		// Read the flag before draining, so nothing queued ahead of end() is lost.
+		const bool last_pass = stopping;
+
+		block *b;
+		while ((b = queue.begin_read()) != nullptr) {
+			for (int t = 0; t < num_tracks; ++t) {
+				files[t].add(b->tracks[t], b->num_samples);
+			}
+			queue.end_read();
+		}
+
+		if (last_pass) {
+			break;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
 	}
 }
 
@@ -114,9 +373,7 @@ void wav_recorder_init()
 
 void wav_recorder_shutdown()
 {
-	if (Wav_record_state == RECORD_WAV_RECORDING) {
-		Wav_recorder.end();
-	}
+	Wav_recorder.end();
 }
 
 void wav_recorder_process(const int16_t *samples, const int num_samples)
@@ -136,6 +393,13 @@ void wav_recorder_process(const int16_t *samples, const int num_samples)
 	}
 }
 
+void wav_recorder_add_silence(const int num_samples)
+{
+	if (Wav_record_state == RECORD_WAV_RECORDING) {
+		Wav_recorder.add_silence(num_samples);
+	}
+}
+
 void wav_recorder_set(wav_recorder_command_t command)
 {
 	if (Wav_record_state != RECORD_WAV_DISABLED) {
@@ -162,11 +426,20 @@ uint8_t wav_recorder_get_state()
 	return (uint8_t)Wav_record_state;
 }
 
+uint64_t wav_recorder_get_samples_recorded()
+{
+	return Wav_recorder.samples_recorded();
+}
+
+void wav_recorder_set_format(bool use_float, bool multitrack)
+{
+	Wav_float      = use_float;
+	Wav_multitrack = multitrack;
+}
+
 void wav_recorder_set_path(const char *path)
 {
-	if (Wav_record_state == RECORD_WAV_RECORDING) {
-		Wav_recorder.end();
-	}
+	Wav_recorder.end();
 
 	if (Wav_path != nullptr) {
 		delete[] Wav_path;
@@ -11,10 +11,17 @@ enum wav_recorder_command_t {
 void wav_recorder_init();
 void wav_recorder_shutdown();
 void wav_recorder_process(const int16_t *samples, const int num_samples);
+void wav_recorder_add_silence(const int num_samples);
 
 void    wav_recorder_set(wav_recorder_command_t command);
 uint8_t wav_recorder_get_state();
 
+// Sample frames handed to the writer since the current files were opened, including added silence.
+uint64_t wav_recorder_get_samples_recorded();
+
+// Takes effect the next time recording starts.
+// Multitrack writes the unmixed YM, PSG and PCM output next to the mix, as <name>-ym.wav and so on.
+void wav_recorder_set_format(bool use_float, bool multitrack);
 void wav_recorder_set_path(const char *path);
 
 #endif
\ No newline at end of file
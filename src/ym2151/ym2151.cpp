@@ -8,6 +8,7 @@
 
 #include "audio.h"
 #include "bitutils.h"
+#include "state.h"
 
 //#define YM2151_USE_PICK 1
 //#define YM2151_USE_LINEAR_INTERPOLATION 1
@@ -315,18 +316,19 @@ public:
 		}
 	}
 
-	void write(uint8_t addr, uint8_t value)
+	bool write(uint8_t addr, uint8_t value)
 	{
 		if (ymfm_is_busy()) {
 			if (YM_is_strict()) {
 				printf("WARN: Write to YM2151 ($%02X <- $%02X) while busy.\n", (int)addr, (int)value);
-			} else {
-				m_write_queue.push({ addr, value });
+				return false;
 			}
+			m_write_queue.push({ addr, value });
 		} else {
 			m_chip.write_address(addr);
 			m_chip.write_data(value, false);
 		}
+		return true;
 	}
 
 	void reset()
@@ -334,6 +336,56 @@ public:
 		m_chip.reset();
 	}
 
+	void save_restore(state_stream &state)
+	{
+		// ymfm serializes the chip itself, nest its output as a sized blob.
+		if (state.saving()) {
+			ymfm::ymfm_saved_state chip_state(m_chip_state, true);
+			m_chip.save_restore(chip_state);
+		}
+		uint32_t chip_state_size = (uint32_t)m_chip_state.size();
+		state.field(chip_state_size);
+		m_chip_state.resize(chip_state_size);
+		state.bytes(m_chip_state.data(), chip_state_size);
+		if (!state.saving()) {
+			ymfm::ymfm_saved_state chip_state(m_chip_state, false);
+			m_chip.save_restore(chip_state);
+		}
+
+		state.field(m_generation_time);
+		state.field(m_backbuffer_used);
+		if (m_backbuffer_used > m_backbuffer_size) {
+			m_backbuffer_used = 0;
+		}
+		state.bytes(m_backbuffer, sizeof(m_backbuffer[0]) * m_backbuffer_used);
+		state.field(m_previous_samples);
+
+		uint32_t queued = (uint32_t)m_write_queue.size();
+		state.field(queued);
+		if (state.saving()) {
+			for (uint32_t i = 0; i < queued; ++i) {
+				auto [addr, value] = m_write_queue.front();
+				state.field(addr);
+				state.field(value);
+				m_write_queue.pop();
+				m_write_queue.push({ addr, value });
+			}
+		} else {
+			m_write_queue = {};
+			for (uint32_t i = 0; i < queued && state.good(); ++i) {
+				uint8_t addr  = 0;
+				uint8_t value = 0;
+				state.field(addr);
+				state.field(value);
+				m_write_queue.push({ addr, value });
+			}
+		}
+
+		state.field(m_timers);
+		state.field(m_busy_timer);
+		state.field(m_irq_status);
+	}
+
 	void debug_write(uint8_t addr, uint8_t value)
 	{
 		// do a direct write without triggering the busy timer
@@ -427,6 +479,8 @@ private:
 	int32_t m_busy_timer;
 
 	bool m_irq_status;
+
+	std::vector<uint8_t> m_chip_state;
 };
 
 static ym2151_interface Ym_interface;
@@ -435,18 +489,18 @@ static uint8_t          Last_data    = 0;
 static uint8_t          Ym_registers[256];
 static bool             Ym_irq_enabled = false;
 static bool             Ym_strict_busy = false;
+static uint32_t         Clocks_elapsed = 0;
 
 void YM_prerender(uint32_t clocks)
 {
-	static uint32_t clocks_elapsed = 0;
-	clocks_elapsed += clocks;
+	Clocks_elapsed += clocks;
 
 	const uint32_t clocks_per_sample = 8000000 / Ym_interface.get_sample_rate();
-	const uint32_t samples_to_render = clocks_elapsed / clocks_per_sample;
+	const uint32_t samples_to_render = Clocks_elapsed / clocks_per_sample;
 
 	if (samples_to_render > 0) {
 		Ym_interface.pregenerate(samples_to_render);
-		clocks_elapsed -= samples_to_render * clocks_per_sample;
+		Clocks_elapsed -= samples_to_render * clocks_per_sample;
 	}
 }
 
@@ -480,17 +534,18 @@ void YM_set_strict_busy(bool enable)
 	Ym_strict_busy = enable;
 }
 
-void YM_write(uint8_t offset, uint8_t value)
+bool YM_write(uint8_t offset, uint8_t value)
 {
 	// save the hassle to add interface to dig into opm_registers by caching the writes here
 	if (offset & 1) { // data port
 		Last_data                  = value;
 		Ym_registers[Last_address] = Last_data;
 
-		Ym_interface.write(Last_address, Last_data);
+		return Ym_interface.write(Last_address, Last_data);
 	} else { // address port
 		Last_address = value;
 	}
+	return true;
 }
 
 uint8_t YM_read_status()
@@ -510,6 +565,15 @@ void YM_reset()
 	memset(&Ym_registers[0x20], 0xc0, 8);
 }
 
+void YM_save_restore(state_stream &state)
+{
+	Ym_interface.save_restore(state);
+	state.field(Last_address);
+	state.field(Last_data);
+	state.field(Ym_registers);
+	state.field(Clocks_elapsed);
+}
+
 void YM_debug_write(uint8_t addr, uint8_t value)
 {
 	Ym_registers[addr] = value;
@@ -29,6 +29,8 @@
 #	define YM_CLOCK_RATE (3579545)
 #	define YM_SAMPLE_RATE (YM_CLOCK_RATE >> 6)
 
+class state_stream;
+
 void     YM_prerender(uint32_t clocks);
 void     YM_render(int16_t *buffers, uint32_t samples, uint32_t sample_rate);
 uint32_t YM_get_sample_rate();
@@ -39,10 +41,12 @@ void YM_set_irq_enabled(bool enabled);
 bool YM_is_strict();
 void YM_set_strict_busy(bool enable);
 
-void    YM_write(uint8_t offset, uint8_t value);
+// False if the chip was busy and -ymstrict dropped a data write.
+bool    YM_write(uint8_t offset, uint8_t value);
 uint8_t YM_read_status();
 bool    YM_irq();
 void    YM_reset();
+void    YM_save_restore(state_stream &state);
 
 // debug stuff
 void    YM_debug_write(uint8_t addr, uint8_t value);